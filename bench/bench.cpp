@@ -0,0 +1,231 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "globals.hpp"
+#include "particles.hpp"
+#include "observables.hpp"
+#include "simulation.hpp"
+#include "utils.hpp"
+#include "bench_utils.hpp"
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+// Globals that are normally defined in the main file (set by MakeReplica)
+__thread int N = 3000;
+__thread double Size = 0;
+
+/**
+ * @brief Timing of one kernel at one system size.
+ */
+struct bench_result {
+    std::string kernel;      ///< Benchmarked function
+    std::string unit;        ///< What one operation is (pair, particle, trial, call)
+    int N;                   ///< Number of particles
+    long long ops;           ///< Number of timed operations
+    double seconds;          ///< Total time of the operations
+    long long config_bytes;  ///< Memory held by the benchmarked configuration
+    long long peak_rss_bytes;///< Peak resident memory of the process so far
+};
+
+// Sink preventing the compiler from discarding benchmarked results
+volatile double sink;
+
+// Repeats a call until min_time seconds have elapsed
+bench_result Measure(std::string kernel, std::string unit, long long ops_per_call, double min_time,
+                     const std::function<void()>& call){
+    typedef std::chrono::steady_clock clock;
+    long long calls = 0;
+    double elapsed = 0;
+    clock::time_point start = clock::now();
+    do {
+        call(); calls++;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < min_time);
+    bench_result result;
+    result.kernel = kernel; result.unit = unit; result.N = N;
+    result.ops = calls*ops_per_call; result.seconds = elapsed;
+    result.config_bytes = 0; result.peak_rss_bytes = 0;
+    return result;
+}
+
+// Benchmarks every kernel on one configuration
+std::vector<bench_result> RunKernels(configuration& cfg, double T, double min_time, std::string scratch){
+    std::vector<bench_result> results;
+    const int batch = 1024;
+
+    // Pairs of neighbours and bonded pairs
+    std::vector<std::pair<int, int>> pairs, bonds;
+    for (int j = 0; j < N && (int)pairs.size() < batch; j += 7){
+        for (int i: cfg.neighbours_list[j]) pairs.push_back(std::make_pair(j, i));
+        if (cfg.bond_start[j+1] > cfg.bond_start[j]) bonds.push_back(std::make_pair(j, cfg.bond_partner[cfg.bond_start[j]]));
+    }
+    pairs.resize(std::min((int)pairs.size(), batch));
+    std::vector<int> particles(batch);
+    for (int& j: particles) j = floor(ranf()*N);
+
+    results.push_back(Measure("WCAPair", "pair", pairs.size(), min_time, [&](){
+        double sum = 0;
+        for (const std::pair<int, int>& p: pairs){
+            int j = p.first, i = p.second;
+            sum += WCAPair(cfg.X[j], cfg.Y[j], cfg.Z[j], diameters[cfg.S[j]-1],
+                           cfg.X[i], cfg.Y[i], cfg.Z[i], diameters[cfg.S[i]-1]);
+        } sink = sum;
+    }));
+    results.push_back(Measure("FENEPair", "pair", bonds.size(), min_time, [&](){
+        double sum = 0;
+        for (const std::pair<int, int>& p: bonds){
+            int j = p.first, i = p.second;
+            sum += FENEPair(cfg.X[j], cfg.Y[j], cfg.Z[j], diameters[cfg.S[j]-1],
+                            cfg.X[i], cfg.Y[i], cfg.Z[i], diameters[cfg.S[i]-1]);
+        } sink = sum;
+    }));
+    results.push_back(Measure("V", "particle", batch, min_time, [&](){
+        double sum = 0;
+        for (int j: particles) sum += V(cfg, j);
+        sink = sum;
+    }));
+    results.push_back(Measure("VTotal", "call", 1, min_time, [&](){ sink = VTotal(cfg); }));
+    results.push_back(Measure("UpdateNL", "call", 1, min_time, [&](){ cfg.UpdateNL(); }));
+    results.push_back(Measure("CheckNL", "call", 1, min_time, [&](){ cfg.CheckNL(); }));
+
+    // Trial moves, with the usual neighbours list check after each sweep
+    configuration cfg0 = cfg;
+    results.push_back(Measure("TryDisp", "trial", N, min_time, [&](){
+        for (int i = 0; i < N; i++) TryDisp(cfg, floor(ranf()*N), T);
+        cfg.CheckNL();
+    }));
+    results.push_back(Measure("TryFlip", "trial", N, min_time, [&](){
+        for (int i = 0; i < N; i++) TryFlip(cfg, floor(ranf()*N), T);
+        cfg.CheckNL();
+    }));
+    results.push_back(Measure("TryHeatBathFlip", "trial", N, min_time, [&](){
+        for (int i = 0; i < N; i++) TryHeatBathFlip(cfg, floor(ranf()*N), T);
+        cfg.CheckNL();
+    }));
+
+    // Sweep kernels of pure displacement and mixed runs
+    run_stats counters;
+    results.push_back(Measure("SweepDisp", "trial", N, min_time, [&](){
+        Sweep<displacement_moves>(cfg, T, 0, counters);
+        cfg.CheckNL();
+    }));
+    results.push_back(Measure("SweepMixed", "trial", N, min_time, [&](){
+        Sweep<mixed_moves>(cfg, T, 0.2, counters);
+        cfg.CheckNL();
+    }));
+
+    // Dynamical observables against the initial configuration
+    cfg.UpdateCM_coord(); cfg0.UpdateCM_coord();
+    results.push_back(Measure("MSD", "call", 1, min_time, [&](){ sink = MSD(cfg, cfg0); }));
+    results.push_back(Measure("FS", "call", 1, min_time, [&](){ sink = FS(cfg, cfg0); }));
+
+    // Configuration I/O
+    results.push_back(Measure("WriteTrimCFG", "call", 1, min_time, [&](){ WriteTrimCFG(cfg, scratch); }));
+    results.push_back(Measure("ReadTrimCFG", "call", 1, min_time, [&](){ ReadTrimCFG(scratch, cfg0); }));
+    fs::remove(scratch);
+
+    for (bench_result& result: results){
+        result.config_bytes = ConfigurationBytes(cfg); result.peak_rss_bytes = PeakRSS();
+    }
+    return results;
+}
+
+// Prints results as an aligned table, CSV or JSON
+void PrintResults(const std::vector<bench_result>& results, std::string format, std::ostream& os){
+    if (format == "json"){
+        os << "{\"hardware_threads\": " << std::thread::hardware_concurrency() << ", \"results\": [";
+        for (size_t k = 0; k < results.size(); k++){
+            const bench_result& r = results[k];
+            os << (k ? ", " : "") << "{\"kernel\": \"" << r.kernel << "\", \"unit\": \"" << r.unit
+               << "\", \"N\": " << r.N << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds
+               << ", \"ns_per_op\": " << 1e9*r.seconds/r.ops << ", \"ops_per_s\": " << r.ops/r.seconds
+               << ", \"config_bytes\": " << r.config_bytes << ", \"peak_rss_bytes\": " << r.peak_rss_bytes << "}";
+        }
+        os << "]}" << std::endl;
+    } else if (format == "csv"){
+        os << "kernel,unit,N,ops,seconds,ns_per_op,ops_per_s,config_bytes,peak_rss_bytes" << std::endl;
+        for (const bench_result& r: results){
+            os << r.kernel << "," << r.unit << "," << r.N << "," << r.ops << "," << r.seconds << ","
+               << 1e9*r.seconds/r.ops << "," << r.ops/r.seconds << "," << r.config_bytes << ","
+               << r.peak_rss_bytes << std::endl;
+        }
+    } else {
+        os << std::left << std::setw(14) << "kernel" << std::setw(10) << "N" << std::setw(10) << "unit"
+           << std::right << std::setw(14) << "ns/op" << std::setw(14) << "ops/s"
+           << std::setw(12) << "cfg [MB]" << std::setw(12) << "RSS [MB]" << std::endl;
+        for (const bench_result& r: results){
+            os << std::left << std::setw(14) << r.kernel << std::setw(10) << r.N << std::setw(10) << r.unit
+               << std::right << std::fixed << std::setprecision(1) << std::setw(14) << 1e9*r.seconds/r.ops
+               << std::scientific << std::setprecision(3) << std::setw(14) << r.ops/r.seconds
+               << std::fixed << std::setprecision(1) << std::setw(12) << r.config_bytes/1048576.
+               << std::setw(12) << r.peak_rss_bytes/1048576. << std::endl;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//  bench.cpp
+int main(int argc, const char * argv[]) {
+    std::string input, format, output;
+    std::vector<int> replicas;
+    double T, min_time;
+    bool sort;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Produce help message")
+        ("init", po::value<std::string>(&input)->default_value(std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz"),
+                 "Configuration replicated to build the benchmarked systems")
+        ("replicas", po::value<std::vector<int>>(&replicas)->multitoken()->default_value(std::vector<int>{1, 2, 3, 4}, "1 2 3 4"),
+                     "Number of replicas along each direction (N grows as replicas^3)")
+        ("T", po::value<double>(&T)->default_value(2.0), "Temperature of the trial moves")
+        ("sort", po::bool_switch(&sort), "Sort molecules along a Morton curve before benchmarking")
+        ("min-time", po::value<double>(&min_time)->default_value(0.2), "Minimum seconds spent on each kernel")
+        ("format", po::value<std::string>(&format)->default_value("table"), "Output format (table, csv or json)")
+        ("output", po::value<std::string>(&output)->default_value(""), "Output file (standard output if empty)");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const po::error& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    if (format != "table" && format != "csv" && format != "json"){
+        std::cerr << "Error: Unknown format " << format << std::endl;
+        return 1;
+    }
+
+    generator.Seed(12345);
+    std::string scratch = (fs::temp_directory_path() / fs::unique_path("tfmc-bench-%%%%%%.xy")).string();
+    std::vector<bench_result> results;
+    for (int k: replicas){
+        configuration cfg = MakeReplica(input, k);
+        if (sort) cfg.Permute(MortonOrder(cfg));
+        std::cerr << "Benchmarking N = " << N << std::endl;
+        std::vector<bench_result> size_results = RunKernels(cfg, T, min_time, scratch);
+        results.insert(results.end(), size_results.begin(), size_results.end());
+    }
+
+    if (output.empty()){
+        PrintResults(results, format, std::cout);
+    } else {
+        std::ofstream out(output);
+        PrintResults(results, format, out);
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <sys/resource.h>
+#include "globals.hpp"
+#include "utils.hpp"
+#include "bench_utils.hpp"
+
+// Peak resident memory of the process
+long long PeakRSS(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;       // bytes
+#else
+    return usage.ru_maxrss*1024LL; // kilobytes
+#endif
+}
+
+// Memory held by a configuration
+long long ConfigurationBytes(const configuration& cfg){
+    long long bytes = sizeof(real)*(cfg.X.capacity() + cfg.Y.capacity() + cfg.Z.capacity() +
+                                    cfg.X0.capacity() + cfg.Y0.capacity() + cfg.Z0.capacity()) +
+                      sizeof(double)*(cfg.Xfull.capacity() + cfg.Yfull.capacity() + cfg.Zfull.capacity()) +
+                      sizeof(int)*(cfg.S.capacity() + cfg.molecule.capacity() + cfg.mol_start.capacity() +
+                                   cfg.bond_start.capacity() + cfg.bond_partner.capacity());
+    for (const std::vector<int>& list: cfg.neighbours_list) bytes += sizeof(std::vector<int>) + sizeof(int)*list.capacity();
+    return bytes;
+}
+
+// Number of particles stored in a configuration file
+int CountParticles(std::string input){
+    std::ifstream input_file(input);
+    if (!input_file.is_open()){
+        throw std::runtime_error("Could not open file: " + input);
+    }
+    std::string line;
+    int count = 0;
+    while (std::getline(input_file, line)){
+        if (line.find_first_not_of(" \t\r") != std::string::npos) count++;
+    }
+    return count;
+}
+
+// Builds a configuration by replicating a configuration file k times along each direction
+configuration MakeReplica(std::string input, int k){
+    int n = CountParticles(input); double L = pow(n/density, 1./3.);
+    N = n; Size = L;
+    configuration base = ReadTrimCFG(input);
+    N = n*k*k*k; Size = L*k;
+    configuration cfg;
+    std::vector<int> molecules(N);
+    int i = 0;
+    for (int a = 0; a < k; a++){
+        for (int b = 0; b < k; b++){
+            for (int c = 0; c < k; c++){
+                for (int j = 0; j < n; j++, i++){
+                    cfg.S[i] = base.S[j]; molecules[i] = base.molecule[j] + (i/n)*base.Molecules();
+                    cfg.Xfull[i] = base.Xfull[j] + a*L; cfg.X[i] = ShiftInMainBox(cfg.Xfull[i]);
+                    cfg.Yfull[i] = base.Yfull[j] + b*L; cfg.Y[i] = ShiftInMainBox(cfg.Yfull[i]);
+                    cfg.Zfull[i] = base.Zfull[j] + c*L; cfg.Z[i] = ShiftInMainBox(cfg.Zfull[i]);
+                }
+            }
+        }
+    }
+    cfg.X0 = cfg.X; cfg.Y0 = cfg.Y; cfg.Z0 = cfg.Z;
+    cfg.SetMolecules(molecules); cfg.UpdateNL();
+    return cfg;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file bench_utils.hpp
+ * @brief Helpers shared by the benchmark executables.
+ *
+ * Benchmarked systems are built by replicating a configuration file along the three
+ * directions, which keeps its density and local structure at any number of particles.
+ */
+
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <string>
+#include "particles.hpp"
+
+/**
+ * @brief Peak resident memory of the process.
+ *
+ * @return Peak resident memory in bytes.
+ */
+long long PeakRSS();
+
+/**
+ * @brief Memory held by a configuration.
+ *
+ * @param cfg Configuration.
+ * @return Size of the configuration's arrays and lists in bytes.
+ */
+long long ConfigurationBytes(const configuration& cfg);
+
+/**
+ * @brief Builds a configuration by replicating a configuration file.
+ *
+ * N and Size are set to the values of the replicated system. Bonds and neighbours lists are
+ * built.
+ *
+ * @param input Path to the configuration file.
+ * @param k Number of replicas along each direction.
+ * @return Replicated configuration of k^3 times the particles of the file.
+ */
+configuration MakeReplica(std::string input, int k);
+
+#endif // BENCH_UTILS_H
@@ -0,0 +1,258 @@
+#include <cmath>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <sstream>
+#include <boost/program_options.hpp>
+#include "globals.hpp"
+#include "particles.hpp"
+#include "observables.hpp"
+#include "simulation.hpp"
+#include "utils.hpp"
+#include "bench_utils.hpp"
+
+namespace po = boost::program_options;
+
+// Globals that are normally defined in the main file (set by MakeReplica)
+__thread int N = 3000;
+__thread double Size = 0;
+
+/**
+ * @brief Relaxation of one move mix.
+ */
+struct decorrelation_result {
+    double p_flip;           ///< Probability of a flip
+    double step;             ///< Width of the trial displacements
+    double disp_acceptance;  ///< Acceptance rate of the displacements
+    double flip_acceptance;  ///< Acceptance rate of the flips
+    double swap_acceptance;  ///< Acceptance rate of the inter-molecular swaps
+    long long sweeps;        ///< Number of MC sweeps performed
+    double seconds;          ///< Seconds spent in these sweeps
+    double tau_sweeps;       ///< Sweeps needed for Fs to reach 1/e (negative if not reached)
+    double tau_seconds;      ///< Seconds needed for Fs to reach 1/e (negative if not reached)
+};
+
+// Moves of the measured runs
+struct move_mix {
+    double p_flip;
+    double step;
+};
+
+// Optional swap and volume moves shared by every mix
+struct extra_moves {
+    double swap_fraction;
+    bool swap_local;
+    int volume_every;
+    double pressure;
+    double max_dlnV;
+    bool heat_bath;
+};
+
+// Runs one move mix until Fs decays to 1/e, sampling Fs on log-spaced sweeps
+decorrelation_result MeasureDecorrelation(const configuration& initial, double T, const move_mix& mix,
+                                          const extra_moves& extra, std::string fs_name, int warmup,
+                                          long long max_sweeps, double ratio){
+    typedef std::chrono::steady_clock clock;
+    configuration cfg = initial;
+    double size = Size;
+    maximum_displacement = mix.step;
+    sweep_kernel sweep = SelectSweep(mix.p_flip, extra.heat_bath);
+    const long long swaps = llround(extra.swap_fraction*N);
+    run_stats stats;
+    for (int t = 1; t <= warmup; t++){
+        cfg.CheckNL();
+        sweep(cfg, T, mix.p_flip, stats);
+    }
+    stats = run_stats();
+
+    observables_set obs({fs_name});
+    cfg.UpdateCM_coord();
+    configuration cfg0 = cfg;
+    const double threshold = exp(-1.);
+    double t_prev = 0, fs_prev = 1, seconds = 0, seconds_prev = 0;
+    decorrelation_result result;
+    result.p_flip = mix.p_flip; result.step = mix.step;
+    result.tau_sweeps = -1; result.tau_seconds = -1;
+
+    long long t = 0, next = 1;
+    while (t < max_sweeps){
+        // Timed sweeps, with the neighbours list checks of a production run
+        clock::time_point start = clock::now();
+        for (; t < next; t++){
+            cfg.CheckNL();
+            sweep(cfg, T, mix.p_flip, stats);
+            for (long long s = 0; s < swaps; s++){
+                stats.swap_trials++;
+                stats.swap_accepted += TrySwap(cfg, floor(ranf()*N), T, extra.swap_local);
+            }
+            if (extra.volume_every > 0 && (t+1)%extra.volume_every == 0){
+                stats.volume_trials++;
+                stats.volume_accepted += TryVolume(cfg, T, extra.pressure, extra.max_dlnV);
+            }
+        }
+        seconds += std::chrono::duration<double>(clock::now() - start).count();
+
+        cfg.UpdateCM_coord();
+        double fs = obs.Compute(cfg, cfg0)[0];
+        if (fs < threshold){
+            // Interpolating in log time between the two samples around 1/e
+            double weight = (fs_prev - threshold)/(fs_prev - fs);
+            result.tau_sweeps = t_prev > 0 ? exp(log(t_prev) + weight*(log(double(t)) - log(t_prev))) : weight*t;
+            result.tau_seconds = seconds_prev + (seconds - seconds_prev)*(result.tau_sweeps - t_prev)/(t - t_prev);
+            break;
+        }
+        t_prev = t; fs_prev = fs; seconds_prev = seconds;
+        next = std::max(t+1, (long long)ceil(t*ratio));
+        if (next > max_sweeps) next = max_sweeps;
+    }
+    result.disp_acceptance = stats.disp_trials > 0 ? double(stats.disp_accepted)/stats.disp_trials : 0;
+    result.flip_acceptance = stats.flip_trials > 0 ? double(stats.flip_accepted)/stats.flip_trials : 0;
+    result.swap_acceptance = stats.swap_trials > 0 ? double(stats.swap_accepted)/stats.swap_trials : 0;
+    result.sweeps = t; result.seconds = seconds;
+    Size = size;
+    return result;
+}
+
+// Prints results as an aligned table, CSV or JSON, marking the mix with the shortest relaxation in seconds
+void PrintResults(const std::vector<decorrelation_result>& results, std::string format, std::ostream& os){
+    int best = -1;
+    for (size_t k = 0; k < results.size(); k++){
+        if (results[k].tau_seconds >= 0 && (best < 0 || results[k].tau_seconds < results[best].tau_seconds)) best = k;
+    }
+    if (format == "json"){
+        os << "{\"N\": " << N << ", \"best\": " << best << ", \"results\": [";
+        for (size_t k = 0; k < results.size(); k++){
+            const decorrelation_result& r = results[k];
+            os << (k ? ", " : "") << "{\"p_flip\": " << r.p_flip << ", \"step\": " << r.step
+               << ", \"disp_acceptance\": " << r.disp_acceptance << ", \"flip_acceptance\": " << r.flip_acceptance
+               << ", \"swap_acceptance\": " << r.swap_acceptance
+               << ", \"sweeps\": " << r.sweeps << ", \"seconds\": " << r.seconds
+               << ", \"tau_sweeps\": " << r.tau_sweeps << ", \"tau_seconds\": " << r.tau_seconds << "}";
+        }
+        os << "]}" << std::endl;
+    } else if (format == "csv"){
+        os << "p_flip,step,disp_acceptance,flip_acceptance,swap_acceptance,sweeps,seconds,tau_sweeps,tau_seconds" << std::endl;
+        for (const decorrelation_result& r: results){
+            os << r.p_flip << "," << r.step << "," << r.disp_acceptance << "," << r.flip_acceptance << ","
+               << r.swap_acceptance << ","
+               << r.sweeps << "," << r.seconds << "," << r.tau_sweeps << "," << r.tau_seconds << std::endl;
+        }
+    } else {
+        os << std::right << std::setw(8) << "p_flip" << std::setw(8) << "step" << std::setw(10) << "acc_disp"
+           << std::setw(10) << "acc_flip" << std::setw(10) << "acc_swap" << std::setw(14) << "sweeps/s" << std::setw(14) << "tau [sweeps]"
+           << std::setw(12) << "tau [s]" << std::endl;
+        for (size_t k = 0; k < results.size(); k++){
+            const decorrelation_result& r = results[k];
+            os << std::fixed << std::setprecision(3) << std::setw(8) << r.p_flip << std::setw(8) << r.step
+               << std::setw(10) << r.disp_acceptance << std::setw(10) << r.flip_acceptance << std::setw(10) << r.swap_acceptance
+               << std::setprecision(1) << std::setw(14) << (r.seconds > 0 ? r.sweeps/r.seconds : 0);
+            if (r.tau_sweeps < 0){
+                os << std::setw(14) << "> " + std::to_string(r.sweeps) << std::setw(12) << "-";
+            } else {
+                os << std::setw(14) << r.tau_sweeps << std::setprecision(3) << std::setw(12) << r.tau_seconds;
+            }
+            os << ((int)k == best ? "   *" : "") << std::defaultfloat << std::endl;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//  decorrelation.cpp
+int main(int argc, const char * argv[]) {
+    std::string input, format, output, fs_name;
+    std::vector<double> p_flips, steps;
+    double T, q, ratio, pressure, volume_max, swap_fraction;
+    int replicas, warmup, volume_every;
+    bool swap_local, heat_bath;
+    long long max_sweeps;
+    unsigned int seed;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Produce help message")
+        ("init", po::value<std::string>(&input)->default_value(std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz"),
+                 "Configuration at the state point (replicated along each direction)")
+        ("replicas", po::value<int>(&replicas)->default_value(1), "Number of replicas along each direction (N grows as replicas^3)")
+        ("T", po::value<double>(&T)->default_value(2.0), "Temperature")
+        ("p_flip", po::value<std::vector<double>>(&p_flips)->multitoken()->default_value(std::vector<double>{0, 0.2, 0.5}, "0 0.2 0.5"),
+                   "Probabilities of a flip of the measured move mixes")
+        ("step", po::value<std::vector<double>>(&steps)->multitoken()->default_value(std::vector<double>{0.17}, "0.17"),
+                 "Widths of the trial displacements of the measured move mixes")
+        ("heat-bath", po::bool_switch(&heat_bath), "Draw the types of a molecule among all their arrangements in flips")
+        ("swap-fraction", po::value<double>(&swap_fraction)->default_value(0), "Number of inter-molecular swap trials per sweep, in units of N")
+        ("swap-local", po::bool_switch(&swap_local), "Draw the partners of swaps from the neighbours lists")
+        ("volume-every", po::value<int>(&volume_every)->default_value(0), "Number of MC sweeps between two volume moves (0 keeps the volume fixed)")
+        ("pressure", po::value<double>(&pressure)->default_value(0), "Pressure of the volume moves")
+        ("volume-max", po::value<double>(&volume_max)->default_value(0.002), "Largest change of ln V in a volume move")
+        ("q", po::value<double>(&q)->default_value(0), "Wave-vector of Fs (0 for 2*pi/sigmaMax)")
+        ("warmup", po::value<int>(&warmup)->default_value(0), "Untimed sweeps before the reference configuration")
+        ("max-sweeps", po::value<long long>(&max_sweeps)->default_value(100000), "Largest number of sweeps of each mix")
+        ("ratio", po::value<double>(&ratio)->default_value(1.1), "Ratio between two consecutive samples of Fs")
+        ("seed", po::value<unsigned int>(&seed)->default_value(12345), "Seed of the random number generator (reset for each mix)")
+        ("format", po::value<std::string>(&format)->default_value("table"), "Output format (table, csv or json)")
+        ("output", po::value<std::string>(&output)->default_value(""), "Output file (standard output if empty)");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const po::error& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    if (format != "table" && format != "csv" && format != "json"){
+        std::cerr << "Error: Unknown format " << format << std::endl;
+        return 1;
+    }
+    if (ratio <= 1 || max_sweeps < 1 || swap_fraction < 0 || (volume_every > 0 && volume_max <= 0)){
+        std::cerr << "Error: ratio must be above 1, and max-sweeps, swap-fraction and volume-max positive" << std::endl;
+        return 1;
+    }
+    for (double p_flip: p_flips){
+        if (p_flip < 0 || p_flip > 1){
+            std::cerr << "Error: Probabilities of a flip must lie between 0 and 1" << std::endl;
+            return 1;
+        }
+    }
+    for (double step: steps){
+        if (step <= 0){
+            std::cerr << "Error: Widths of the trial displacements must be positive" << std::endl;
+            return 1;
+        }
+    }
+    if (q > 0){
+        std::ostringstream name; name << "Fs:" << q;
+        fs_name = name.str();
+    } else {
+        fs_name = "Fs";
+    }
+
+    generator.Seed(seed);
+    configuration cfg = MakeReplica(input, replicas);
+    extra_moves extra = {swap_fraction, swap_local, volume_every, pressure, volume_max, heat_bath};
+    std::vector<decorrelation_result> results;
+    for (double p_flip: p_flips){
+        for (double step: steps){
+            std::cerr << "Measuring p_flip = " << p_flip << ", step = " << step << " (N = " << N << ")" << std::endl;
+            // Same random sequence for every mix
+            generator.Seed(seed);
+            move_mix mix = {p_flip, step};
+            results.push_back(MeasureDecorrelation(cfg, T, mix, extra, fs_name, warmup, max_sweeps, ratio));
+        }
+    }
+
+    if (output.empty()){
+        PrintResults(results, format, std::cout);
+    } else {
+        std::ofstream out(output);
+        PrintResults(results, format, out);
+    }
+    return 0;
+}
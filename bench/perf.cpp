@@ -0,0 +1,190 @@
+#include <cmath>
+#include <map>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+#include "globals.hpp"
+#include "particles.hpp"
+#include "simulation.hpp"
+#include "utils.hpp"
+#include "bench_utils.hpp"
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+// Globals that are normally defined in the main file (set by MakeReplica)
+__thread int N = 3000;
+__thread double Size = 0;
+
+// Baseline entries keyed by "case metric"
+typedef std::map<std::string, double> baseline_map;
+
+// Reads a baseline file (missing files hold no entries)
+baseline_map ReadBaseline(std::string input){
+    baseline_map baseline;
+    std::ifstream input_file(input);
+    std::string line;
+    while (std::getline(input_file, line)){
+        if (line.empty() || line[0] == '#') continue;
+        std::stringstream ss(line);
+        std::string name, metric; double value;
+        if (ss >> name >> metric >> value) baseline[name + " " + metric] = value;
+    }
+    return baseline;
+}
+
+// Writes a baseline file
+void WriteBaseline(const baseline_map& baseline, std::string output){
+    std::ofstream output_file(output);
+    output_file << "# TFMC performance baseline (case metric value), only meaningful on the machine which recorded it" << std::endl;
+    output_file << std::setprecision(8);
+    for (const std::pair<const std::string, double>& entry: baseline){
+        output_file << entry.first << " " << entry.second << std::endl;
+    }
+}
+
+// Outcome of the comparison of a measurement with the baseline
+enum metric_check {metric_ok, metric_regression, metric_missing};
+
+// Exit code of a case without baseline, reported as skipped by ctest (SKIP_RETURN_CODE)
+const int skip_code = 77;
+
+// Compares a measurement to its baseline, higher being better if `higher` is true
+metric_check CheckMetric(const baseline_map& baseline, std::string key, double value, bool higher, double tolerance){
+    baseline_map::const_iterator it = baseline.find(key);
+    std::cout << std::left << std::setw(48) << key << std::right << std::setw(16) << value;
+    if (it == baseline.end()){
+        std::cout << "   (no baseline, record it with --update)" << std::endl;
+        return metric_missing;
+    }
+    double ratio = value/it->second;
+    bool ok = higher ? ratio >= 1 - tolerance : ratio <= 1 + tolerance;
+    std::cout << std::setw(16) << it->second << std::fixed << std::setprecision(3) << std::setw(10) << ratio
+              << (ok ? "   ok" : "   REGRESSION") << std::defaultfloat << std::setprecision(6) << std::endl;
+    return ok ? metric_ok : metric_regression;
+}
+
+// Writes the trajectory replayed by the replay mode in a child process, so that its memory is not
+// counted in the peak resident memory of the replay
+bool RecordTrajectory(configuration& cfg, double T, int sweeps, double p_flip, std::vector<std::string>& observables,
+                      std::string& out, int n_log, const run_options& opts){
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0){
+        int code = 0;
+        try {
+            MonteCarloRun(cfg, T, sweeps, 1, 1, p_flip, observables, out, n_log, 1, false, opts);
+        } catch (const std::exception& ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            code = 1;
+        }
+        std::cout.flush();
+        _exit(code);
+    }
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//-----------------------------------------------------------------------------
+//  perf.cpp
+int main(int argc, const char * argv[]) {
+    std::string input, mode, baseline_path;
+    int replicas, threads, sweeps;
+    double tolerance;
+    bool update;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Produce help message")
+        ("mode", po::value<std::string>(&mode)->default_value("run"),
+                 "Benchmarked phase: run (MonteCarloRun) or replay (observables-only ComputeObservables)")
+        ("init", po::value<std::string>(&input)->default_value(std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz"),
+                 "Configuration replicated to build the benchmarked system")
+        ("replicas", po::value<int>(&replicas)->default_value(1), "Number of replicas along each direction (N grows as replicas^3)")
+        ("threads", po::value<int>(&threads)->default_value(1), "Number of threads of the replay")
+        ("sweeps", po::value<int>(&sweeps)->default_value(100), "Number of MC sweeps")
+        ("baseline", po::value<std::string>(&baseline_path)->default_value(""), "Baseline file to compare with")
+        ("tolerance", po::value<double>(&tolerance)->default_value(0.15), "Relative slowdown (or memory growth) tolerated")
+        ("update", po::bool_switch(&update), "Record the measurements into the baseline instead of comparing");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const po::error& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    if (mode != "run" && mode != "replay"){
+        std::cerr << "Error: Unknown mode " << mode << std::endl;
+        return 1;
+    }
+
+    // Fixed seed and fixed run parameters, so that every measurement does the same work
+    generator.Seed(12345);
+    configuration cfg = MakeReplica(input, replicas);
+    std::string out = (fs::temp_directory_path() / fs::unique_path("tfmc-perf-%%%%%%")).string() + "/";
+    fs::create_directories(out + "configs/");
+    std::vector<std::string> observables = {"U", "MSD", "Fs"};
+    run_options opts;
+    opts.stats_every = 0;
+    double T = 2.0, p_flip = 0.2;
+    int n_log = 50;
+
+    typedef std::chrono::steady_clock clock;
+    std::string name, metric;
+    double throughput;
+    if (mode == "run"){
+        name = "MonteCarloRun_N" + std::to_string(N); metric = "sweeps_per_s";
+        clock::time_point start = clock::now();
+        MonteCarloRun(cfg, T, sweeps, 1, 1, p_flip, observables, out, n_log, 1, false, opts);
+        throughput = sweeps/std::chrono::duration<double>(clock::now() - start).count();
+    } else {
+        name = "ComputeObservables_N" + std::to_string(N) + "_T" + std::to_string(threads); metric = "snapshots_per_s";
+        if (!RecordTrajectory(cfg, T, sweeps, p_flip, observables, out, n_log, opts)){
+            std::cerr << "Error: Could not record the replayed trajectory" << std::endl;
+            fs::remove_all(out);
+            return 1;
+        }
+        opts.threads = threads;
+        int snapshots = GetLogspacedSnapshots(1, sweeps, 1, n_log).size();
+        clock::time_point start = clock::now();
+        ComputeObservables(T, sweeps, 1, 1, observables, out, n_log, false, opts);
+        throughput = snapshots/std::chrono::duration<double>(clock::now() - start).count();
+    }
+    fs::remove_all(out);
+    double rss = PeakRSS();
+
+    // Comparing with (or recording) the baseline
+    baseline_map baseline = baseline_path.empty() ? baseline_map() : ReadBaseline(baseline_path);
+    if (update){
+        if (baseline_path.empty()){
+            std::cerr << "Error: --update requires --baseline" << std::endl;
+            return 1;
+        }
+        baseline[name + " " + metric] = throughput;
+        baseline[name + " peak_rss_bytes"] = rss;
+        WriteBaseline(baseline, baseline_path);
+        std::cout << "Recorded " << name << ": " << throughput << " " << metric << ", "
+                  << rss << " peak_rss_bytes" << std::endl;
+        return 0;
+    }
+    std::cout << std::left << std::setw(48) << "case metric" << std::right << std::setw(16) << "measured"
+              << std::setw(16) << "baseline" << std::setw(10) << "ratio" << std::endl;
+    metric_check checks[2] = {CheckMetric(baseline, name + " " + metric, throughput, true, tolerance),
+                               CheckMetric(baseline, name + " peak_rss_bytes", rss, false, tolerance)};
+    if (checks[0] == metric_regression || checks[1] == metric_regression) return 1;
+    return (checks[0] == metric_missing || checks[1] == metric_missing) ? skip_code : 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file checkpoint.hpp
+ * @brief Binary checkpoints of Monte Carlo runs.
+ *
+ * This module writes and reads the complete state of a Monte Carlo run (current configuration,
+ * cycle references, counters, random number generator and size of the observables file) so that
+ * a run killed at any time can be resumed bit-exactly from its last checkpoint.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include "particles.hpp"
+#include "simulation.hpp"
+
+/**
+ * @brief Writes a trivially copyable value to a binary stream.
+ *
+ * @param os Output stream.
+ * @param value Value to write.
+ */
+template <typename T>
+void WriteBinary(std::ostream& os, const T& value){
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * @brief Writes a vector of trivially copyable values (size first) to a binary stream.
+ *
+ * @param os Output stream.
+ * @param values Values to write.
+ */
+template <typename T>
+void WriteBinary(std::ostream& os, const std::vector<T>& values){
+    long long size = values.size();
+    WriteBinary(os, size);
+    if (size > 0) os.write(reinterpret_cast<const char*>(values.data()), size*sizeof(T));
+}
+
+/**
+ * @brief Reads a trivially copyable value from a binary stream.
+ *
+ * @param is Input stream.
+ * @param value Value to read.
+ */
+template <typename T>
+void ReadBinary(std::istream& is, T& value){
+    is.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if (!is) throw std::runtime_error("Truncated checkpoint");
+}
+
+/**
+ * @brief Reads a vector of trivially copyable values written by WriteBinary.
+ *
+ * @param is Input stream.
+ * @param values Values to read.
+ */
+template <typename T>
+void ReadBinary(std::istream& is, std::vector<T>& values){
+    long long size;
+    ReadBinary(is, size);
+    values.resize(size);
+    if (size > 0) is.read(reinterpret_cast<char*>(values.data()), size*sizeof(T));
+    if (!is) throw std::runtime_error("Truncated checkpoint");
+}
+
+/**
+ * @brief Writes the state of a run to a checkpoint file.
+ *
+ * The file is first written next to its destination and then renamed, so that a job killed
+ * while checkpointing never leaves a corrupted checkpoint behind.
+ *
+ * @param cfg Current configuration.
+ * @param state Current run state.
+ * @param output Path to the checkpoint file.
+ */
+void WriteCheckpoint(const configuration& cfg, const run_state& state, std::string output);
+
+/**
+ * @brief Reads the state of a run from a checkpoint file.
+ *
+ * The random number generator is restored as well.
+ *
+ * @param cfg Configuration to restore.
+ * @param state Run state to restore.
+ * @param input Path to the checkpoint file.
+ */
+void ReadCheckpoint(configuration& cfg, run_state& state, std::string input);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,94 @@
+/**
+ * @file correlator.hpp
+ * @brief Multiple-tau correlator of single-particle dynamics.
+ *
+ * This module computes the mean square displacement and the self-intermediate scattering
+ * function at all lags between one sweep and the length of a cycle, averaged over every time
+ * origin, with a memory growing only logarithmically with the longest lag.
+ */
+
+#ifndef CORRELATOR_H
+#define CORRELATOR_H
+
+#include <vector>
+#include <string>
+#include "particles.hpp"
+
+/**
+ * @brief Multiple-tau (hierarchically decimated) correlator of particles' positions.
+ *
+ * Center of mass corrected positions are pushed every `every` sweeps into level 0, which keeps
+ * the last `p` of them. Every `m` pushes, the latest position of a level is also pushed into the
+ * next level, whose lags are thus `m` times longer. Level l correlates the lags j*m^l*every with
+ * p/m <= j < p (1 <= j < p for level 0), so that lags up to `max_lag` only require
+ * O(log(max_lag)) stored blocks.
+ *
+ * Higher levels are decimated rather than block-averaged: the MSD and Fs are not linear in the
+ * positions, and correlating time-averaged positions would bias the MSD low and Fs high by terms
+ * of order block/lag, with a kink at each level boundary. Decimation keeps every correlated pair
+ * exact, at the price of fewer time origins at long lags.
+ *
+ * The self-intermediate scattering function is averaged over wave-vectors along the x, y and z
+ * axes (written as `Fs_axes`), unlike the `Fs` observable which averages over 360 directions of
+ * the XY plane, too costly at every lag.
+ */
+struct multi_tau_correlator {
+    int p;                      ///< Number of blocks stored at each level
+    int m;                      ///< Averaging factor between two levels
+    int every;                  ///< Number of MC sweeps between two pushes
+    int max_lag;                ///< Longest lag to correlate (in MC sweeps)
+    double q;                   ///< Wave-vector of the self-intermediate scattering function
+    int levels;                 ///< Number of levels
+    std::vector<double> blocks; ///< Stored positions (levels x p x 3N, X then Y then Z)
+    std::vector<int> head;      ///< Index of the newest block of each level
+    std::vector<int> filled;    ///< Number of valid blocks of each level
+    std::vector<int> pushed;    ///< Number of positions pushed into each level since the last push into the next one
+    std::vector<double> msd;    ///< Summed mean square displacements (levels x p)
+    std::vector<double> fs;     ///< Summed self-intermediate scattering functions along the axes (levels x p)
+    std::vector<long long> samples; ///< Number of time origins of each lag (levels x p)
+
+    /**
+     * @brief Constructor of a disabled correlator.
+     */
+    multi_tau_correlator() : p(0), m(0), every(0), max_lag(0), q(0), levels(0) {}
+
+    /**
+     * @brief Constructor allocating the levels needed to reach `max_lag`.
+     *
+     * @param p Number of blocks stored at each level (multiple of m).
+     * @param m Decimation factor between two levels.
+     * @param every Number of MC sweeps between two pushes.
+     * @param max_lag Longest lag to correlate (in MC sweeps).
+     * @param q Wave-vector of the self-intermediate scattering function (0 for 2*pi/sigmaMax).
+     * @throws std::invalid_argument if p is not a multiple of m.
+     */
+    multi_tau_correlator(int p, int m, int every, int max_lag, double q);
+
+    /**
+     * @brief Method to push the current positions.
+     *
+     * The center of mass of the configuration must be up to date.
+     *
+     * @param cfg Current configuration.
+     * @param order Original index of each particle of the configuration (identity if empty).
+     */
+    void Push(const configuration& cfg, const std::vector<int>& order = std::vector<int>());
+
+    /**
+     * @brief Method to write the correlation functions.
+     *
+     * @param output Path to the output file (columns `lag MSD Fs_axes samples`).
+     */
+    void Write(std::string output) const;
+
+private:
+    /**
+     * @brief Method to push positions into one level and correlate them with the stored ones.
+     *
+     * @param level Level to push into.
+     * @param positions Positions to push (X then Y then Z).
+     */
+    void PushLevel(int level, const double* positions);
+};
+
+#endif // CORRELATOR_H
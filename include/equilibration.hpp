@@ -0,0 +1,102 @@
+/**
+ * @file equilibration.hpp
+ * @brief Automatic detection of equilibration.
+ *
+ * This module monitors the potential energy and the self-intermediate scattering function of a
+ * run, measures the structural relaxation time and the autocorrelation time of the energy on
+ * the fly, and decides when the energy has been stationary for enough relaxation times, so that
+ * the number of equilibration sweeps adapts to each state point.
+ */
+
+#ifndef EQUILIBRATION_H
+#define EQUILIBRATION_H
+
+#include <vector>
+#include <string>
+#include "particles.hpp"
+
+/**
+ * @brief Online monitor of equilibration.
+ *
+ * Every `every` sweeps, the energy per particle and the self-intermediate scattering function
+ * Fs with respect to a reference configuration are sampled. Each time Fs falls below
+ * `threshold`, one relaxation has passed and the current configuration becomes the new reference.
+ * Once `relaxations` relaxations have passed, the energy over the last `relaxations` relaxation
+ * times is checked for stationarity: the means of its two halves must agree within two standard
+ * errors, which are corrected by the integrated autocorrelation time of the energy. The window
+ * must also span `relaxations` autocorrelation times of the energy.
+ */
+struct equilibration_monitor {
+    int every;                     ///< Number of MC sweeps between two samples
+    int relaxations;               ///< Number of relaxation times required with a stationary energy
+    double threshold;              ///< Value of Fs defining one relaxation
+    double q;                      ///< Wave-vector of Fs
+    int t;                         ///< Next equilibration sweep to perform
+    bool done;                     ///< True once the equilibration phase is over
+    bool equilibrated;             ///< True if the stationarity criterion was met
+    std::vector<double> reference; ///< Center of mass corrected positions at the last relaxation (X then Y then Z, original order)
+    std::vector<int> times;        ///< Sweeps of the samples
+    std::vector<double> energies;  ///< Potential energy per particle of the samples
+    std::vector<double> fs;        ///< Fs with respect to the reference of the samples
+    std::vector<int> crossings;    ///< Sweeps at which a relaxation started
+    double tau_alpha;              ///< Mean sweeps between two relaxations over the last window
+    double tau_energy;             ///< Integrated autocorrelation time of the energy over the last window (in sweeps)
+
+    /**
+     * @brief Constructor of a disabled monitor.
+     */
+    equilibration_monitor()
+        : every(0), relaxations(0), threshold(0), q(0), t(0), done(true), equilibrated(false),
+          tau_alpha(0), tau_energy(0) {}
+
+    /**
+     * @brief Constructor of a monitor starting at sweep 0.
+     *
+     * @param every Number of MC sweeps between two samples.
+     * @param relaxations Number of relaxation times required with a stationary energy.
+     * @param threshold Value of Fs defining one relaxation (between 0 and 1).
+     * @throws std::invalid_argument if a parameter is out of range.
+     */
+    equilibration_monitor(int every, int relaxations, double threshold);
+
+    /**
+     * @brief Method to sample the current configuration.
+     *
+     * The center of mass and the neighbours lists of the configuration must be up to date.
+     *
+     * @param cfg Current configuration.
+     * @param sweep Number of equilibration sweeps already performed.
+     * @param order Original index of each particle of the configuration (identity if empty).
+     * @return True if the configuration is equilibrated.
+     */
+    bool Sample(const configuration& cfg, int sweep, const std::vector<int>& order = std::vector<int>());
+
+    /**
+     * @brief Method to write the sampled time series.
+     *
+     * @param output Path to the output file (columns `t U Fs`).
+     */
+    void WriteSeries(std::string output) const;
+
+    /**
+     * @brief Method to write the measured relaxation times in JSON format.
+     *
+     * @param output Path to the summary file.
+     */
+    void WriteSummary(std::string output) const;
+};
+
+/**
+ * @brief Estimates the integrated autocorrelation time of a time series.
+ *
+ * The autocorrelation function is summed up to the smallest lag W with W >= 5 tau (Sokal's
+ * automatic windowing), so that tau = 1/2 for uncorrelated samples.
+ *
+ * @param series Time series.
+ * @param begin First sample of the range to analyse.
+ * @param end One past the last sample of the range to analyse.
+ * @return The integrated autocorrelation time, in samples.
+ */
+double IntegratedAutocorrelationTime(const std::vector<double>& series, size_t begin, size_t end);
+
+#endif // EQUILIBRATION_H
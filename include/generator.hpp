@@ -0,0 +1,40 @@
+/**
+ * @file generator.hpp
+ * @brief Generation of initial configurations of trimers.
+ *
+ * This module builds a starting configuration of N/3 trimers at the density of the simulation
+ * without any input file: molecules are placed on a cubic grid with the orientation which keeps
+ * them furthest from the molecules already placed, then residual overlaps are removed by
+ * minimizing a soft repulsive potential. The result has finite WCA and FENE energies,
+ * so the Monte Carlo run can start from it directly.
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "particles.hpp"
+
+/**
+ * @brief Builds a configuration of N/3 trimers filling the box of side `Size`.
+ *
+ * Each molecule holds one particle of each type (in random order) at the corners of an
+ * equilateral triangle of side `bond_length`. Molecules are centered on the sites of a cubic grid
+ * (a random subset of them if N/3 is not a cube), and each molecule tries `orientations` random
+ * orientations, keeping the one with the largest distance to the particles already placed.
+ * Overlaps are then relaxed by minimizing, with the FIRE algorithm, harmonic repulsions between
+ * non-bonded particles closer than their mean diameter plus harmonic bonds, until no non-bonded
+ * pair is closer than `min_ratio` times its mean diameter.
+ * Pairs are found with cell lists, so the cost grows linearly with N.
+ *
+ * @param bond_length Side of the triangle of each trimer.
+ * @param orientations Number of random orientations tried for each molecule.
+ * @param min_ratio Smallest accepted distance between non-bonded particles, relative to their mean diameter.
+ * @param max_iterations Largest number of relaxation steps.
+ * @return Configuration whose molecules are whole in unwrapped positions (neighbours lists not built).
+ * @throws std::invalid_argument if N is not a multiple of 3 or a parameter is out of range.
+ * @throws std::runtime_error if overlaps remain after `max_iterations` steps.
+ */
+configuration GenerateTrimers(double bond_length = 0.95, int orientations = 20, double min_ratio = 0.9,
+                              int max_iterations = 10000);
+
+#endif // GENERATOR_H
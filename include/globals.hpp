@@ -14,19 +14,25 @@
 #define GLOBALS_H
 
 // Libraries
-#include <cstdlib> // For dynamic memory and random numbers
+#include <cstdlib> // For dynamic memory
+#include "rng.hpp" // For random numbers
 
 // Shared variables
 
 /**
  * @brief Number of particles.
+ *
+ * Each thread holds its own value, so that the jobs of a manifest can run concurrently.
+ * Threads working for a job must copy the job's value first. GNU `__thread` storage is used
+ * rather than `thread_local`, whose initialization checks cost a call per access in the hot
+ * loops, so definitions need constant initializers.
  */
-extern int N;
+extern __thread int N;
 
 /**
- * @brief Size of the simulation box.
+ * @brief Size of the simulation box (one value per thread, like N).
  */
-extern double Size;
+extern __thread double Size;
 
 /**
  * @brief Maximum diameter of particles.
@@ -43,10 +49,23 @@ const double diameters[3] = {0.9, 1.0, 1.1};
  */
 const double density = 1.2;
 
+/**
+ * @brief Scalar type of the wrapped positions.
+ *
+ * Mixed precision builds (-DTFMC_PRECISION=mixed) store wrapped positions in single precision,
+ * halving the memory traffic of the energy kernels, while unwrapped positions and energies stay
+ * in double precision.
+ */
+#ifdef TFMC_MIXED_PRECISION
+typedef float real;
+#else
+typedef double real;
+#endif
+
 /**
  * @brief Generates a random number between 0 and 1.
  */
 #define ranf() \
-    ((double)rand()/(1.0+RAND_MAX))
+    ((double)generator.Next()/(1.0+RNG_MAX))
 
 #endif // GLOBALS_H
\ No newline at end of file
@@ -0,0 +1,128 @@
+/**
+ * @file histogram.hpp
+ * @brief Energy histograms accumulated during the simulation and reweighted to other temperatures.
+ *
+ * This module accumulates the histogram of the energy of a run together with the sums of
+ * selected static observables inside each energy bin, which is all the single and multiple
+ * histogram methods (Ferrenberg-Swendsen) need to reweight averages to nearby temperatures.
+ * One run, or a few runs at neighbouring temperatures, thus cover a whole temperature window.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <vector>
+#include <string>
+
+/**
+ * @brief Histogram of the energy per particle and joint sums of observables.
+ *
+ * Bins of width `width` are indexed by floor(e/width), e being the potential energy per particle
+ * (plus P*V/N in isobaric runs, where the enthalpy is the variable conjugate to the temperature).
+ * Only filled bins are stored, so the energy range does not need to be known in advance. Each bin
+ * holds its number of samples, the sums of e, e^2 and of the density, and the sums of the
+ * observables. The kinetic part rho*T of the pressure `P` is not accumulated, so that it can be
+ * added back at the reweighted temperature.
+ */
+struct energy_histogram {
+    double width;                     ///< Width of the bins of the energy per particle (0 if disabled)
+    double T;                         ///< Temperature of the run
+    double pressure;                  ///< Pressure of the P*V term of the energy
+    bool isobaric;                    ///< Whether the energy includes the P*V term
+    int particles;                    ///< Number of particles
+    std::vector<std::string> columns; ///< Names of the observables summed in each bin
+    std::vector<long long> keys;      ///< Index of each filled bin, in increasing order
+    std::vector<double> sums;         ///< Samples, sums of e, e^2, rho and of the observables of each bin
+
+    /**
+     * @brief Constructor of a disabled histogram.
+     */
+    energy_histogram() : width(0), T(0), pressure(0), isobaric(false), particles(0) {}
+
+    /**
+     * @brief Constructor of an empty histogram.
+     *
+     * @param width Width of the energy bins.
+     * @param T Temperature of the run.
+     * @param pressure Pressure of the run.
+     * @param isobaric Whether the volume fluctuates (the P*V term is then added to the energy).
+     * @param columns Names of the observables summed in each bin.
+     * @throws std::invalid_argument if the width or the temperature is not positive.
+     */
+    energy_histogram(double width, double T, double pressure, bool isobaric, const std::vector<std::string>& columns);
+
+    /**
+     * @brief Method to retrieve the number of sums stored per bin.
+     *
+     * @return Number of sums of a bin.
+     */
+    int Stride() const { return 4 + columns.size(); }
+
+    /**
+     * @brief Method to add one sample.
+     *
+     * @param U Potential energy per particle.
+     * @param volume Volume of the box.
+     * @param values Values of the observables, one per column.
+     */
+    void Sample(double U, double volume, const std::vector<double>& values);
+
+    /**
+     * @brief Method to retrieve the number of samples.
+     *
+     * @return Number of samples accumulated.
+     */
+    long long Samples() const;
+
+    /**
+     * @brief Method to write the histogram.
+     *
+     * The file starts with a comment line holding the parameters of the run, followed by the names
+     * of the columns `e e2 rho count obs1 obs2 ...` and by one row per filled bin with the means
+     * of each quantity inside the bin.
+     *
+     * @param output Path to the output file.
+     */
+    void Write(std::string output) const;
+};
+
+/**
+ * @brief Reads a histogram written by energy_histogram::Write.
+ *
+ * @param input Path to the histogram file.
+ * @return Histogram holding the same samples.
+ * @throws std::runtime_error if the file cannot be read or is not a histogram file.
+ */
+energy_histogram ReadHistogram(std::string input);
+
+/**
+ * @brief Averages reweighted to one temperature.
+ */
+struct reweighted_averages {
+    double T;                   ///< Temperature
+    double energy;              ///< Mean energy per particle
+    double heat_capacity;       ///< Heat capacity per particle, N(<e^2>-<e>^2)/T^2
+    double effective_samples;   ///< Effective number of samples (Kish), small when T lies outside the sampled window
+    std::vector<double> values; ///< Means of the observables, one per column
+};
+
+/**
+ * @brief Reweights histograms to other temperatures with the multiple histogram method.
+ *
+ * The density of states is estimated from all histograms by iterating the Ferrenberg-Swendsen
+ * equations for the free energies of the runs (a single histogram only needs one iteration).
+ * Samples are weighted at the mean energy of their bin, which is exact up to the width of the
+ * bins. The kinetic part of the pressure is evaluated at the reweighted temperature.
+ *
+ * @param runs Histograms of the runs (same N, bin width, ensemble and columns).
+ * @param temperatures Temperatures to reweight to.
+ * @param tolerance Largest change of the free energies between the last two iterations.
+ * @param max_iterations Largest number of iterations.
+ * @return Averages at each temperature.
+ * @throws std::invalid_argument if the histograms are empty or cannot be combined.
+ * @throws std::runtime_error if the iterations do not converge.
+ */
+std::vector<reweighted_averages> Reweight(const std::vector<energy_histogram>& runs, const std::vector<double>& temperatures,
+                                          double tolerance = 1e-10, int max_iterations = 100000);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,135 @@
+/**
+ * @file live.hpp
+ * @brief Live export of the state of a run through shared memory.
+ *
+ * This module publishes the latest configuration, energy and runtime statistics of a run into a
+ * POSIX shared memory segment, so that a long run can be monitored locally without waiting for
+ * configuration files and without any filesystem I/O. The segment holds a small ring of frames,
+ * each guarded by a sequence lock: the simulation never waits for readers, and readers retry
+ * the rare frames they caught while being rewritten.
+ */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "particles.hpp"
+#include "stats.hpp"
+
+/**
+ * @brief Fixed-size part of a published frame.
+ *
+ * The structure is trivially copyable so that it can be copied in and out of shared memory.
+ */
+struct live_frame {
+    long long frame;     ///< Number of the frame since the start of the process
+    int t;               ///< MC sweep of the frame (of the equilibration if `equilibrating`)
+    bool equilibrating;  ///< Whether the frame was published during the equilibration
+    double Size;         ///< Size of the box
+    double U;            ///< Potential energy per particle
+    run_stats stats;     ///< Runtime statistics since the start of the run
+};
+
+/**
+ * @brief Name of the shared memory segment of a run.
+ *
+ * The name is derived from the absolute path of the output directory, so that the reader only
+ * needs the `rootdir` of the run and concurrent runs of a manifest do not collide.
+ *
+ * @param rootdir Output directory of the run (relative to the working directory).
+ * @return Name of the segment (starting with a slash).
+ */
+std::string LiveName(const std::string& rootdir);
+
+/**
+ * @brief Writer side of the shared memory segment.
+ *
+ * The segment is created (or replaced) by the constructor and removed by the destructor. Frames
+ * are written into the slot following the last one, so that a reader copying the latest frame
+ * is only disturbed if `slots` frames are published meanwhile.
+ */
+class live_export {
+public:
+    /**
+     * @brief Constructor creating the segment.
+     *
+     * @param name Name of the segment.
+     * @param slots Number of frames of the ring.
+     * @throws std::runtime_error if the segment cannot be created.
+     */
+    live_export(const std::string& name, int slots = 4);
+
+    /**
+     * @brief Destructor unmapping and removing the segment.
+     */
+    ~live_export();
+
+    live_export(const live_export&) = delete;
+    live_export& operator=(const live_export&) = delete;
+
+    /**
+     * @brief Method to publish a frame, without ever waiting for readers.
+     *
+     * @param cfg Current configuration (unwrapped positions are published, like configuration files).
+     * @param frame Fixed-size part of the frame (its number is set by the method).
+     * @param order Original index of each particle (empty if never sorted).
+     */
+    void Publish(const configuration& cfg, live_frame frame, const std::vector<int>& order);
+
+private:
+    std::string name;    ///< Name of the segment
+    char* base;          ///< Mapped segment
+    std::size_t bytes;   ///< Size of the segment
+    long long published; ///< Number of frames published
+};
+
+/**
+ * @brief Reader side of the shared memory segment.
+ */
+class live_reader {
+public:
+    /**
+     * @brief Constructor mapping an existing segment read-only.
+     *
+     * @param name Name of the segment.
+     * @throws std::runtime_error if the segment does not exist or is not a TFMC segment.
+     */
+    live_reader(const std::string& name);
+
+    /**
+     * @brief Destructor unmapping the segment.
+     */
+    ~live_reader();
+
+    live_reader(const live_reader&) = delete;
+    live_reader& operator=(const live_reader&) = delete;
+
+    /**
+     * @brief Method to retrieve the number of particles of the run.
+     *
+     * @return Number of particles.
+     */
+    int Particles() const { return particles; }
+
+    /**
+     * @brief Method to copy the latest frame.
+     *
+     * @param frame Fixed-size part of the frame.
+     * @param S Particles' types, in the original order.
+     * @param X Unwrapped x coordinates, in the original order.
+     * @param Y Unwrapped y coordinates, in the original order.
+     * @param Z Unwrapped z coordinates, in the original order.
+     * @return false if no frame was published yet, or if every attempt raced with the writer.
+     */
+    bool Read(live_frame& frame, std::vector<int>& S, std::vector<double>& X, std::vector<double>& Y,
+              std::vector<double>& Z) const;
+
+private:
+    const char* base;  ///< Mapped segment
+    std::size_t bytes; ///< Size of the segment
+    int particles;     ///< Number of particles
+};
+
+#endif // LIVE_H
@@ -0,0 +1,79 @@
+/**
+ * @file manifest.hpp
+ * @brief Batch execution of many runs in a single process.
+ *
+ * This module reads a manifest listing jobs (a JSON parameters file, an optional initial
+ * configuration and a few per-job settings each) and executes them on a pool of threads, so that
+ * one scheduler allocation can run many state points and short jobs backfill the cores freed by
+ * finished ones. Each job runs on its own thread with its own number of particles, box size and
+ * random number generator, and writes into its own root directory.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <vector>
+#include <string>
+#include "simulation.hpp"
+
+/**
+ * @brief One job of a manifest.
+ */
+struct manifest_job {
+    std::string params;                   ///< Path to the JSON parameters
+    std::string init;                     ///< Path to the initial configuration (observables-only job if empty)
+    std::string rootdir;                  ///< Output directory (the one of the parameters unless overridden)
+    std::vector<std::string> observables; ///< Observables to compute
+    unsigned int seed;                    ///< Seed of the random number generator
+    bool restart;                         ///< Resume the job from its checkpoint
+    bool generate;                        ///< Start from a generated configuration instead of `init`
+};
+
+/**
+ * @brief Reads a manifest.
+ *
+ * The manifest is a JSON object whose `jobs` array holds one object per job with the keys
+ * `params` (required), `init`, `generate`, `rootdir`, `observables`, `seed` and `restart`
+ * (optional). Missing observables, restart and generate flags are taken from the command line,
+ * missing seeds are drawn from the clock (distinct for each job).
+ *
+ * @param manifest_path Path to the manifest.
+ * @param observables Observables of the jobs which do not list theirs.
+ * @param opts Command line settings (restart and generate flags).
+ * @return The jobs, in the order of the manifest.
+ * @throws std::runtime_error if the manifest or a job's parameters cannot be read, if two
+ *         jobs share an output directory, or if a job has both an `init` and `generate`.
+ */
+std::vector<manifest_job> ReadManifest(const std::string& manifest_path,
+                                       const std::vector<std::string>& observables, const run_options& opts);
+
+/**
+ * @brief Runs one job on the calling thread.
+ *
+ * The number of particles, box size and random number generator of the calling thread are set
+ * from the job, as `main` does for a single run.
+ *
+ * @param job Job to run.
+ * @param opts Command line settings, completed by the optional settings of the job's parameters.
+ * @throws std::runtime_error (or any exception of the run) if the job fails.
+ */
+void RunJob(const manifest_job& job, const run_options& opts);
+
+/**
+ * @brief Runs the jobs of a manifest on a pool of threads.
+ *
+ * Jobs are handed out in order to `concurrency` worker threads. A failing job does not stop the
+ * others. The status of every job (`pending`, `running`, `done` or `failed`, with its wall-clock
+ * time and error message) is rewritten to `status_path` in JSON format each time a job starts or
+ * ends. Observables-only jobs replay their snapshots on `opts.threads` threads (1 if 0).
+ *
+ * @param jobs Jobs to run.
+ * @param concurrency Number of jobs running at the same time (0 for all cores).
+ * @param opts Command line settings.
+ * @param status_path Path to the status file.
+ * @return The number of failed jobs.
+ */
+int RunManifest(const std::vector<manifest_job>& jobs, int concurrency, const run_options& opts,
+                const std::string& status_path);
+
+#endif // MANIFEST_H
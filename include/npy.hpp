@@ -0,0 +1,105 @@
+/**
+ * @file npy.hpp
+ * @brief Binary observables file in the NumPy `.npy` format.
+ *
+ * This module writes the rows of the observables file as fixed-size records of a structured
+ * `.npy` array, whose fields are `t`, `cycle` and the columns of the observables. The file is
+ * read without any parsing, and can be memory-mapped, with `numpy.load(path, mmap_mode="r")`,
+ * each column being accessed by its name.
+ */
+
+#ifndef NPY_H
+#define NPY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+/**
+ * @brief Observables file appended to in batches of fixed-size records.
+ *
+ * Records hold `t` and `cycle` as 64-bit integers followed by one 64-bit float per column, in
+ * the byte order of the machine. Rows are buffered and written every `batch` rows or when the
+ * file is flushed; the number of rows stored in the header is rewritten in place at each write,
+ * so the file on disk is always a valid array of the rows written so far.
+ */
+class npy_table {
+public:
+    /**
+     * @brief Constructor of a closed table.
+     */
+    npy_table() : batch(0), rows(0), header_bytes(0), record_bytes(0) {}
+
+    /**
+     * @brief Destructor flushing the buffered rows.
+     */
+    ~npy_table();
+
+    npy_table(const npy_table&) = delete;
+    npy_table& operator=(const npy_table&) = delete;
+
+    /**
+     * @brief Method to create the file, holding no rows.
+     *
+     * @param output Path to the file.
+     * @param columns Names of the observables columns.
+     * @param batch Number of rows buffered between two writes.
+     * @throws std::runtime_error if the file cannot be created.
+     */
+    void Create(std::string output, const std::vector<std::string>& columns, int batch = 1024);
+
+    /**
+     * @brief Method to reopen the file after a restart.
+     *
+     * Rows written after the checkpoint are discarded since they will be computed again.
+     *
+     * @param output Path to the file.
+     * @param columns Names of the observables columns (must match the file).
+     * @param offset Size of the file at checkpoint time.
+     * @param batch Number of rows buffered between two writes.
+     * @throws std::runtime_error if the file does not hold these columns or is shorter than `offset`.
+     */
+    void Reopen(std::string output, const std::vector<std::string>& columns, std::streamoff offset, int batch = 1024);
+
+    /**
+     * @brief Method to append one row.
+     *
+     * @param t Current timestep.
+     * @param cycle Current cycle.
+     * @param values Values of the observables columns.
+     */
+    void Write(int t, int cycle, const std::vector<double>& values);
+
+    /**
+     * @brief Method to write the buffered rows and update the header.
+     *
+     * @return Size of the file.
+     */
+    std::streamoff Flush();
+
+    /**
+     * @brief Method to flush and close the file.
+     */
+    void Close();
+
+private:
+    std::fstream file;                ///< Open file
+    std::vector<std::string> columns; ///< Names of the observables columns
+    std::vector<char> buffer;         ///< Rows not written yet
+    int batch;                        ///< Number of rows buffered between two writes
+    long long rows;                   ///< Number of rows written to the file
+    std::size_t header_bytes;         ///< Size of the header
+    std::size_t record_bytes;         ///< Size of one row
+
+    /**
+     * @brief Method to build the header for the current number of rows.
+     *
+     * The number of rows is padded to a fixed width, so that the size of the header does not
+     * depend on it.
+     *
+     * @return Header, padded to a multiple of 64 bytes.
+     */
+    std::string Header() const;
+};
+
+#endif // NPY_H
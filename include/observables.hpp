@@ -11,11 +11,17 @@
 #ifndef OBS_H
 #define OBS_H
 
+#include <map>
+#include <vector>
+#include <string>
 #include "particles.hpp"
 
 /**
  * @brief Calculates the pairwise WCA potential between two particles.
  * 
+ * Distances are computed with the precision of the coordinates, the potential in double.
+ *
+ * @tparam Real Scalar type of the coordinates (float or double).
  * @param x1 X coordinate of the first particle.
  * @param y1 Y coordinate of the first particle.
  * @param z1 Z coordinate of the first particle.
@@ -26,11 +32,15 @@
  * @param s2 Diameter of the second particle.
  * @return The WCA potential between the two particles.
  */
-double WCAPair(double x1, double y1, double z1, double s1, double x2, double y2, double z2, double s2);
+template <typename Real>
+double WCAPair(Real x1, Real y1, Real z1, double s1, Real x2, Real y2, Real z2, double s2);
 
 /**
  * @brief Calculates the pairwise FENE potential between two particles.
  * 
+ * Distances are computed with the precision of the coordinates, the potential in double.
+ *
+ * @tparam Real Scalar type of the coordinates (float or double).
  * @param x1 X coordinate of the first particle.
  * @param y1 Y coordinate of the first particle.
  * @param z1 Z coordinate of the first particle.
@@ -41,7 +51,8 @@ double WCAPair(double x1, double y1, double z1, double s1, double x2, double y2,
  * @param s2 Diameter of the second particle.
  * @return The FENE potential between the two particles.
  */
-double FENEPair(double x1, double y1, double z1, double s1, double x2, double y2, double z2, double s2);
+template <typename Real>
+double FENEPair(Real x1, Real y1, Real z1, double s1, Real x2, Real y2, Real z2, double s2);
 
 /**
  * @brief Calculates the potential associated with a particle.
@@ -50,7 +61,25 @@ double FENEPair(double x1, double y1, double z1, double s1, double x2, double y2
  * @param j Index of the particle.
  * @return The potential associated with the particle.
  */
-double V(const configuration& cfg, int j);
+template <typename Real>
+double V(const basic_configuration<Real>& cfg, int j);
+
+/**
+ * @brief Calculates the potential of a particle before and after a trial displacement.
+ *
+ * Both potentials are summed in the same order as V, in a single pass over the neighbours, so
+ * each neighbour is loaded once.
+ *
+ * @param cfg Current configuration.
+ * @param j Index of the particle.
+ * @param x X coordinate of the trial position.
+ * @param y Y coordinate of the trial position.
+ * @param z Z coordinate of the trial position.
+ * @param V_old Potential of the particle at its current position.
+ * @param V_new Potential of the particle at the trial position.
+ */
+template <typename Real>
+void VDisp(const basic_configuration<Real>& cfg, int j, Real x, Real y, Real z, double& V_old, double& V_new);
 
 /**
  * @brief Calculates the total system energy.
@@ -58,7 +87,39 @@ double V(const configuration& cfg, int j);
  * @param cfg Current configuration.
  * @return The total system energy.
  */
-double VTotal(const configuration& cfg);
+template <typename Real>
+double VTotal(const basic_configuration<Real>& cfg);
+
+/**
+ * @brief Calculates the potential of a particle with other molecules for each of the three diameters.
+ *
+ * Each neighbour of another molecule is loaded and its distance computed once, the three WCA
+ * terms being evaluated from the same distance, so that the energies of every arrangement of the
+ * types of a molecule cost a single pass over the neighbours lists of its particles.
+ *
+ * @param cfg Current configuration.
+ * @param j Index of the particle.
+ * @param U Potentials of the particle with diameters 1, 2 and 3 (bonds and particles of its own molecule excluded).
+ */
+template <typename Real>
+void VTypes(const basic_configuration<Real>& cfg, int j, double U[3]);
+
+/**
+ * @brief Calculates the total energy and virial, and the energy of the uniformly scaled configuration.
+ *
+ * Every pair of the neighbours lists and every bond is visited once, and its distance r gives
+ * both its contributions at r and at `scale`*r, so that the energy change of a volume move and
+ * the virial pressure cost a single pass. The neighbours lists must hold every pair closer than
+ * the cutoff in the scaled configuration.
+ *
+ * @param cfg Current configuration.
+ * @param scale Factor applied to all distances for the scaled energy (1 for none).
+ * @param U Total potential energy.
+ * @param U_scaled Total potential energy of the scaled configuration (infinite if a bond would break).
+ * @param W Virial, sum of r.F over all interacting pairs.
+ */
+template <typename Real>
+void VTotalScaled(const basic_configuration<Real>& cfg, double scale, double& U, double& U_scaled, double& W);
 
 /**
  * @brief Calculates the average mean square displacement.
@@ -78,4 +139,161 @@ double MSD(const configuration& cfg, const configuration& cfg0);
  */
 double FS(const configuration& cfg, const configuration& cfg0);
 
+/**
+ * @brief Calculates the overlap function.
+ * 
+ * @param cfg Current configuration.
+ * @param cfg0 Initial configuration.
+ * @param a Cutoff distance.
+ * @return The overlap function.
+ */
+double Overlap(const configuration& cfg, const configuration& cfg0, double a);
+
+/**
+ * @brief Moments of the overlap function accumulated over cycles at each time lag.
+ *
+ * The four-point susceptibility is the variance of the overlap over cycles, 
+ * chi4 = N(<Q^2> - <Q>^2).
+ */
+struct overlap_moments {
+    std::map<int, double> sumQ;  ///< Sum of the overlaps for each lag
+    std::map<int, double> sumQ2; ///< Sum of the squared overlaps for each lag
+    std::map<int, int> samples;  ///< Number of cycles for each lag
+
+    /**
+     * @brief Method to add the overlap of one cycle.
+     *
+     * @param lag Number of MC sweeps since the beginning of the cycle.
+     * @param Q Overlap of the cycle.
+     * @return The four-point susceptibility over the cycles accumulated so far.
+     */
+    double Add(int lag, double Q);
+};
+
+/**
+ * @brief Mean, variance and standard error of the observables over cycles at each time lag.
+ *
+ * Values are accumulated with Welford's streaming algorithm, so that runs with many cycles can
+ * be averaged without keeping (or writing) one row per cycle.
+ */
+struct cycle_averages {
+    std::map<int, long long> samples;          ///< Number of cycles for each lag
+    std::map<int, std::vector<double>> mean;   ///< Mean of each observable for each lag
+    std::map<int, std::vector<double>> m2;     ///< Sum of squared deviations from the mean for each lag
+
+    /**
+     * @brief Method to add the observables of one cycle.
+     *
+     * @param lag Number of MC sweeps since the beginning of the cycle.
+     * @param values Values of the observables (without susceptibilities).
+     */
+    void Add(int lag, const std::vector<double>& values);
+
+    /**
+     * @brief Method to write the averaged table.
+     *
+     * Each row holds `lag samples` followed, for each observable X, by `X X_var X_err` (mean,
+     * unbiased variance over cycles and standard error of the mean). `Q` is also followed by
+     * `chi4`, the susceptibility N(<Q^2> - <Q>^2) over all the cycles.
+     *
+     * @param output Path to the table, replaced atomically.
+     * @param names Names of the observables, in the order of the values.
+     */
+    void Write(std::string output, const std::vector<std::string>& names) const;
+};
+
+/**
+ * @brief Set of observables requested for a run, validated and evaluated together.
+ *
+ * Names are looked up at construction in the registry of known observables:
+ * - `U`: potential energy per particle (requires the neighbours lists),
+ * - `MSD`: mean square displacement,
+ * - `MSD_A`, `MSD_B`, `MSD_C`: mean square displacement of the particles of a given type 
+ *   (type at the beginning of the cycle),
+ * - `MSD_CM`: mean square displacement of the molecules' centers of mass,
+ * - `alpha2`: non-Gaussian parameter 3<dr^4>/(5<dr^2>^2) - 1,
+ * - `Fs`: self-intermediate scattering function at q = 2*pi/sigmaMax, or `Fs:q` at any q,
+ * - `Q`: overlap function, followed by the four-point susceptibility column `chi4`,
+ * - `P`: virial pressure (N T + W/3)/V (requires the neighbours lists),
+ * - `rho`: number density N/V.
+ *
+ * All displacement-based observables are evaluated in one fused sweep over the particles,
+ * so that adding observables does not add passes over the configurations.
+ */
+class observables_set {
+public:
+    /**
+     * @brief Constructor validating the requested observables.
+     *
+     * @param names Names of the observables, in the order of the output columns.
+     * @param a Cutoff distance of the overlap function.
+     * @param T Temperature (kinetic part of the pressure).
+     * @throws std::invalid_argument if a name is unknown.
+     */
+    observables_set(const std::vector<std::string>& names, double a = 0.3, double T = 0);
+
+    /**
+     * @brief Method to retrieve the names of the output columns.
+     *
+     * @return Names of the columns (`Q` is followed by `chi4`).
+     */
+    std::vector<std::string> Columns() const;
+
+    /**
+     * @brief Method to check whether some observables require the neighbours lists.
+     *
+     * @return true if an energy-type observable (U or P) is requested.
+     */
+    bool RequiresNeighbours() const { return energy; }
+
+    /**
+     * @brief Method to check whether some observables depend on the reference configuration.
+     *
+     * @return true if a displacement-based observable is requested.
+     */
+    bool RequiresReference() const { return displacements; }
+
+    /**
+     * @brief Method to compute all observables.
+     *
+     * @param cfg Current configuration.
+     * @param cfg0 Configuration at the beginning of the cycle.
+     * @return Values of the observables, one per name (without susceptibilities).
+     */
+    std::vector<double> Compute(const configuration& cfg, const configuration& cfg0) const;
+
+    /**
+     * @brief Method to insert the four-point susceptibility after each overlap value.
+     *
+     * Must be called once per cycle and lag, in order, since the overlap moments are accumulated.
+     *
+     * @param lag Number of MC sweeps since the beginning of the cycle.
+     * @param values Values returned by Compute, completed in place.
+     * @param moments Overlap moments accumulated over cycles.
+     */
+    void AddSusceptibilities(int lag, std::vector<double>& values, overlap_moments& moments) const;
+
+private:
+    /**
+     * @brief Kinds of registered observables.
+     */
+    enum kind { ENERGY, MSD_ALL, MSD_TYPE, MSD_MOLECULE, ALPHA2, SELF_SCATTERING, OVERLAP, PRESSURE, DENSITY };
+
+    /**
+     * @brief Requested observable.
+     */
+    struct entry {
+        std::string name; ///< Name of the observable
+        kind type;        ///< Kind of the observable
+        double param;     ///< Wave-vector of Fs or particle type of MSD_X
+    };
+
+    std::vector<entry> entries; ///< Requested observables
+    std::vector<double> qs;     ///< Distinct wave-vectors of the requested Fs
+    double a;                   ///< Cutoff distance of the overlap function
+    double T;                   ///< Temperature
+    bool energy;                ///< Whether the energy is requested
+    bool displacements;         ///< Whether displacement-based observables are requested
+};
+
 #endif // OBS_H
\ No newline at end of file
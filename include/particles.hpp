@@ -14,33 +14,72 @@
 #include <vector>
 #include "globals.hpp"
 
+/**
+ * @brief Default margin added to the cutoff radius of the neighbours lists.
+ */
+const double default_skin = 0.7;
+
+/**
+ * @brief Molecule of each particle when particles are grouped into trimers of consecutive particles.
+ *
+ * @return Molecule index of each of the N particles.
+ */
+std::vector<int> TrimerMolecules();
+
 /**
  * @brief Structure to keep track of the evolution of configurations.
+ *
+ * Wrapped positions, which are all the energy kernels read, are stored with the scalar type
+ * `Real`. Unwrapped positions, used for dynamical observables, are always stored in double.
+ *
+ * @tparam Real Scalar type of the wrapped positions (float or double).
  */
-struct configuration {
-    std::vector<double> X;      ///< Particles' X coordinates inside main box
-    std::vector<double> Y;      ///< Particles' Y coordinates inside main box
-    std::vector<double> Z;      ///< Particles' Z coordinates inside main box
+template <typename Real>
+struct basic_configuration {
+    std::vector<Real> X;        ///< Particles' X coordinates inside main box
+    std::vector<Real> Y;        ///< Particles' Y coordinates inside main box
+    std::vector<Real> Z;        ///< Particles' Z coordinates inside main box
     std::vector<double> Xfull;  ///< Particles' real X coordinates (for dynamical purposes)
     std::vector<double> Yfull;  ///< Particles' real Y coordinates (for dynamical purposes)
     std::vector<double> Zfull;  ///< Particles' real Z coordinates (for dynamical purposes)
-    std::vector<double> X0;     ///< Particles' X coordinates at last neighbors update
-    std::vector<double> Y0;     ///< Particles' Y coordinates at last neighbors update
-    std::vector<double> Z0;     ///< Particles' Z coordinates at last neighbors update
+    std::vector<Real> X0;       ///< Particles' X coordinates at last neighbors update
+    std::vector<Real> Y0;       ///< Particles' Y coordinates at last neighbors update
+    std::vector<Real> Z0;       ///< Particles' Z coordinates at last neighbors update
     std::vector<int> S;         ///< Particles' types (NOT DIAMETERS)
     std::vector<std::vector<int>> neighbours_list; ///< Verlet lists for each particle
-    std::vector<std::vector<int>> bonded_neighbours; ///< Bonded particles for each particle
+    std::vector<int> molecule;     ///< Molecule of each particle (molecules are contiguous)
+    std::vector<int> mol_start;    ///< First particle of each molecule, followed by N
+    std::vector<int> bond_start;   ///< First entry of each particle in `bond_partner`, followed by its size
+    std::vector<int> bond_partner; ///< Bonded particles of each particle, sorted, contiguous per particle
     double XCM; ///< Center of mass X coordinate
     double YCM; ///< Center of mass Y coordinate
     double ZCM; ///< Center of mass Z coordinate
+    double skin; ///< Margin added to the cutoff radius of the neighbours lists
+    double nl_size; ///< Size of the box at the last neighbours update
     
     /**
      * @brief Constructor to initialize vectors.
+     *
+     * Particles are grouped into trimers of consecutive particles.
      */
-    configuration() 
+    basic_configuration() 
         : X(N), Y(N), Z(N), Xfull(N), Yfull(N), Zfull(N), 
-          X0(N), Y0(N), Z0(N), S(N), neighbours_list(N), bonded_neighbours(N), 
-          XCM(0), YCM(0), ZCM(0) {}
+          X0(N), Y0(N), Z0(N), S(N), neighbours_list(N), 
+          XCM(0), YCM(0), ZCM(0), skin(default_skin), nl_size(Size) { SetMolecules(TrimerMolecules()); }
+
+    /**
+     * @brief Constructor converting a configuration of another precision.
+     *
+     * @param other Configuration to convert.
+     */
+    template <typename Other>
+    explicit basic_configuration(const basic_configuration<Other>& other)
+        : X(other.X.begin(), other.X.end()), Y(other.Y.begin(), other.Y.end()), Z(other.Z.begin(), other.Z.end()),
+          Xfull(other.Xfull), Yfull(other.Yfull), Zfull(other.Zfull),
+          X0(other.X0.begin(), other.X0.end()), Y0(other.Y0.begin(), other.Y0.end()), Z0(other.Z0.begin(), other.Z0.end()),
+          S(other.S), neighbours_list(other.neighbours_list),
+          molecule(other.molecule), mol_start(other.mol_start), bond_start(other.bond_start), bond_partner(other.bond_partner),
+          XCM(other.XCM), YCM(other.YCM), ZCM(other.ZCM), skin(other.skin), nl_size(other.nl_size) {}
 
     /**
      * @brief Method to calculate center of mass coordinates.
@@ -53,16 +92,149 @@ struct configuration {
     void UpdateNL();
 
     /**
-     * @brief Method to retrieve bonded particles for all particles.
+     * @brief Method to build the bonds of every particle from the molecules.
+     *
+     * Molecules of up to three particles are fully bonded (the trimers of the model), longer
+     * molecules are linear chains bonding consecutive particles.
      */
     void GetBonds();
 
+    /**
+     * @brief Method to group the particles into molecules.
+     *
+     * Molecules are renumbered by order of appearance and bonds are rebuilt, unless the grouping
+     * did not change.
+     *
+     * @param index Molecule of each particle (the MOL_INDEX column of configuration files).
+     * @throws std::invalid_argument if there are not N indices or if a molecule is not contiguous.
+     */
+    void SetMolecules(const std::vector<int>& index);
+
+    /**
+     * @brief Method to retrieve the number of molecules.
+     *
+     * @return Number of molecules.
+     */
+    int Molecules() const { return mol_start.size() - 1; }
+
+    /**
+     * @brief Method to check whether particles are grouped into trimers of consecutive particles.
+     *
+     * @return True for the default grouping, which configuration files do not need to store.
+     */
+    bool Trimers() const;
+
     /**
      * @brief Method to check whether or not to update the neighbors list.
+     *
+     * Lists are rebuilt once a particle moved by more than half the skin since the last update.
+     * Lists stay valid when the box is rescaled, since uniform scaling keeps the order of the
+     * distances, but compressing the box by a factor f < 1 since the last update shrinks the
+     * effective skin to f(r_cutoff + skin) - r_cutoff (displacements being measured in scaled
+     * coordinates, as positions at the last update are rescaled along with the others).
+     *
+     * @return True if the neighbors list was rebuilt.
      */
-    void CheckNL();
+    bool CheckNL();
+
+    /**
+     * @brief Method to change the skin of the neighbours lists.
+     *
+     * Lists are rebuilt with the new skin, since lists built with a smaller skin would not be
+     * valid under the looser rebuild criterion of a larger one.
+     *
+     * @param new_skin New margin added to the cutoff radius.
+     * @throws std::invalid_argument if the skin is negative.
+     */
+    void SetSkin(double new_skin);
+
+    /**
+     * @brief Method to check whether the neighbours lists would still be valid in a rescaled box.
+     *
+     * @param factor Factor applied to the side of the current box.
+     * @return True if every pair closer than the cutoff in the rescaled box is listed.
+     */
+    bool NLValidAfterScaling(double factor) const;
+
+    /**
+     * @brief Method to rescale all positions about the origin of the box.
+     *
+     * Wrapped and unwrapped positions and positions at the last neighbours update are multiplied
+     * by `factor`, the neighbours lists being kept. The caller updates `Size` accordingly.
+     *
+     * @param factor Factor applied to all positions.
+     */
+    void Rescale(double factor);
+
+    /**
+     * @brief Method to reorder the particles.
+     *
+     * Neighbours lists are relabelled and molecules and bonds are rebuilt, so the permutation must
+     * keep the particles of each molecule contiguous and in order.
+     *
+     * @param perm New order of the particles (perm[i] is the current index of the particle moved to i).
+     */
+    void Permute(const std::vector<int>& perm);
 };
 
+/**
+ * @brief Configuration with the precision selected at build time.
+ */
+typedef basic_configuration<real> configuration;
+
+/**
+ * @brief Linked-cell structure binning particles into cubic cells of side at least `rmin`.
+ *
+ * Pairs closer than `rmin` are found by looping over the 27 cells surrounding a particle's cell,
+ * which is only valid if there are at least 3 cells along each direction.
+ */
+struct cell_list {
+    int nc;                ///< Number of cells along each direction
+    double lc;             ///< Side of a cell
+    std::vector<int> head; ///< First particle of each cell (-1 if empty)
+    std::vector<int> next; ///< Next particle inside the same cell (-1 at the end)
+    std::vector<int> cell; ///< Cell index of each particle
+
+    /**
+     * @brief Constructor of an empty structure.
+     */
+    cell_list() : nc(0), lc(0) {}
+
+    /**
+     * @brief Method to bin the particles of a configuration.
+     *
+     * @param cfg Configuration to bin.
+     * @param rmin Minimum side of the cells.
+     */
+    template <typename Real>
+    void Build(const basic_configuration<Real>& cfg, double rmin);
+
+    /**
+     * @brief Method to retrieve the index of a cell, periodic images included.
+     *
+     * @param cx Cell coordinate along X.
+     * @param cy Cell coordinate along Y.
+     * @param cz Cell coordinate along Z.
+     * @return Index of the cell.
+     */
+    int Index(int cx, int cy, int cz) const {
+        cx = (cx + nc) % nc; cy = (cy + nc) % nc; cz = (cz + nc) % nc;
+        return (cx*nc + cy)*nc + cz;
+    }
+};
+
+/**
+ * @brief Orders molecules along a Morton (Z-order) curve of the box.
+ *
+ * Molecules are sorted by the Morton key of their first particle on a 1024^3 grid, so that
+ * molecules close in space end up close in memory. Particles of a molecule stay contiguous.
+ *
+ * @param cfg Configuration to order.
+ * @return Permutation to pass to configuration::Permute.
+ */
+template <typename Real>
+std::vector<int> MortonOrder(const basic_configuration<Real>& cfg);
+
 /**
  * @brief Calculates difference of a and b while applying periodic boundary conditions.
  * 
@@ -70,7 +242,8 @@ struct configuration {
  * @param coord2 Second coordinate
  * @return Adjusted coordinate difference
  */
-double MinimumImageDistance(double coord1, double coord2);
+template <typename Real>
+Real MinimumImageDistance(Real coord1, Real coord2);
 
 /**
  * @brief Shifts coordinate inside main box.
@@ -0,0 +1,58 @@
+/**
+ * @file rng.hpp
+ * @brief Random number generator with an explicit, serializable state.
+ *
+ * This module provides an additive lagged-Fibonacci generator which reproduces, draw for draw,
+ * the sequence of the glibc `rand()` function. Contrary to `rand()`, its full state is exposed
+ * so that a simulation can be checkpointed and resumed bit-exactly, and the generated sequence
+ * no longer depends on the C library of the host system.
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+/**
+ * @brief Largest value returned by rng::Next().
+ */
+const int RNG_MAX = 2147483647;
+
+/**
+ * @brief Additive lagged-Fibonacci generator r[i] = r[i-3] + r[i-31].
+ *
+ * The structure is a trivial aggregate, so that it can live in thread-local storage without
+ * per-access initialization checks. Call Seed() before drawing from a new generator.
+ */
+struct rng {
+    int32_t state[31]; ///< Lagged-Fibonacci table
+    int front;         ///< Index of the front tap inside the table
+    int rear;          ///< Index of the rear tap inside the table
+
+    /**
+     * @brief Method to (re)seed the generator, equivalent to `srand(seed)`.
+     *
+     * @param seed Seed of the sequence.
+     */
+    void Seed(unsigned int seed);
+
+    /**
+     * @brief Method to draw the next integer of the sequence, equivalent to `rand()`.
+     *
+     * @return A random integer between 0 and RNG_MAX.
+     */
+    int Next(){
+        uint32_t value = (uint32_t)state[front] + (uint32_t)state[rear];
+        state[front] = (int32_t)value;
+        if (++front >= 31) front = 0;
+        if (++rear >= 31) rear = 0;
+        return (int)(value >> 1);
+    }
+};
+
+/**
+ * @brief Generator shared by all Monte Carlo moves of a thread, initially seeded like an unseeded `rand()`.
+ */
+extern __thread rng generator;
+
+#endif // RNG_H
@@ -13,11 +13,118 @@
 
 #include <vector>
 #include <string>
+#include <ios>
+#include <cmath>
 #include "particles.hpp"
+#include "structure.hpp"
+#include "observables.hpp"
+#include "correlator.hpp"
+#include "stats.hpp"
+#include "equilibration.hpp"
+#include "histogram.hpp"
+
+/**
+ * @brief Width of the uniform distribution of trial displacements along each direction.
+ *
+ * One value per thread, like N and Size. MonteCarloRun sets it from `run_options::step`.
+ */
+extern __thread double maximum_displacement;
+
+/**
+ * @brief Optional run settings, either read from the JSON parameters or from the command line.
+ */
+struct run_options {
+    bool restart;               ///< Resume the run from the checkpoint stored in the output directory
+    bool generate;              ///< Start from a generated configuration instead of reading one
+    int checkpoint_every;       ///< Number of MC sweeps between two checkpoints (0 disables)
+    double checkpoint_walltime; ///< Wall-clock seconds between two checkpoints (0 disables)
+    int threads;                ///< Number of worker threads of observables-only runs (0 for all cores)
+    int structure_every;        ///< Number of MC sweeps between two g(r) and S(q) samples (0 disables)
+    double gr_rmax;             ///< Cutoff of g(r)
+    int gr_bins;                ///< Number of bins of g(r)
+    int sq_nmax;                ///< Largest wave-vector shell of S(q), in units of 2*pi/L (0 disables S(q))
+    std::vector<double> sq_q;   ///< Wave-vectors of the shells of S(q), replacing the shells 1...sq_nmax if not empty
+    int sq_modes;               ///< Largest number of wave-vectors per shell of S(q) (0 keeps them all)
+    double overlap_a;           ///< Cutoff distance of the overlap function Q
+    int correlator_every;       ///< Number of MC sweeps between two multiple-tau correlator updates (0 disables)
+    int correlator_p;           ///< Number of blocks stored at each level of the correlator
+    int correlator_m;           ///< Decimation factor between two levels of the correlator
+    double correlator_q;        ///< Wave-vector of the correlator's self-intermediate scattering function (0 for 2*pi/sigmaMax)
+    int stats_every;            ///< Number of MC sweeps between two rows of the stats file (0 disables)
+    int sort_every;             ///< Number of neighbours list rebuilds between two spatial sorts of the molecules (0 disables)
+    int equil_max_sweeps;       ///< Largest number of equilibration sweeps before the run (0 disables equilibration)
+    int equil_every;            ///< Number of MC sweeps between two samples of the equilibration monitor
+    int equil_relaxations;      ///< Number of relaxation times required with a stationary energy
+    double equil_fs;            ///< Value of Fs defining one relaxation
+    double skin;                ///< Margin added to the cutoff radius of the neighbours lists (initial value if tuned)
+    int skin_tune;              ///< Number of MC sweeps measured for each skin while tuning it (0 disables)
+    bool obs_average;           ///< Average the observables over cycles into `obs_avg.txt`
+    bool obs_raw;               ///< Write one row per snapshot and cycle into `obs.txt`
+    bool obs_binary;            ///< Write the rows of `obs.txt` into the binary file `obs.npy`
+    int live_every;             ///< Number of MC sweeps between two frames of the live export (0 disables)
+    double pressure;            ///< Pressure of the isobaric volume moves
+    int volume_every;           ///< Number of MC sweeps between two volume moves (0 keeps the volume fixed)
+    double volume_max;          ///< Largest change of the logarithm of the volume in a volume move
+    double step;                ///< Width of the trial displacements along each direction
+    double swap_fraction;       ///< Number of inter-molecular swap trials per sweep, in units of N
+    bool swap_local;            ///< Draw the partners of swaps from the neighbours lists
+    int histogram_every;        ///< Number of MC sweeps between two samples of the energy histogram (0 disables)
+    double histogram_width;     ///< Width of the bins of the energy histogram, per particle
+    std::vector<std::string> histogram_observables; ///< Static observables averaged in each bin of the energy histogram
+    bool flip_heat_bath;        ///< Draw the types of a molecule among all their arrangements instead of Metropolis flips
+    std::string manifest;       ///< Manifest of jobs to run instead of a single run (empty for a single run)
+    int jobs;                   ///< Number of jobs of the manifest running at the same time (0 for all cores)
+
+    /**
+     * @brief Constructor setting the default values.
+     */
+    run_options() 
+        : restart(false), generate(false), checkpoint_every(0), checkpoint_walltime(0), threads(0), 
+          structure_every(0), gr_rmax(4.0), gr_bins(200), sq_nmax(20), sq_modes(0), overlap_a(0.3),
+          correlator_every(0), correlator_p(16), correlator_m(2), correlator_q(0),
+          stats_every(1000), sort_every(0), equil_max_sweeps(0), equil_every(10), equil_relaxations(10),
+          equil_fs(exp(-1.)), skin(default_skin), skin_tune(0), obs_average(false), obs_raw(true), obs_binary(false),
+          live_every(0), pressure(0), volume_every(0), volume_max(0.002), step(0.17),
+          swap_fraction(0), swap_local(false), histogram_every(0), histogram_width(0.001),
+          flip_heat_bath(false), jobs(0) {}
+};
+
+/**
+ * @brief Structure holding the state of a Monte Carlo run besides the current configuration.
+ */
+struct run_state {
+    int t;                                  ///< Next MC sweep to perform
+    int dataCounter;                        ///< Number of log-spaced snapshots already processed
+    int cycleCounter;                       ///< Number of cycle references already recorded
+    std::vector <configuration> cfgsCycles; ///< Reference configurations of each cycle
+    std::streamoff obsOffset;               ///< Size of the observables file at checkpoint time
+    std::streamoff obsBinaryOffset;         ///< Size of the binary observables file at checkpoint time
+    structure_accumulator structure;        ///< g(r) and S(q) accumulated since the end of the last cycle
+    overlap_moments moments;                ///< Overlap moments accumulated over cycles
+    cycle_averages averages;                ///< Observables averaged over cycles
+    multi_tau_correlator correlator;        ///< MSD and Fs accumulated over all time origins
+    energy_histogram histogram;             ///< Energy histogram of the run (disabled if width is 0)
+    run_stats stats;                        ///< Runtime statistics of the rows already written
+    run_stats window;                       ///< Runtime statistics since the last row of the stats file
+    std::streamoff statsOffset;             ///< Size of the stats file at checkpoint time
+    std::vector <int> order;                ///< Original index of each particle (empty if never sorted)
+    equilibration_monitor equilibration;    ///< Equilibration phase preceding the run (done if disabled)
+    skin_tuner tuner;                       ///< Search of the skin of the neighbours lists (done if disabled)
+
+    /**
+     * @brief Constructor setting the state of a fresh run.
+     */
+    run_state() 
+        : t(1), dataCounter(0), cycleCounter(0), obsOffset(0), obsBinaryOffset(0), statsOffset(0) {}
+};
 
 /**
  * @brief Runs the Monte Carlo simulation.
  * 
+ * If `opts.equil_max_sweeps` is set, the run is preceded by equilibration sweeps which stop as
+ * soon as the energy has been stationary for `opts.equil_relaxations` relaxation times (see
+ * equilibration_monitor), or after `opts.equil_max_sweeps` sweeps.
+ *
  * @param cfg Initial configuration.
  * @param T Temperature.
  * @param tau Number of Monte Carlo steps.
@@ -29,39 +136,157 @@
  * @param n_log Number of log-spaced points.
  * @param n_lin Number of linear-spaced points.
  * @param progress_bar True/False statement to output progress_bar
+ * @param opts Optional run settings (checkpointing, restart).
  */
 void MonteCarloRun(configuration& cfg, double T, int tau, int cycles, int tw, double p_flip, 
-        std::vector <std::string>& observables, std::string& out, int n_log, int n_lin, bool progress_bar);
+        std::vector <std::string>& observables, std::string& out, int n_log, int n_lin, bool progress_bar,
+        const run_options& opts = run_options());
+
+/**
+ * @brief Mix of trial moves of a sweep.
+ */
+enum move_set {
+    mixed_moves,        ///< Displacements with probability 1-p_flip, flips otherwise
+    displacement_moves, ///< Displacements only (p_flip = 0)
+    flip_moves          ///< Flips only (p_flip = 1)
+};
+
+/**
+ * @brief Sweep kernel performing N trial moves.
+ *
+ * @param cfg Current configuration.
+ * @param T Temperature.
+ * @param p_flip Probability of flipping (only read by mixed moves).
+ * @param stats Counters of the trial moves.
+ */
+typedef void (*sweep_kernel)(configuration& cfg, double T, double p_flip, run_stats& stats);
+
+/**
+ * @brief Performs one MC sweep of N trial moves on random particles.
+ *
+ * The move mix is a template parameter, so that pure displacement and pure flip runs compile to
+ * loops without the per-trial draw of the move type and its branch. They therefore consume one
+ * random number less per trial than a mixed run.
+ *
+ * @tparam Moves Mix of trial moves.
+ * @tparam HeatBath Whether flips are heat-bath flips (TryHeatBathFlip) instead of TryFlip.
+ */
+template <move_set Moves, bool HeatBath = false>
+void Sweep(configuration& cfg, double T, double p_flip, run_stats& stats);
+
+/**
+ * @brief Selects the sweep kernel of a move mix, once before the sweeps.
+ *
+ * @param p_flip Probability of flipping.
+ * @param heat_bath Whether flips are heat-bath flips.
+ * @return Pure displacement kernel if p_flip = 0, pure flip kernel if p_flip = 1, mixed otherwise.
+ * @throws std::invalid_argument if p_flip is not between 0 and 1.
+ */
+sweep_kernel SelectSweep(double p_flip, bool heat_bath = false);
 
 /**
  * @brief Tries displacing one particle.
  * 
+ * @tparam Real Scalar type of the wrapped positions (float or double).
  * @param cfg Current configuration.
  * @param j Index of the particle to displace.
  * @param T Temperature.
+ * @return True if the displacement was accepted.
  */
-void TryDisp(configuration& cfg, int j, double T);
+template <typename Real>
+bool TryDisp(basic_configuration<Real>& cfg, int j, double T);
 
 /**
  * @brief Tries swapping two particles' diameters.
  * 
+ * @tparam Real Scalar type of the wrapped positions (float or double).
+ * @param cfg Current configuration.
+ * @param j Index of the particle to swap.
+ * @param T Temperature.
+ * @return True if the flip was accepted.
+ */
+template <typename Real>
+bool TryFlip(basic_configuration<Real>& cfg, int j, double T);
+
+/**
+ * @brief Draws new types for the molecule of a particle among all their arrangements.
+ *
+ * The energies of every distinct arrangement of the molecule's types (6 for a trimer of three
+ * types) are computed from a single pass over the neighbours lists of its particles (see VTypes),
+ * and an arrangement is drawn with its Boltzmann weight, whatever the current one. Unlike TryFlip,
+ * no trial is wasted on a rejection: the types only stay put with the probability of the current
+ * arrangement. Molecules of more than three particles fall back to TryFlip.
+ *
+ * @tparam Real Scalar type of the wrapped positions (float or double).
+ * @param cfg Current configuration.
+ * @param j Index of a particle of the molecule.
+ * @param T Temperature.
+ * @return True if the types of the molecule changed.
+ */
+template <typename Real>
+bool TryHeatBathFlip(basic_configuration<Real>& cfg, int j, double T);
+
+/**
+ * @brief Tries swapping the diameters of particle j and of a particle of another molecule.
+ *
+ * The partner is drawn uniformly among all particles, or among the neighbours of j if `local`
+ * (neighbours lists are symmetric and unchanged by the move, so both proposals are symmetric).
+ * Partners of the same type or of the same molecule give a rejected trial. Unlike flips, swaps
+ * change the composition of the molecules, only the number of particles of each type being
+ * conserved.
+ *
+ * @tparam Real Scalar type of the wrapped positions (float or double).
  * @param cfg Current configuration.
  * @param j Index of the particle to swap.
  * @param T Temperature.
+ * @param local Whether the partner is drawn from the neighbours list of j.
+ * @return True if the swap was accepted.
+ */
+template <typename Real>
+bool TrySwap(basic_configuration<Real>& cfg, int j, double T, bool local);
+
+/**
+ * @brief Tries an isobaric change of the volume.
+ *
+ * The logarithm of the volume is changed by a uniform amount of at most `max_dlnV` and all
+ * positions are rescaled, the move being accepted with probability
+ * min(1, exp(-(dU + P dV)/T + (N+1) ln(V'/V))). The energies of the current and rescaled
+ * configurations are summed in one pass over the current neighbours lists (see VTotalScaled),
+ * which stay valid in scaled coordinates; they are only rebuilt beforehand if the compression
+ * would leave them without margin.
+ *
+ * @tparam Real Scalar type of the wrapped positions (float or double).
+ * @param cfg Current configuration.
+ * @param T Temperature.
+ * @param P Pressure.
+ * @param max_dlnV Largest change of the logarithm of the volume.
+ * @param rebuilt Set to true if the neighbours lists were rebuilt (optional), so that the
+ *                caller can count the rebuild like those of CheckNL.
+ * @return True if the volume move was accepted.
  */
-void TryFlip(configuration& cfg, int j, double T);
+template <typename Real>
+bool TryVolume(basic_configuration<Real>& cfg, double T, double P, double max_dlnV, bool* rebuilt = nullptr);
 
 /**
  * @brief Computes observables without running the simulation.
+ *
+ * Saved snapshots are replayed concurrently on a pool of worker threads, each reusing its own
+ * configuration buffer, while rows are written to `obs.txt` in order. Neighbours lists are only
+ * built when an energy-type observable is requested. Snapshots are read in the box of side
+ * `Size`, so the volume must have been fixed during the run.
  * 
+ * @param T Temperature (kinetic part of the pressure).
  * @param tau Number of Monte Carlo steps.
  * @param cycles Number of cycles.
  * @param tw Waiting time.
  * @param observables List of observables to compute.
  * @param out Output directory.
  * @param n_log Number of log-spaced points.
+ * @param progress_bar True/False statement to output progress_bar
+ * @param opts Optional run settings (number of threads).
  */
-void ComputeObservables(int tau, int cycles, int tw, 
-        std::vector <std::string>& observables, std::string& out, int n_log);
+void ComputeObservables(double T, int tau, int cycles, int tw, 
+        std::vector <std::string>& observables, std::string& out, int n_log, bool progress_bar,
+        const run_options& opts = run_options());
 
 #endif // SIMULATION_H
\ No newline at end of file
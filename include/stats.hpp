@@ -0,0 +1,149 @@
+/**
+ * @file stats.hpp
+ * @brief Runtime performance counters of Monte Carlo runs.
+ *
+ * This module counts accepted trial moves and neighbours list rebuilds and measures the time
+ * spent in each part of the Monte Carlo loop, so that jobs can be sized and slow state points
+ * spotted while a run is going.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include "particles.hpp"
+
+/**
+ * @brief Counters and timers accumulated over a range of MC sweeps.
+ *
+ * The structure is trivially copyable so that it can be stored in checkpoints.
+ */
+struct run_stats {
+    long long sweeps;             ///< Number of MC sweeps
+    long long disp_trials;        ///< Number of attempted displacements
+    long long disp_accepted;      ///< Number of accepted displacements
+    long long flip_trials;        ///< Number of attempted flips
+    long long flip_accepted;      ///< Number of accepted flips
+    long long swap_trials;        ///< Number of attempted inter-molecular swaps
+    long long swap_accepted;      ///< Number of accepted inter-molecular swaps
+    long long nl_rebuilds;        ///< Number of neighbours list rebuilds
+    double neighbours;            ///< Summed mean numbers of neighbours per particle
+    long long neighbours_samples; ///< Number of samples of the mean number of neighbours
+    double time_sweeps;           ///< Seconds spent in trial moves
+    double time_neighbours;       ///< Seconds spent checking and rebuilding neighbours lists
+    double time_observables;      ///< Seconds spent computing observables
+    double time_io;               ///< Seconds spent writing configurations, observables and checkpoints
+    double time_total;            ///< Wall-clock seconds
+    double skin;                  ///< Skin of the neighbours lists at the last sample
+    long long volume_trials;      ///< Number of attempted volume moves
+    long long volume_accepted;    ///< Number of accepted volume moves
+    double density;               ///< Number density at the last sample
+
+    /**
+     * @brief Constructor setting all counters to zero.
+     */
+    run_stats()
+        : sweeps(0), disp_trials(0), disp_accepted(0), flip_trials(0), flip_accepted(0),
+          swap_trials(0), swap_accepted(0), nl_rebuilds(0), neighbours(0), neighbours_samples(0), time_sweeps(0),
+          time_neighbours(0), time_observables(0), time_io(0), time_total(0), skin(0),
+          volume_trials(0), volume_accepted(0), density(0) {}
+
+    /**
+     * @brief Method to add the counters of another range of sweeps.
+     *
+     * @param other Counters to add.
+     */
+    void Merge(const run_stats& other);
+
+    /**
+     * @brief Method to sample the mean number of neighbours per particle (and the skin and density).
+     *
+     * @param cfg Current configuration.
+     */
+    void SampleNeighbours(const configuration& cfg);
+
+    /**
+     * @brief Method to write one row of the stats file.
+     *
+     * @param t Current MC sweep.
+     * @param log_stats Output stream.
+     */
+    void WriteRow(int t, std::ostream& log_stats) const;
+
+    /**
+     * @brief Method to write the summary of a run in JSON format.
+     *
+     * @param output Path to the summary file.
+     */
+    void WriteSummary(std::string output) const;
+
+    /**
+     * @brief Method to print a human-readable summary.
+     *
+     * @param os Output stream.
+     */
+    void Print(std::ostream& os) const;
+};
+
+/**
+ * @brief Online tuning of the skin of the neighbours lists.
+ *
+ * A larger skin makes every trial move loop over more neighbours but makes rebuilds rarer, and
+ * the best trade-off depends on the temperature. The time spent in trial moves and neighbours
+ * lists per sweep is measured over `sweeps` sweeps for each skin. Starting from the initial
+ * skin, the skin is changed by `step` in the direction lowering this cost (larger skins first)
+ * until the cost rises again, and the skin with the lowest cost is kept for the rest of the run.
+ * The structure is trivially copyable so that it can be stored in checkpoints.
+ */
+struct skin_tuner {
+    int sweeps;             ///< Number of MC sweeps measured for each skin
+    double step;            ///< Change of the skin between two measurements
+    double initial;         ///< Skin at the start of the search
+    double skin;            ///< Skin being measured
+    int direction;          ///< Direction of the search (+1 or -1)
+    double best_skin;       ///< Skin with the lowest cost so far
+    double best_cost;       ///< Lowest cost so far in seconds per sweep (negative before the first measurement)
+    long long start_sweeps; ///< Sweeps performed at the start of the current measurement (-1 before it starts)
+    double start_seconds;   ///< Seconds spent at the start of the current measurement
+    bool done;              ///< True once the skin is chosen
+
+    /**
+     * @brief Constructor of a disabled tuner.
+     */
+    skin_tuner()
+        : sweeps(0), step(0), initial(0), skin(0), direction(0), best_skin(0), best_cost(-1),
+          start_sweeps(-1), start_seconds(0), done(true) {}
+
+    /**
+     * @brief Constructor of a tuner starting from a given skin.
+     *
+     * @param sweeps Number of MC sweeps measured for each skin.
+     * @param skin Initial skin.
+     * @param step Change of the skin between two measurements.
+     * @throws std::invalid_argument if a parameter is out of range.
+     */
+    skin_tuner(int sweeps, double skin, double step = 0.1);
+
+    /**
+     * @brief Method to feed the tuner with the time spent so far.
+     *
+     * Must be called before every sweep, while the neighbours lists use the returned skin.
+     *
+     * @param total_sweeps Number of MC sweeps performed so far.
+     * @param total_seconds Seconds spent in trial moves and neighbours lists so far.
+     * @return The skin to use for the next sweep.
+     */
+    double Update(long long total_sweeps, double total_seconds);
+};
+
+/**
+ * @brief Creates the stats file and writes its header.
+ *
+ * @param output Path to the stats file.
+ * @return Output stream of the stats file.
+ */
+std::ofstream MakeStatsFile(std::string output);
+
+#endif // STATS_H
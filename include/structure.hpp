@@ -0,0 +1,103 @@
+/**
+ * @file structure.hpp
+ * @brief Static structure observables accumulated during the simulation.
+ *
+ * This module accumulates the partial radial distribution functions g(r) and the partial
+ * static structure factors S(q) of the three particle types on the fly, so that structural
+ * data no longer requires dumping and post-processing configurations.
+ */
+
+#ifndef STRUCTURE_H
+#define STRUCTURE_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "particles.hpp"
+
+/**
+ * @brief Number of distinct type pairs (AA, AB, AC, BB, BC, CC).
+ */
+const int typePairs = 6;
+
+/**
+ * @brief Index of the type pair (a, b) among AA, AB, AC, BB, BC, CC.
+ *
+ * @param a Type of the first particle (0, 1 or 2).
+ * @param b Type of the second particle (0, 1 or 2).
+ * @return Index of the pair.
+ */
+inline int TypePair(int a, int b){
+    if (a > b) std::swap(a, b);
+    return a*3 - a*(a-1)/2 + (b-a);
+}
+
+/**
+ * @brief Shells of wave-vectors of S(q), in units of 2*pi/L.
+ *
+ * @param nmax Largest shell when no wave-vector is requested (all shells 1...nmax).
+ * @param q Wave-vectors whose shells are requested, rounded to the nearest shell of the current box.
+ * @return Requested shells in increasing order, without repetitions.
+ */
+std::vector<int> WaveVectorShells(int nmax, const std::vector<double>& q);
+
+/**
+ * @brief Accumulator of partial radial distribution functions and static structure factors.
+ *
+ * g(r) is histogrammed up to `rmax` using a cell list. S(q) is averaged over the wave-vectors
+ * q = 2*pi*n/L with integer n inside each requested shell of |n|. Since a shell holds about
+ * 2*pi*|n|^2 wave-vectors, at most `max_modes` of them are kept per shell, spread over the whole
+ * shell and fixed at construction, which bounds the cost of the shells around the first peak of
+ * large boxes.
+ */
+struct structure_accumulator {
+    double rmax;             ///< Cutoff of the radial distribution functions
+    int bins;                ///< Number of bins of the radial distribution functions
+    int samples;             ///< Number of accumulated samples
+    std::vector<int> shells; ///< Shells of wave-vectors, |n| in units of 2*pi/L
+    std::vector<int> vectors;///< Kept wave-vectors (nx, ny, nz), sorted by nx then ny
+    std::vector<int> vector_shell; ///< Index in `shells` of each kept wave-vector
+    std::vector<double> gr;  ///< Pair counts of each type pair, then of all pairs (bins x (typePairs+1))
+    std::vector<double> norm;///< Summed pair densities of each type pair, then of all pairs (typePairs+1)
+    std::vector<double> sq;  ///< Summed partial structure factors, then total one (shells x (typePairs+1))
+    std::vector<double> qs;  ///< Summed wave-vector norms of each shell
+    std::vector<int> modes;  ///< Number of kept wave-vectors inside each shell
+
+    /**
+     * @brief Constructor of a disabled accumulator.
+     */
+    structure_accumulator() : rmax(0), bins(0), samples(0) {}
+
+    /**
+     * @brief Constructor allocating the histograms.
+     *
+     * @param rmax Cutoff of the radial distribution functions (at most half the box).
+     * @param bins Number of bins of the radial distribution functions.
+     * @param shells Shells of wave-vectors of S(q), in units of 2*pi/L (empty disables S(q)).
+     * @param max_modes Largest number of wave-vectors per shell (0 keeps them all).
+     * @throws std::invalid_argument if a shell is not positive or max_modes is negative.
+     */
+    structure_accumulator(double rmax, int bins, const std::vector<int>& shells, int max_modes = 0);
+
+    /**
+     * @brief Method to accumulate g(r) and S(q) of a configuration.
+     *
+     * @param cfg Current configuration.
+     */
+    void Sample(const configuration& cfg);
+
+    /**
+     * @brief Method to write the averaged g(r) and S(q).
+     *
+     * @param output_gr Path to the g(r) file (columns `r gAA gAB gAC gBB gBC gCC g`).
+     * @param output_sq Path to the S(q) file (columns `q SAA SAB SAC SBB SBC SCC S`).
+     */
+    void Write(std::string output_gr, std::string output_sq) const;
+
+    /**
+     * @brief Method to discard the accumulated samples.
+     */
+    void Reset();
+};
+
+#endif // STRUCTURE_H
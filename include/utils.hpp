@@ -16,6 +16,8 @@
 #include <vector>
 #include <fstream>
 #include "particles.hpp"
+#include "simulation.hpp"
+#include "observables.hpp"
 
 /**
  * @brief Parses command line arguments.
@@ -32,6 +34,23 @@ bool ParseCMDLine(int argc, const char* argv[],
                         std::string& params,
                         std::vector<std::string>& observables);
 
+/**
+ * @brief Parses command line arguments, including optional run settings.
+ * 
+ * @param argc Number of arguments.
+ * @param argv Array of argument strings.
+ * @param input Path to initial configuration file.
+ * @param params Path to JSON file for simulation parameters.
+ * @param observables List of observables to compute.
+ * @param opts Optional run settings (e.g. `--restart`, `--manifest`).
+ * @return true if parsing was successful, false otherwise (`--params` is required without `--manifest`).
+ */
+bool ParseCMDLine(int argc, const char* argv[],
+                        std::string& input,
+                        std::string& params,
+                        std::vector<std::string>& observables,
+                        run_options& opts);
+
 /**
  * @brief Reads parameters from a JSON file.
  * 
@@ -58,22 +77,61 @@ bool ReadJSONParams(const std::string& params_path,
                     int& linPoints,
                     double& p_flip);
 
+/**
+ * @brief Reads optional run settings from a JSON file.
+ *
+ * Missing fields keep the defaults of `run_options`.
+ * 
+ * @param params_path Path to the JSON file.
+ * @param opts Run settings to fill.
+ * @return true if reading was successful, false otherwise.
+ */
+bool ReadJSONOptions(const std::string& params_path, run_options& opts);
+
 /**
  * @brief Reads trimer configuration from a file.
  * 
+ * Lines hold `TYPE X Y Z`, optionally preceded by a MOL_INDEX column grouping the particles into
+ * molecules of any size (particles of a molecule must be contiguous). Particles are grouped into
+ * trimers of consecutive particles when the column is absent.
+ *
  * @param input Path to the input file.
  * @return The configuration read from the file.
  */
 configuration ReadTrimCFG(std::string input);
 
+/**
+ * @brief Reads trimer configuration from a file into an existing configuration.
+ *
+ * Contrary to the returning version, the particle arrays of C are reused when reading many
+ * snapshots into the same buffer, and bonds are only rebuilt if the molecules change. The
+ * molecule index is still read into temporary vectors, so this is not allocation free.
+ * 
+ * @param input Path to the input file.
+ * @param C Configuration to fill.
+ */
+void ReadTrimCFG(std::string input, configuration& C);
+
 /**
  * @brief Writes trimer configuration to a file.
  * 
+ * The MOL_INDEX column is only written if particles are not grouped into trimers of consecutive
+ * particles, so that files of trimers keep their format.
+ * 
  * @param cfg The configuration to write.
  * @param output Path to the output file.
  */
 void WriteTrimCFG(const configuration& cfg, std::string output);
 
+/**
+ * @brief Writes a reordered trimer configuration to a file in the original particles' order.
+ * 
+ * @param cfg The configuration to write.
+ * @param output Path to the output file.
+ * @param order Original index of each particle of the configuration (identity if empty).
+ */
+void WriteTrimCFG(const configuration& cfg, std::string output, const std::vector<int>& order);
+
 /**
  * @brief Creates output directory for storing results.
  * 
@@ -85,25 +143,32 @@ void MakeOutDir(std::string rootdir, std::string params_path);
 /**
  * @brief Creates an output file for storing observable data.
  * 
- * @param observables List of observables to log.
+ * @param observables Observables to log.
+ * @param output Path to the output file.
+ * @return An open output file stream for logging observables.
+ */
+std::ofstream MakeObsFile(const observables_set& observables, std::string output);
+
+/**
+ * @brief Reopens an observables (or stats) file to append to it after a restart.
+ *
+ * Rows written after the checkpoint are discarded since they will be computed again.
+ * 
  * @param output Path to the output file.
+ * @param offset Size of the file at checkpoint time.
  * @return An open output file stream for logging observables.
  */
-std::ofstream MakeObsFile(std::vector <std::string>& observables, std::string output);
+std::ofstream ReopenObsFile(std::string output, std::streamoff offset);
 
 /**
- * @brief Writes observables at a specific timestep.
+ * @brief Writes already computed observables at a specific timestep.
  * 
- * @param cfg Current configuration.
- * @param cfg0 Initial configuration.
  * @param t Current timestep.
  * @param cycle Current cycle.
- * @param observables List of observables.
- * @param log_obs Output file stream for logging observables.
+ * @param values Values of the observables.
+ * @param log_obs Output stream for logging observables.
  */
-void WriteObs(const configuration& cfg, const configuration& cfg0, 
-              int t, int cycle, std::vector <std::string>& observables, 
-              std::ofstream& log_obs);
+void WriteObs(int t, int cycle, const std::vector <double>& values, std::ostream& log_obs);
 
 /**
  * @brief Gets log-spaced snapshots.
@@ -0,0 +1,224 @@
+#include <fstream>
+#include <cstring>
+#include <map>
+#include <boost/filesystem.hpp>
+#include "globals.hpp"
+#include "checkpoint.hpp"
+
+namespace fs = boost::filesystem;
+
+// Checkpoint format
+const char checkpoint_magic[8] = {'T', 'F', 'M', 'C', 'C', 'K', 'P', 'T'};
+const int checkpoint_version = 18;
+
+// Writes one configuration
+void WriteConfiguration(std::ostream& os, const configuration& cfg){
+    WriteBinary(os, cfg.X); WriteBinary(os, cfg.Y); WriteBinary(os, cfg.Z);
+    WriteBinary(os, cfg.Xfull); WriteBinary(os, cfg.Yfull); WriteBinary(os, cfg.Zfull);
+    WriteBinary(os, cfg.X0); WriteBinary(os, cfg.Y0); WriteBinary(os, cfg.Z0);
+    WriteBinary(os, cfg.S); WriteBinary(os, cfg.molecule);
+    WriteBinary(os, cfg.XCM); WriteBinary(os, cfg.YCM); WriteBinary(os, cfg.ZCM); WriteBinary(os, cfg.skin);
+    WriteBinary(os, cfg.nl_size);
+    for (int i = 0; i < N; i++) WriteBinary(os, cfg.neighbours_list[i]);
+}
+
+// Reads one configuration
+void ReadConfiguration(std::istream& is, configuration& cfg){
+    ReadBinary(is, cfg.X); ReadBinary(is, cfg.Y); ReadBinary(is, cfg.Z);
+    ReadBinary(is, cfg.Xfull); ReadBinary(is, cfg.Yfull); ReadBinary(is, cfg.Zfull);
+    ReadBinary(is, cfg.X0); ReadBinary(is, cfg.Y0); ReadBinary(is, cfg.Z0);
+    ReadBinary(is, cfg.S);
+    std::vector<int> molecules;
+    ReadBinary(is, molecules);
+    ReadBinary(is, cfg.XCM); ReadBinary(is, cfg.YCM); ReadBinary(is, cfg.ZCM); ReadBinary(is, cfg.skin);
+    ReadBinary(is, cfg.nl_size);
+    cfg.neighbours_list.resize(N);
+    for (int i = 0; i < N; i++) ReadBinary(is, cfg.neighbours_list[i]);
+    // Bonds only depend on the molecules
+    cfg.SetMolecules(molecules);
+}
+
+// Writes a list of names
+void WriteNames(std::ostream& os, const std::vector<std::string>& names){
+    WriteBinary(os, (long long)names.size());
+    for (const std::string& name: names) WriteBinary(os, std::vector<char>(name.begin(), name.end()));
+}
+
+// Reads a list of names
+void ReadNames(std::istream& is, std::vector<std::string>& names){
+    long long size;
+    ReadBinary(is, size);
+    names.clear();
+    for (long long k = 0; k < size; k++){
+        std::vector<char> name;
+        ReadBinary(is, name);
+        names.emplace_back(name.begin(), name.end());
+    }
+}
+
+// Writes a map keyed by time lags
+template <typename T>
+void WriteLagMap(std::ostream& os, const std::map<int, T>& values){
+    WriteBinary(os, (long long)values.size());
+    for (const std::pair<const int, T>& entry: values){
+        WriteBinary(os, entry.first); WriteBinary(os, entry.second);
+    }
+}
+
+// Reads a map keyed by time lags
+template <typename T>
+void ReadLagMap(std::istream& is, std::map<int, T>& values){
+    long long size;
+    ReadBinary(is, size);
+    values.clear();
+    for (long long k = 0; k < size; k++){
+        int lag; T value;
+        ReadBinary(is, lag); ReadBinary(is, value);
+        values[lag] = value;
+    }
+}
+
+// Writes the state of a run to a checkpoint file
+void WriteCheckpoint(const configuration& cfg, const run_state& state, std::string output){
+    std::string tmp = output + ".tmp";
+    std::ofstream ckpt(tmp, std::ios::binary | std::ios::trunc);
+    if (!ckpt.is_open()){
+        throw std::runtime_error("Could not open file: " + tmp);
+    }
+    ckpt.write(checkpoint_magic, sizeof(checkpoint_magic));
+    WriteBinary(ckpt, checkpoint_version);
+    WriteBinary(ckpt, (int)sizeof(real));
+    WriteBinary(ckpt, N); WriteBinary(ckpt, Size);
+
+    // Counters and random number generator
+    WriteBinary(ckpt, state.t);
+    WriteBinary(ckpt, state.dataCounter);
+    WriteBinary(ckpt, state.cycleCounter);
+    long long obsOffset = state.obsOffset;
+    WriteBinary(ckpt, obsOffset);
+    long long obsBinaryOffset = state.obsBinaryOffset;
+    WriteBinary(ckpt, obsBinaryOffset);
+    long long statsOffset = state.statsOffset;
+    WriteBinary(ckpt, statsOffset);
+    WriteBinary(ckpt, generator);
+
+    // Configurations
+    WriteConfiguration(ckpt, cfg);
+    WriteBinary(ckpt, (int)state.cfgsCycles.size());
+    for (const configuration& ref: state.cfgsCycles) WriteConfiguration(ckpt, ref);
+
+    // Accumulators
+    const structure_accumulator& structure = state.structure;
+    WriteBinary(ckpt, structure.rmax); WriteBinary(ckpt, structure.bins); 
+    WriteBinary(ckpt, structure.samples); WriteBinary(ckpt, structure.shells);
+    WriteBinary(ckpt, structure.vectors); WriteBinary(ckpt, structure.vector_shell);
+    WriteBinary(ckpt, structure.gr); WriteBinary(ckpt, structure.norm);
+    WriteBinary(ckpt, structure.sq); WriteBinary(ckpt, structure.qs); WriteBinary(ckpt, structure.modes);
+    WriteLagMap(ckpt, state.moments.sumQ); WriteLagMap(ckpt, state.moments.sumQ2); 
+    WriteLagMap(ckpt, state.moments.samples);
+    WriteLagMap(ckpt, state.averages.samples); WriteLagMap(ckpt, state.averages.mean);
+    WriteLagMap(ckpt, state.averages.m2);
+    const multi_tau_correlator& correlator = state.correlator;
+    WriteBinary(ckpt, correlator.p); WriteBinary(ckpt, correlator.m); WriteBinary(ckpt, correlator.every);
+    WriteBinary(ckpt, correlator.max_lag); WriteBinary(ckpt, correlator.q); WriteBinary(ckpt, correlator.levels);
+    WriteBinary(ckpt, correlator.blocks);
+    WriteBinary(ckpt, correlator.head); WriteBinary(ckpt, correlator.filled); WriteBinary(ckpt, correlator.pushed);
+    WriteBinary(ckpt, correlator.msd); WriteBinary(ckpt, correlator.fs); WriteBinary(ckpt, correlator.samples);
+    WriteBinary(ckpt, state.stats); WriteBinary(ckpt, state.window);
+    WriteBinary(ckpt, state.order);
+    const equilibration_monitor& equil = state.equilibration;
+    WriteBinary(ckpt, equil.every); WriteBinary(ckpt, equil.relaxations); WriteBinary(ckpt, equil.threshold);
+    WriteBinary(ckpt, equil.q); WriteBinary(ckpt, equil.t); WriteBinary(ckpt, equil.done);
+    WriteBinary(ckpt, equil.equilibrated); WriteBinary(ckpt, equil.reference); WriteBinary(ckpt, equil.times);
+    WriteBinary(ckpt, equil.energies); WriteBinary(ckpt, equil.fs); WriteBinary(ckpt, equil.crossings);
+    WriteBinary(ckpt, equil.tau_alpha); WriteBinary(ckpt, equil.tau_energy);
+    WriteBinary(ckpt, state.tuner);
+    const energy_histogram& histogram = state.histogram;
+    WriteBinary(ckpt, histogram.width); WriteBinary(ckpt, histogram.T); WriteBinary(ckpt, histogram.pressure);
+    WriteBinary(ckpt, histogram.isobaric); WriteBinary(ckpt, histogram.particles);
+    WriteBinary(ckpt, histogram.keys); WriteBinary(ckpt, histogram.sums); WriteNames(ckpt, histogram.columns);
+
+    ckpt.close();
+    if (!ckpt){
+        throw std::runtime_error("Could not write checkpoint: " + tmp);
+    }
+    fs::rename(tmp, output);
+}
+
+// Reads the state of a run from a checkpoint file
+void ReadCheckpoint(configuration& cfg, run_state& state, std::string input){
+    std::ifstream ckpt(input, std::ios::binary);
+    if (!ckpt.is_open()){
+        throw std::runtime_error("Could not open file: " + input);
+    }
+    char magic[8];
+    ckpt.read(magic, sizeof(magic));
+    int version, precision, ckptN; double ckptSize;
+    ReadBinary(ckpt, version);
+    if (std::memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 || version != checkpoint_version){
+        throw std::runtime_error("Not a valid checkpoint: " + input);
+    }
+    ReadBinary(ckpt, precision);
+    if (precision != (int)sizeof(real)){
+        throw std::runtime_error("Checkpoint " + input + " was written with another precision");
+    }
+    ReadBinary(ckpt, ckptN); ReadBinary(ckpt, ckptSize);
+    if (ckptN != N){
+        throw std::runtime_error("Checkpoint " + input + " holds " + std::to_string(ckptN) +
+                                 " particles instead of " + std::to_string(N));
+    }
+    Size = ckptSize;
+
+    // Counters and random number generator
+    ReadBinary(ckpt, state.t);
+    ReadBinary(ckpt, state.dataCounter);
+    ReadBinary(ckpt, state.cycleCounter);
+    long long obsOffset;
+    ReadBinary(ckpt, obsOffset);
+    state.obsOffset = obsOffset;
+    long long obsBinaryOffset;
+    ReadBinary(ckpt, obsBinaryOffset);
+    state.obsBinaryOffset = obsBinaryOffset;
+    long long statsOffset;
+    ReadBinary(ckpt, statsOffset);
+    state.statsOffset = statsOffset;
+    ReadBinary(ckpt, generator);
+
+    // Configurations
+    ReadConfiguration(ckpt, cfg);
+    int references;
+    ReadBinary(ckpt, references);
+    state.cfgsCycles.assign(references, configuration());
+    for (configuration& ref: state.cfgsCycles) ReadConfiguration(ckpt, ref);
+
+    // Accumulators
+    structure_accumulator& structure = state.structure;
+    ReadBinary(ckpt, structure.rmax); ReadBinary(ckpt, structure.bins); 
+    ReadBinary(ckpt, structure.samples); ReadBinary(ckpt, structure.shells);
+    ReadBinary(ckpt, structure.vectors); ReadBinary(ckpt, structure.vector_shell);
+    ReadBinary(ckpt, structure.gr); ReadBinary(ckpt, structure.norm);
+    ReadBinary(ckpt, structure.sq); ReadBinary(ckpt, structure.qs); ReadBinary(ckpt, structure.modes);
+    ReadLagMap(ckpt, state.moments.sumQ); ReadLagMap(ckpt, state.moments.sumQ2); 
+    ReadLagMap(ckpt, state.moments.samples);
+    ReadLagMap(ckpt, state.averages.samples); ReadLagMap(ckpt, state.averages.mean);
+    ReadLagMap(ckpt, state.averages.m2);
+    multi_tau_correlator& correlator = state.correlator;
+    ReadBinary(ckpt, correlator.p); ReadBinary(ckpt, correlator.m); ReadBinary(ckpt, correlator.every);
+    ReadBinary(ckpt, correlator.max_lag); ReadBinary(ckpt, correlator.q); ReadBinary(ckpt, correlator.levels);
+    ReadBinary(ckpt, correlator.blocks);
+    ReadBinary(ckpt, correlator.head); ReadBinary(ckpt, correlator.filled); ReadBinary(ckpt, correlator.pushed);
+    ReadBinary(ckpt, correlator.msd); ReadBinary(ckpt, correlator.fs); ReadBinary(ckpt, correlator.samples);
+    ReadBinary(ckpt, state.stats); ReadBinary(ckpt, state.window);
+    ReadBinary(ckpt, state.order);
+    equilibration_monitor& equil = state.equilibration;
+    ReadBinary(ckpt, equil.every); ReadBinary(ckpt, equil.relaxations); ReadBinary(ckpt, equil.threshold);
+    ReadBinary(ckpt, equil.q); ReadBinary(ckpt, equil.t); ReadBinary(ckpt, equil.done);
+    ReadBinary(ckpt, equil.equilibrated); ReadBinary(ckpt, equil.reference); ReadBinary(ckpt, equil.times);
+    ReadBinary(ckpt, equil.energies); ReadBinary(ckpt, equil.fs); ReadBinary(ckpt, equil.crossings);
+    ReadBinary(ckpt, equil.tau_alpha); ReadBinary(ckpt, equil.tau_energy);
+    ReadBinary(ckpt, state.tuner);
+    energy_histogram& histogram = state.histogram;
+    ReadBinary(ckpt, histogram.width); ReadBinary(ckpt, histogram.T); ReadBinary(ckpt, histogram.pressure);
+    ReadBinary(ckpt, histogram.isobaric); ReadBinary(ckpt, histogram.particles);
+    ReadBinary(ckpt, histogram.keys); ReadBinary(ckpt, histogram.sums); ReadNames(ckpt, histogram.columns);
+}
@@ -0,0 +1,82 @@
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include "globals.hpp"
+#include "correlator.hpp"
+
+const double pi = 3.14159265358979323846;
+
+// Allocates the levels needed to reach max_lag
+multi_tau_correlator::multi_tau_correlator(int p, int m, int every, int max_lag, double q)
+    : p(p), m(m), every(every), max_lag(max_lag), q(q > 0 ? q : 2*pi/sigmaMax), levels(1) {
+    if (m < 2 || p < 2 || p%m != 0){
+        throw std::invalid_argument("Correlator blocks p must be a multiple of the decimation factor m >= 2");
+    }
+    long long longest = (long long)(p-1)*every;
+    while (longest < max_lag){
+        longest *= m; levels++;
+    }
+    blocks.assign((size_t)levels*p*3*N, 0.);
+    head.assign(levels, -1); filled.assign(levels, 0); pushed.assign(levels, 0);
+    msd.assign(levels*p, 0.); fs.assign(levels*p, 0.); samples.assign(levels*p, 0);
+}
+
+// Pushes the current center of mass corrected positions
+void multi_tau_correlator::Push(const configuration& cfg, const std::vector<int>& order){
+    std::vector<double> positions(3*N);
+    for (int i = 0; i < N; i++){
+        int k = order.empty() ? i : order[i]; // blocks are stored in the original order
+        positions[k] = cfg.Xfull[i] - cfg.XCM;
+        positions[N+k] = cfg.Yfull[i] - cfg.YCM;
+        positions[2*N+k] = cfg.Zfull[i] - cfg.ZCM;
+    }
+    PushLevel(0, positions.data());
+}
+
+// Pushes positions into one level and correlates them with the stored ones
+void multi_tau_correlator::PushLevel(int level, const double* positions){
+    head[level] = (head[level]+1)%p;
+    filled[level] = std::min(filled[level]+1, p);
+    double* newest = &blocks[((size_t)level*p + head[level])*3*N];
+    std::copy(positions, positions + 3*N, newest);
+
+    // Correlating with the stored blocks of this level
+    int first = (level == 0) ? 1 : p/m;
+    for (int j = first; j < filled[level]; j++){
+        const double* oldest = &blocks[((size_t)level*p + (head[level]-j+p)%p)*3*N];
+        double sum2 = 0, sumCos = 0;
+        for (int i = 0; i < N; i++){
+            double dx = newest[i] - oldest[i];
+            double dy = newest[N+i] - oldest[N+i];
+            double dz = newest[2*N+i] - oldest[2*N+i];
+            sum2 += dx*dx + dy*dy + dz*dz;
+            sumCos += cos(q*dx) + cos(q*dy) + cos(q*dz);
+        }
+        msd[level*p+j] += sum2/N; fs[level*p+j] += sumCos/(3*N); samples[level*p+j]++;
+    }
+
+    // Decimating into the next level
+    if (level+1 < levels && ++pushed[level] == m){
+        pushed[level] = 0;
+        PushLevel(level+1, newest);
+    }
+}
+
+// Writes the correlation functions
+void multi_tau_correlator::Write(std::string output) const{
+    std::ofstream log_corr(output);
+    log_corr << "lag MSD Fs_axes samples" << std::endl;
+    log_corr << std::scientific << std::setprecision(8);
+    long long stride = every;
+    for (int level = 0; level < levels; level++, stride *= m){
+        int first = (level == 0) ? 1 : p/m;
+        for (int j = first; j < p; j++){
+            long long count = samples[level*p+j];
+            if (count == 0 || j*stride > max_lag) continue;
+            log_corr << j*stride << " " << msd[level*p+j]/count << " " << fs[level*p+j]/count
+                     << " " << count << std::endl;
+        }
+    }
+}
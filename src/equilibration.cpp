@@ -0,0 +1,114 @@
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include "globals.hpp"
+#include "observables.hpp"
+#include "equilibration.hpp"
+
+const double pi = 3.14159265358979323846;
+
+// Mean of a range of a time series
+double RangeMean(const std::vector<double>& series, size_t begin, size_t end){
+    double sum = 0;
+    for (size_t k = begin; k < end; k++) sum += series[k];
+    return sum/(end-begin);
+}
+
+// Variance of a range of a time series
+double RangeVariance(const std::vector<double>& series, size_t begin, size_t end){
+    double mean = RangeMean(series, begin, end), sum = 0;
+    for (size_t k = begin; k < end; k++) sum += (series[k]-mean)*(series[k]-mean);
+    return sum/(end-begin);
+}
+
+// Integrated autocorrelation time with Sokal's automatic windowing
+double IntegratedAutocorrelationTime(const std::vector<double>& series, size_t begin, size_t end){
+    size_t n = end - begin;
+    double mean = RangeMean(series, begin, end), var = RangeVariance(series, begin, end);
+    double tau = 0.5;
+    if (n < 2 || var <= 0) return tau;
+    for (size_t w = 1; w < n; w++){
+        double c = 0;
+        for (size_t k = begin; k + w < end; k++) c += (series[k]-mean)*(series[k+w]-mean);
+        tau += c/((n-w)*var);
+        if (w >= 5*tau) break;
+    }
+    return std::max(tau, 0.5);
+}
+
+// Starts a monitor at sweep 0
+equilibration_monitor::equilibration_monitor(int every, int relaxations, double threshold)
+    : every(every), relaxations(relaxations), threshold(threshold), q(2*pi/sigmaMax), t(1),
+      done(false), equilibrated(false), tau_alpha(0), tau_energy(0) {
+    if (every < 1 || relaxations < 1 || threshold <= 0 || threshold >= 1){
+        throw std::invalid_argument("Equilibration requires every >= 1, relaxations >= 1 and 0 < threshold < 1");
+    }
+}
+
+// Samples the energy and Fs, and checks whether the configuration is equilibrated
+bool equilibration_monitor::Sample(const configuration& cfg, int sweep, const std::vector<int>& order){
+    std::vector<double> positions(3*N);
+    for (int i = 0; i < N; i++){
+        int k = order.empty() ? i : order[i]; // positions are stored in the original order
+        positions[k] = cfg.Xfull[i] - cfg.XCM;
+        positions[N+k] = cfg.Yfull[i] - cfg.YCM;
+        positions[2*N+k] = cfg.Zfull[i] - cfg.ZCM;
+    }
+    double value = 1;
+    if (reference.empty()){
+        reference.swap(positions); crossings.push_back(sweep);
+    } else {
+        double sumCos = 0;
+        for (int k = 0; k < 3*N; k++) sumCos += cos(q*(positions[k] - reference[k]));
+        value = sumCos/(3*N);
+    }
+    times.push_back(sweep); energies.push_back(VTotal(cfg)/(2*N)); fs.push_back(value);
+    if (value >= threshold) return false;
+
+    // One more relaxation has passed
+    reference.swap(positions); crossings.push_back(sweep);
+    int c = crossings.size();
+    if (c <= relaxations) return false;
+    int start = crossings[c-1-relaxations];
+    size_t begin = 0, end = times.size();
+    while (times[begin] < start) begin++;
+    size_t n = end - begin;
+    tau_alpha = double(sweep - start)/relaxations;
+    double tau = IntegratedAutocorrelationTime(energies, begin, end);
+    tau_energy = tau*every;
+    if (n < 8 || sweep - start < relaxations*tau_energy) return false;
+
+    // Comparing the mean energies of both halves of the window
+    size_t middle = begin + n/2;
+    double se2 = 2*tau*(RangeVariance(energies, begin, middle)/(middle-begin) +
+                        RangeVariance(energies, middle, end)/(end-middle));
+    double drift = std::abs(RangeMean(energies, begin, middle) - RangeMean(energies, middle, end));
+    equilibrated = drift <= 2*sqrt(se2);
+    return equilibrated;
+}
+
+// Writes the sampled time series
+void equilibration_monitor::WriteSeries(std::string output) const{
+    std::ofstream log_equil(output);
+    log_equil << "t U Fs" << std::endl;
+    log_equil << std::scientific << std::setprecision(8);
+    for (size_t k = 0; k < times.size(); k++){
+        log_equil << times[k] << " " << energies[k] << " " << fs[k] << std::endl;
+    }
+}
+
+// Writes the measured relaxation times in JSON format
+void equilibration_monitor::WriteSummary(std::string output) const{
+    std::ofstream summary(output);
+    summary << std::setprecision(8);
+    summary << "{" << std::endl
+            << "    \"equilibrated\": " << (equilibrated ? "true" : "false") << "," << std::endl
+            << "    \"sweeps\": " << t-1 << "," << std::endl
+            << "    \"relaxations\": " << (crossings.empty() ? 0 : crossings.size()-1) << "," << std::endl
+            << "    \"tau_alpha\": " << tau_alpha << "," << std::endl
+            << "    \"tau_energy\": " << tau_energy << "," << std::endl
+            << "    \"energy\": " << (energies.empty() ? 0 : energies.back()) << std::endl
+            << "}" << std::endl;
+}
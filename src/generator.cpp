@@ -0,0 +1,202 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "globals.hpp"
+#include "generator.hpp"
+
+const double two_pi = 6.28318530717958647692;
+
+// Draws an integer between 0 and n-1
+int RandomIndex(int n){
+    return std::min(int(ranf()*n), n-1);
+}
+
+// Brings a difference of coordinates smaller than a box side between -Size/2 and Size/2
+inline double Wrap(double d){
+    return d > Size/2 ? d - Size : (d < -Size/2 ? d + Size : d);
+}
+
+// Loops over the particles which may be closer than the side of the cells to a point
+template <typename F>
+void ForNearby(const cell_list& cells, int placed, double x, double y, double z, F&& visit){
+    if (cells.nc < 3){
+        // Box too small for cells
+        for (int k = 0; k < placed; k++) visit(k);
+        return;
+    }
+    int cx = std::min(int(x/cells.lc), cells.nc-1);
+    int cy = std::min(int(y/cells.lc), cells.nc-1);
+    int cz = std::min(int(z/cells.lc), cells.nc-1);
+    for (int dx=-1; dx<=1; dx++){
+        for (int dy=-1; dy<=1; dy++){
+            for (int dz=-1; dz<=1; dz++){
+                for (int k = cells.head[cells.Index(cx+dx, cy+dy, cz+dz)]; k != -1; k = cells.next[k]) visit(k);
+            }
+        }
+    }
+}
+
+// Builds a configuration of trimers on a grid and relaxes its overlaps
+configuration GenerateTrimers(double bond_length, int orientations, double min_ratio, int max_iterations){
+    if (N % 3 != 0 || N < 3){
+        throw std::invalid_argument("Generating trimers requires a positive multiple of 3 particles");
+    }
+    if (bond_length <= 0 || orientations < 1 || min_ratio <= 0 || min_ratio >= 1 || max_iterations < 0){
+        throw std::invalid_argument("Generating trimers requires bond_length > 0, orientations >= 1, "
+                                    "0 < min_ratio < 1 and max_iterations >= 0");
+    }
+    int molecules = N/3;
+    basic_configuration<double> cfg;
+    cfg.X.assign(N, 0); cfg.Y.assign(N, 0); cfg.Z.assign(N, 0);
+
+    // Random subset of the sites of a cubic grid, in the grid's order
+    int nm = std::max(1, int(cbrt(double(molecules))));
+    while (nm*nm*nm < molecules) nm++;
+    std::vector<int> sites(nm*nm*nm);
+    for (int s = 0; s < (int)sites.size(); s++) sites[s] = s;
+    for (int m = 0; m < molecules; m++) std::swap(sites[m], sites[m + RandomIndex(sites.size() - m)]);
+    std::sort(sites.begin(), sites.begin() + molecules);
+    double a = Size/nm, radius = bond_length/sqrt(3.);
+
+    // Placing molecules one by one, particles already placed being binned into cells
+    cell_list cells;
+    cells.nc = std::max(1, int(Size/sigmaMax)); cells.lc = Size/cells.nc;
+    cells.head.assign(cells.nc*cells.nc*cells.nc, -1); cells.next.assign(N, -1); cells.cell.assign(N, 0);
+    for (int m = 0; m < molecules; m++){
+        double cx = (sites[m]/(nm*nm) + 0.5)*a, cy = (sites[m]/nm%nm + 0.5)*a, cz = (sites[m]%nm + 0.5)*a;
+        int types[3] = {1, 2, 3};
+        for (int r = 0; r < 2; r++) std::swap(types[r], types[r + RandomIndex(3 - r)]);
+        double best = -1, best_x[3], best_y[3], best_z[3];
+        for (int o = 0; o < orientations; o++){
+            // Normal of the triangle uniform on the sphere, then a random angle in its plane
+            double uz = 2*ranf() - 1, phi = two_pi*ranf(), ur = sqrt(1 - uz*uz);
+            double ux = ur*cos(phi), uy = ur*sin(phi);
+            double ex = std::abs(ux) < 0.9 ? 1 : 0, ey = 1 - ex;
+            double vx = uy*0 - uz*ey, vy = uz*ex - ux*0, vz = ux*ey - uy*ex;
+            double vn = sqrt(vx*vx + vy*vy + vz*vz); vx /= vn; vy /= vn; vz /= vn;
+            double wx = uy*vz - uz*vy, wy = uz*vx - ux*vz, wz = ux*vy - uy*vx;
+            double psi = two_pi*ranf(), x[3], y[3], z[3], closest = 1e300;
+            for (int r = 0; r < 3; r++){
+                double c = cos(psi + r*two_pi/3), s = sin(psi + r*two_pi/3);
+                x[r] = cx + radius*(c*vx + s*wx); y[r] = cy + radius*(c*vy + s*wy); z[r] = cz + radius*(c*vz + s*wz);
+                double sr = diameters[types[r]-1];
+                double xr = ShiftInMainBox(x[r]), yr = ShiftInMainBox(y[r]), zr = ShiftInMainBox(z[r]);
+                ForNearby(cells, 3*m, xr, yr, zr, [&](int k){
+                    double xij = MinimumImageDistance(xr, cfg.X[k]);
+                    double yij = MinimumImageDistance(yr, cfg.Y[k]);
+                    double zij = MinimumImageDistance(zr, cfg.Z[k]);
+                    double sigma = (sr + diameters[cfg.S[k]-1])/2;
+                    closest = std::min(closest, sqrt(xij*xij + yij*yij + zij*zij)/sigma);
+                });
+            }
+            if (closest > best){
+                best = closest;
+                std::copy(x, x+3, best_x); std::copy(y, y+3, best_y); std::copy(z, z+3, best_z);
+            }
+        }
+        for (int r = 0; r < 3; r++){
+            int i = 3*m + r;
+            cfg.Xfull[i] = best_x[r]; cfg.Yfull[i] = best_y[r]; cfg.Zfull[i] = best_z[r]; cfg.S[i] = types[r];
+            cfg.X[i] = ShiftInMainBox(best_x[r]); cfg.Y[i] = ShiftInMainBox(best_y[r]); cfg.Z[i] = ShiftInMainBox(best_z[r]);
+            int c = cells.Index(std::min(int(cfg.X[i]/cells.lc), cells.nc-1),
+                                std::min(int(cfg.Y[i]/cells.lc), cells.nc-1),
+                                std::min(int(cfg.Z[i]/cells.lc), cells.nc-1));
+            cells.cell[i] = c; cells.next[i] = cells.head[c]; cells.head[c] = i;
+        }
+    }
+
+    // Minimization of harmonic repulsions and bonds (FIRE), over pairs listed up to sigmaMax + skin
+    const double max_move = 0.1, skin = 0.5, dt_max = 0.5;
+    double dt = 0.1, alpha = 0.1;
+    int downhill = 0;
+    std::vector<double> fx(N), fy(N), fz(N), vx(N), vy(N), vz(N), x0, y0, z0;
+    std::vector<std::pair<int, int>> pairs;
+    for (int iteration = 0; iteration <= max_iterations; iteration++){
+        // Listing pairs again once a particle moved by half the skin
+        double moved = 0;
+        for (int i = 0; i < (int)x0.size(); i++){
+            double dx = cfg.Xfull[i] - x0[i], dy = cfg.Yfull[i] - y0[i], dz = cfg.Zfull[i] - z0[i];
+            moved = std::max(moved, dx*dx + dy*dy + dz*dz);
+        }
+        if (x0.empty() || moved > skin*skin/4){
+            double range2 = (sigmaMax + skin)*(sigmaMax + skin);
+            cells.Build(cfg, sigmaMax + skin);
+            pairs.clear();
+            for (int i = 0; i < N; i++){
+                ForNearby(cells, N, cfg.X[i], cfg.Y[i], cfg.Z[i], [&](int k){
+                    if (k <= i || k/3 == i/3) return; // each pair once, molecules excluded
+                    double xij = MinimumImageDistance(cfg.X[i], cfg.X[k]);
+                    double yij = MinimumImageDistance(cfg.Y[i], cfg.Y[k]);
+                    double zij = MinimumImageDistance(cfg.Z[i], cfg.Z[k]);
+                    if (xij*xij + yij*yij + zij*zij < range2) pairs.push_back(std::make_pair(i, k));
+                });
+            }
+            x0 = cfg.Xfull; y0 = cfg.Yfull; z0 = cfg.Zfull;
+        }
+
+        std::fill(fx.begin(), fx.end(), 0); std::fill(fy.begin(), fy.end(), 0); std::fill(fz.begin(), fz.end(), 0);
+        double closest2 = 1e300;
+        for (const std::pair<int, int>& p: pairs){
+            int i = p.first, k = p.second;
+            double dx = cfg.X[i] - cfg.X[k], dy = cfg.Y[i] - cfg.Y[k], dz = cfg.Z[i] - cfg.Z[k];
+            dx = Wrap(dx); dy = Wrap(dy); dz = Wrap(dz);
+            double sigma = (diameters[cfg.S[i]-1] + diameters[cfg.S[k]-1])/2;
+            double r2 = dx*dx + dy*dy + dz*dz;
+            if (r2 >= sigma*sigma) continue;
+            closest2 = std::min(closest2, r2/(sigma*sigma));
+            double r = sqrt(r2), f = r > 0 ? (sigma - r)/r : 0;
+            fx[i] += f*dx; fy[i] += f*dy; fz[i] += f*dz;
+            fx[k] -= f*dx; fy[k] -= f*dy; fz[k] -= f*dz;
+        }
+        if (closest2 >= min_ratio*min_ratio) break;
+        if (iteration == max_iterations){
+            throw std::runtime_error("Overlaps not relaxed after " + std::to_string(max_iterations) +
+                                     " iterations: closest pair at " + std::to_string(sqrt(closest2)) +
+                                     " times its mean diameter, below " + std::to_string(min_ratio));
+        }
+        for (int m = 0; m < molecules; m++){
+            for (int i = 3*m; i < 3*m+2; i++){
+                for (int k = i+1; k < 3*m+3; k++){
+                    double dx = cfg.Xfull[i] - cfg.Xfull[k], dy = cfg.Yfull[i] - cfg.Yfull[k], dz = cfg.Zfull[i] - cfg.Zfull[k];
+                    double r = sqrt(dx*dx + dy*dy + dz*dz), f = (bond_length - r)/r;
+                    fx[i] += f*dx; fy[i] += f*dy; fz[i] += f*dz;
+                    fx[k] -= f*dx; fy[k] -= f*dy; fz[k] -= f*dz;
+                }
+            }
+        }
+        // FIRE: velocities mixed towards the forces, reset when going uphill
+        double power = 0, vnorm = 0, fnorm = 0;
+        for (int i = 0; i < N; i++){
+            power += fx[i]*vx[i] + fy[i]*vy[i] + fz[i]*vz[i];
+            vnorm += vx[i]*vx[i] + vy[i]*vy[i] + vz[i]*vz[i];
+            fnorm += fx[i]*fx[i] + fy[i]*fy[i] + fz[i]*fz[i];
+        }
+        if (power > 0){
+            double mix = fnorm > 0 ? alpha*sqrt(vnorm/fnorm) : 0;
+            for (int i = 0; i < N; i++){
+                vx[i] = (1-alpha)*vx[i] + mix*fx[i]; vy[i] = (1-alpha)*vy[i] + mix*fy[i]; vz[i] = (1-alpha)*vz[i] + mix*fz[i];
+            }
+            if (++downhill > 5) {dt = std::min(1.1*dt, dt_max); alpha *= 0.99;}
+        } else {
+            std::fill(vx.begin(), vx.end(), 0); std::fill(vy.begin(), vy.end(), 0); std::fill(vz.begin(), vz.end(), 0);
+            dt *= 0.5; alpha = 0.1; downhill = 0;
+        }
+        for (int i = 0; i < N; i++){
+            vx[i] += dt*fx[i]; vy[i] += dt*fy[i]; vz[i] += dt*fz[i];
+            double dx = dt*vx[i], dy = dt*vy[i], dz = dt*vz[i];
+            double d = sqrt(dx*dx + dy*dy + dz*dz);
+            if (d > max_move) {dx *= max_move/d; dy *= max_move/d; dz *= max_move/d;}
+            cfg.Xfull[i] += dx; cfg.Yfull[i] += dy; cfg.Zfull[i] += dz;
+            cfg.X[i] = Wrap(cfg.X[i] + dx - Size/2) + Size/2; cfg.Y[i] = Wrap(cfg.Y[i] + dy - Size/2) + Size/2;
+            cfg.Z[i] = Wrap(cfg.Z[i] + dz - Size/2) + Size/2;
+        }
+    }
+
+    // Starting configuration, molecules being whole in unwrapped positions
+    for (int i = 0; i < N; i++){
+        cfg.X[i] = ShiftInMainBox(cfg.Xfull[i]); cfg.Y[i] = ShiftInMainBox(cfg.Yfull[i]);
+        cfg.Z[i] = ShiftInMainBox(cfg.Zfull[i]);
+    }
+    cfg.X0 = cfg.X; cfg.Y0 = cfg.Y; cfg.Z0 = cfg.Z;
+    return configuration(cfg);
+}
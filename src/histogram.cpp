@@ -0,0 +1,231 @@
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include "globals.hpp"
+#include "histogram.hpp"
+
+// Empty histogram
+energy_histogram::energy_histogram(double width, double T, double pressure, bool isobaric, const std::vector<std::string>& columns)
+    : width(width), T(T), pressure(pressure), isobaric(isobaric), particles(N), columns(columns) {
+    if (width <= 0){
+        throw std::invalid_argument("The width of the energy bins must be positive");
+    }
+    if (T <= 0){
+        throw std::invalid_argument("Energy histograms require a positive temperature");
+    }
+}
+
+// Adds one sample to its bin, creating the bin if needed
+void energy_histogram::Sample(double U, double volume, const std::vector<double>& values){
+    if (values.size() != columns.size()){
+        throw std::invalid_argument("Sample of " + std::to_string(values.size()) + " values for " +
+                                    std::to_string(columns.size()) + " columns");
+    }
+    const int stride = Stride();
+    double e = isobaric ? U + pressure*volume/particles : U, rho = particles/volume;
+    long long key = floor(e/width);
+    std::vector<long long>::iterator it = std::lower_bound(keys.begin(), keys.end(), key);
+    std::size_t b = it - keys.begin();
+    if (it == keys.end() || *it != key){
+        keys.insert(it, key);
+        sums.insert(sums.begin() + b*stride, stride, 0.);
+    }
+    double* bin = &sums[b*stride];
+    bin[0] += 1; bin[1] += e; bin[2] += e*e; bin[3] += rho;
+    for (std::size_t k = 0; k < columns.size(); k++){
+        // Kinetic part of the pressure, added back at the reweighted temperature
+        bin[4+k] += columns[k] == "P" ? values[k] - rho*T : values[k];
+    }
+}
+
+// Number of samples
+long long energy_histogram::Samples() const{
+    long long samples = 0;
+    for (std::size_t b = 0; b < keys.size(); b++) samples += llround(sums[b*Stride()]);
+    return samples;
+}
+
+// Writes the means inside each bin
+void energy_histogram::Write(std::string output) const{
+    const int stride = Stride();
+    std::string tmp = output + ".tmp";
+    {
+        std::ofstream table(tmp);
+        if (!table.is_open()){
+            throw std::runtime_error("Could not open file: " + tmp);
+        }
+        table << std::setprecision(16);
+        table << "# T " << T << " N " << particles << " width " << width << " pressure " << pressure
+              << " isobaric " << isobaric << std::endl;
+        table << "bin e e2 rho count";
+        for (const std::string& name: columns) table << " " << name;
+        table << std::endl << std::scientific;
+        for (std::size_t b = 0; b < keys.size(); b++){
+            const double* bin = &sums[b*stride];
+            table << keys[b] << " " << bin[1]/bin[0] << " " << bin[2]/bin[0] << " " << bin[3]/bin[0] << " "
+                  << llround(bin[0]);
+            for (std::size_t k = 0; k < columns.size(); k++) table << " " << bin[4+k]/bin[0];
+            table << std::endl;
+        }
+    }
+    boost::filesystem::rename(tmp, output);
+}
+
+// Reads a histogram file back into sums
+energy_histogram ReadHistogram(std::string input){
+    std::ifstream table(input);
+    if (!table.is_open()){
+        throw std::runtime_error("Could not open file: " + input);
+    }
+    energy_histogram histogram;
+    std::string line, word;
+    std::getline(table, line);
+    std::istringstream parameters(line);
+    std::string hash, t, n, w, p, i;
+    parameters >> hash >> t >> histogram.T >> n >> histogram.particles >> w >> histogram.width
+               >> p >> histogram.pressure >> i >> histogram.isobaric;
+    if (!parameters || hash != "#" || t != "T" || n != "N" || w != "width" || p != "pressure" || i != "isobaric"){
+        throw std::runtime_error("Not an energy histogram file: " + input);
+    }
+    std::getline(table, line);
+    std::istringstream names(line);
+    std::vector<std::string> fixed;
+    for (int k = 0; k < 5 && names >> word; k++) fixed.push_back(word);
+    if (fixed != std::vector<std::string>{"bin", "e", "e2", "rho", "count"}){
+        throw std::runtime_error("Not an energy histogram file: " + input);
+    }
+    while (names >> word) histogram.columns.push_back(word);
+
+    const int stride = histogram.Stride();
+    while (std::getline(table, line)){
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        std::istringstream row(line);
+        long long key, count;
+        double e, e2, rho;
+        row >> key >> e >> e2 >> rho >> count;
+        std::vector<double> bin = {double(count), count*e, count*e2, count*rho};
+        for (int k = 4; k < stride; k++){
+            double mean;
+            row >> mean;
+            bin.push_back(count*mean);
+        }
+        if (!row || count <= 0 || (!histogram.keys.empty() && key <= histogram.keys.back())){
+            throw std::runtime_error("Invalid row of energy histogram file " + input + ": " + line);
+        }
+        histogram.keys.push_back(key);
+        histogram.sums.insert(histogram.sums.end(), bin.begin(), bin.end());
+    }
+    return histogram;
+}
+
+// Logarithm of a sum of exponentials
+double LogSumExp(const std::vector<double>& x){
+    double top = *std::max_element(x.begin(), x.end());
+    if (std::isinf(top)) return top;
+    double sum = 0;
+    for (double v: x) sum += exp(v - top);
+    return top + log(sum);
+}
+
+// Multiple histogram reweighting
+std::vector<reweighted_averages> Reweight(const std::vector<energy_histogram>& runs, const std::vector<double>& temperatures,
+                                          double tolerance, int max_iterations){
+    if (runs.empty()){
+        throw std::invalid_argument("Reweighting requires at least one histogram");
+    }
+    const energy_histogram& first = runs[0];
+    for (const energy_histogram& run: runs){
+        if (run.Samples() == 0){
+            throw std::invalid_argument("Cannot reweight an empty histogram");
+        }
+        if (run.particles != first.particles || run.width != first.width || run.isobaric != first.isobaric ||
+            (run.isobaric && run.pressure != first.pressure) || run.columns != first.columns){
+            throw std::invalid_argument("Histograms differ in N, bin width, ensemble or observables");
+        }
+    }
+    for (double T: temperatures){
+        if (T <= 0) throw std::invalid_argument("Temperatures must be positive");
+    }
+
+    // Bins of all runs merged
+    const int stride = first.Stride(), R = runs.size(), columns = first.columns.size();
+    std::vector<long long> keys;
+    for (const energy_histogram& run: runs) keys.insert(keys.end(), run.keys.begin(), run.keys.end());
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    const int B = keys.size();
+    std::vector<double> total(B*stride, 0.);
+    std::vector<double> n(R, 0.), beta(R);
+    for (int r = 0; r < R; r++){
+        const energy_histogram& run = runs[r];
+        beta[r] = 1/run.T;
+        for (std::size_t b = 0; b < run.keys.size(); b++){
+            int u = std::lower_bound(keys.begin(), keys.end(), run.keys[b]) - keys.begin();
+            for (int k = 0; k < stride; k++) total[u*stride+k] += run.sums[b*stride+k];
+            n[r] += run.sums[b*stride];
+        }
+    }
+    // Total energy and means inside each bin
+    std::vector<double> counts(B), energies(B);
+    for (int b = 0; b < B; b++){
+        counts[b] = total[b*stride];
+        energies[b] = first.particles*total[b*stride+1]/counts[b];
+    }
+
+    // Free energies of the runs and density of states
+    std::vector<double> f(R, 0.), logOmega(B), runTerms(R), binTerms(B);
+    bool converged = false;
+    for (int iteration = 0; iteration < max_iterations && !converged; iteration++){
+        for (int b = 0; b < B; b++){
+            for (int r = 0; r < R; r++) runTerms[r] = log(n[r]) + f[r] - beta[r]*energies[b];
+            logOmega[b] = log(counts[b]) - LogSumExp(runTerms);
+        }
+        std::vector<double> next(R);
+        for (int r = 0; r < R; r++){
+            for (int b = 0; b < B; b++) binTerms[b] = logOmega[b] - beta[r]*energies[b];
+            next[r] = -LogSumExp(binTerms);
+        }
+        // Free energies are defined up to a constant, fixed by the first run
+        double change = 0;
+        for (int r = 0; r < R; r++){
+            change = std::max(change, std::abs(next[r] - next[0] - f[r]));
+        }
+        for (int r = R-1; r >= 0; r--) next[r] -= next[0];
+        f.swap(next);
+        converged = change < tolerance;
+    }
+    if (!converged){
+        throw std::runtime_error("Multiple histogram iterations did not converge");
+    }
+
+    // Averages at each temperature
+    std::vector<reweighted_averages> results;
+    std::vector<double> logWeights(B);
+    for (double T: temperatures){
+        for (int b = 0; b < B; b++) logWeights[b] = logOmega[b] - energies[b]/T;
+        double norm = LogSumExp(logWeights);
+        reweighted_averages averages;
+        averages.T = T;
+        double e = 0, e2 = 0, rho = 0, squares = 0;
+        averages.values.assign(columns, 0.);
+        for (int b = 0; b < B; b++){
+            double w = exp(logWeights[b] - norm);
+            const double* bin = &total[b*stride];
+            e += w*bin[1]/counts[b]; e2 += w*bin[2]/counts[b]; rho += w*bin[3]/counts[b];
+            for (int k = 0; k < columns; k++) averages.values[k] += w*bin[4+k]/counts[b];
+            squares += w*w/counts[b];
+        }
+        for (int k = 0; k < columns; k++){
+            if (first.columns[k] == "P") averages.values[k] += rho*T;
+        }
+        averages.energy = e;
+        averages.heat_capacity = first.particles*(e2 - e*e)/(T*T);
+        averages.effective_samples = 1/squares;
+        results.push_back(averages);
+    }
+    return results;
+}
@@ -0,0 +1,181 @@
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#include "globals.hpp"
+#include "live.hpp"
+
+// Segment format
+const char live_magic[8] = {'T', 'F', 'M', 'C', 'L', 'I', 'V', 'E'};
+const int live_version = 3;
+
+// Header of the segment
+struct live_header {
+    char magic[8];
+    int version;
+    int particles;
+    int slots;
+    std::atomic<long long> latest; // last complete frame (-1 before the first)
+};
+
+// Header of one slot, followed by the unwrapped positions (X, Y, Z) and the types
+struct live_slot {
+    std::atomic<unsigned long long> sequence; // odd while the slot is being written
+    live_frame frame;
+};
+
+// Bytes of one slot, rounded to cache lines so that slots never share one
+std::size_t SlotBytes(int particles){
+    std::size_t bytes = sizeof(live_slot) + particles*(3*sizeof(double) + sizeof(int));
+    return (bytes + 63)/64*64;
+}
+
+// Bytes of the header, rounded likewise
+std::size_t HeaderBytes(){
+    return (sizeof(live_header) + 63)/64*64;
+}
+
+// Name of the segment of a run
+std::string LiveName(const std::string& rootdir){
+    std::string path = boost::filesystem::absolute(rootdir).string(), name = "/tfmc";
+    for (char c: path){
+        name += (c == '/') ? '_' : c;
+    }
+    while (name.size() > 1 && name.back() == '_') name.pop_back();
+    return name.substr(0, 250);
+}
+
+// Creates the segment
+live_export::live_export(const std::string& name, int slots) : name(name), base(nullptr), published(0) {
+    if (slots < 1){
+        throw std::invalid_argument("A live export requires at least one slot");
+    }
+    bytes = HeaderBytes() + slots*SlotBytes(N);
+    // Segment left by a killed run, whose readers keep their own mapping
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0){
+        throw std::runtime_error("Could not create shared memory " + name + ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd, bytes) != 0){
+        close(fd); shm_unlink(name.c_str());
+        throw std::runtime_error("Could not size shared memory " + name + ": " + std::strerror(errno));
+    }
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED){
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Could not map shared memory " + name + ": " + std::strerror(errno));
+    }
+    base = static_cast<char*>(mapped);
+
+    live_header* header = new (base) live_header;
+    header->version = live_version; header->particles = N; header->slots = slots;
+    header->latest.store(-1, std::memory_order_relaxed);
+    for (int k = 0; k < slots; k++){
+        live_slot* slot = new (base + HeaderBytes() + k*SlotBytes(N)) live_slot;
+        slot->sequence.store(0, std::memory_order_relaxed);
+    }
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, live_magic, sizeof(live_magic));
+}
+
+// Removes the segment
+live_export::~live_export(){
+    munmap(base, bytes);
+    shm_unlink(name.c_str());
+}
+
+// Publishes a frame with a sequence lock
+void live_export::Publish(const configuration& cfg, live_frame frame, const std::vector<int>& order){
+    live_header* header = reinterpret_cast<live_header*>(base);
+    char* start = base + HeaderBytes() + (published % header->slots)*SlotBytes(N);
+    live_slot* slot = reinterpret_cast<live_slot*>(start);
+    double* X = reinterpret_cast<double*>(start + sizeof(live_slot));
+    double* Y = X + N;
+    double* Z = Y + N;
+    int* S = reinterpret_cast<int*>(Z + N);
+
+    unsigned long long sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    frame.frame = published;
+    slot->frame = frame;
+    for (int i = 0; i < N; i++){
+        int k = order.empty() ? i : order[i];
+        X[k] = cfg.Xfull[i]; Y[k] = cfg.Yfull[i]; Z[k] = cfg.Zfull[i]; S[k] = cfg.S[i];
+    }
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    header->latest.store(published, std::memory_order_release);
+    published++;
+}
+
+// Maps an existing segment
+live_reader::live_reader(const std::string& name) : base(nullptr), bytes(0), particles(0) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0){
+        throw std::runtime_error("No live export " + name + ": " + std::strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)HeaderBytes()){
+        close(fd);
+        throw std::runtime_error("Live export " + name + " is not ready");
+    }
+    bytes = info.st_size;
+    void* mapped = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED){
+        throw std::runtime_error("Could not map shared memory " + name + ": " + std::strerror(errno));
+    }
+    base = static_cast<const char*>(mapped);
+
+    const live_header* header = reinterpret_cast<const live_header*>(base);
+    bool valid = std::memcmp(header->magic, live_magic, sizeof(live_magic)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || header->version != live_version || header->slots < 1 ||
+        bytes < HeaderBytes() + header->slots*SlotBytes(header->particles)){
+        munmap(const_cast<char*>(base), bytes);
+        throw std::runtime_error("Not a valid live export (or not ready yet): " + name);
+    }
+    particles = header->particles;
+}
+
+// Unmaps the segment
+live_reader::~live_reader(){
+    munmap(const_cast<char*>(base), bytes);
+}
+
+// Copies the latest frame, retrying when the writer raced with the copy
+bool live_reader::Read(live_frame& frame, std::vector<int>& S, std::vector<double>& X, std::vector<double>& Y,
+                       std::vector<double>& Z) const{
+    const live_header* header = reinterpret_cast<const live_header*>(base);
+    S.resize(particles); X.resize(particles); Y.resize(particles); Z.resize(particles);
+    for (int attempt = 0; attempt < 1000; attempt++){
+        long long latest = header->latest.load(std::memory_order_acquire);
+        if (latest < 0) return false;
+        const char* start = base + HeaderBytes() + (latest % header->slots)*SlotBytes(particles);
+        const live_slot* slot = reinterpret_cast<const live_slot*>(start);
+        const double* x = reinterpret_cast<const double*>(start + sizeof(live_slot));
+        const double* y = x + particles;
+        const double* z = y + particles;
+        const int* s = reinterpret_cast<const int*>(z + particles);
+
+        unsigned long long before = slot->sequence.load(std::memory_order_acquire);
+        if (before % 2 == 1) continue;
+        frame = slot->frame;
+        std::memcpy(X.data(), x, particles*sizeof(double));
+        std::memcpy(Y.data(), y, particles*sizeof(double));
+        std::memcpy(Z.data(), z, particles*sizeof(double));
+        std::memcpy(S.data(), s, particles*sizeof(int));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) == before) return true;
+    }
+    return false;
+}
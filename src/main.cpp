@@ -3,14 +3,18 @@
 #include <string>
 #include <iostream>
 #include <ctime>
+#include <stdexcept>
 #include "globals.hpp"
 #include "particles.hpp"
 #include "utils.hpp"
 #include "simulation.hpp"
+#include "observables.hpp"
+#include "manifest.hpp"
+#include "generator.hpp"
 
 // Default run parameters
-int N = 5;
-double Size = pow(N/density, 1/3.);
+__thread int N = 5;
+__thread double Size = 0;
 double T = 2.0; 
 int tau = 100000;
 int tw = 1;
@@ -28,20 +32,46 @@ int main(int argc, const char * argv[]) {
     std::string params_path;
     std::string rootdir;
     std::vector <std::string> observables;
+    run_options opts;
     bool norun;
     
     // Parse command line arguments
-    if (!ParseCMDLine(argc, argv, input, params_path, observables)){
+    if (!ParseCMDLine(argc, argv, input, params_path, observables, opts)){
         return 1;
     };
 
+    // Running the jobs of a manifest, each with its own parameters
+    if (!opts.manifest.empty()){
+        std::vector <manifest_job> jobs;
+        try {
+            jobs = ReadManifest(opts.manifest, observables, opts);
+        } catch (const std::exception& ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+        int failed = RunManifest(jobs, opts.jobs, opts, opts.manifest + ".status.json");
+        std::cout << jobs.size() - failed << " jobs done, " << failed << " failed" << std::endl;
+        return failed > 0 ? 1 : 0;
+    }
+
     // Loading params from json file
     if (!ReadJSONParams(params_path, rootdir, N, T, tau, tw, cycles, logPoints, linPoints, p_flip)){
         return 1;
     }
+    if (!ReadJSONOptions(params_path, opts)){
+        return 1;
+    }
+
+    // Validating observables
+    try {
+        observables_set obs_set(observables, opts.overlap_a, T);
+    } catch (const std::invalid_argument& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
 
     // Random number seed
-    srand(time(NULL));
+    generator.Seed(time(NULL));
 
     // Recalculating size
     Size = pow(N/density, 1./3.);
@@ -52,21 +82,32 @@ int main(int argc, const char * argv[]) {
     // Copy the file to the target directory
     
     // Setting run mode
-    (input == "") ? norun = true : norun = false;
+    (input == "" && !opts.restart && !opts.generate) ? norun = true : norun = false;
 
     double t0 = time(NULL); // Timer
 
     if (norun){
         // Compute observables
-        ComputeObservables(tau, cycles, tw, observables, rootdir, logPoints);
+        ComputeObservables(T, tau, cycles, tw, observables, rootdir, logPoints, true, opts);
     } else{
-        // Read init config
-        configuration initconf;
-        initconf = ReadTrimCFG(input);
         // Make outdir and copy json file
         MakeOutDir(rootdir, params_path);
+        // Read or generate init config (the checkpoint holds it when restarting)
+        configuration initconf;
+        if (opts.generate && !opts.restart) {
+            try {
+                initconf = GenerateTrimers();
+            } catch (const std::exception& ex) {
+                std::cerr << "Error: " << ex.what() << std::endl;
+                return 1;
+            }
+            WriteTrimCFG(initconf, rootdir + "init.xyz");
+            std::cout << "Initial configuration generated in " << time(NULL) - t0 << " seconds" << std::endl;
+        } else if (!opts.restart) {
+            initconf = ReadTrimCFG(input);
+        }
         // Do simulation
-        MonteCarloRun(initconf, T, tau, cycles, tw, p_flip, observables, rootdir, logPoints, linPoints, true); 
+        MonteCarloRun(initconf, T, tau, cycles, tw, p_flip, observables, rootdir, logPoints, linPoints, true, opts); 
     }
     
     double time_elapsed = time(NULL) - t0;
@@ -0,0 +1,213 @@
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <boost/json.hpp>
+#include <boost/filesystem.hpp>
+#include "globals.hpp"
+#include "utils.hpp"
+#include "manifest.hpp"
+#include "generator.hpp"
+
+namespace fs = boost::filesystem;
+namespace json = boost::json;
+
+// Escapes a string for JSON output
+std::string JSONString(const std::string& text){
+    std::string escaped = "\"";
+    for (char c: text){
+        if (c == '"' || c == '\\') {escaped += '\\'; escaped += c;}
+        else if (c == '\n') escaped += "\\n";
+        else if ((unsigned char)c < 0x20) escaped += ' ';
+        else escaped += c;
+    }
+    return escaped + "\"";
+}
+
+// Read the jobs of a manifest
+std::vector<manifest_job> ReadManifest(const std::string& manifest_path,
+                                       const std::vector<std::string>& observables, const run_options& opts){
+    std::ifstream manifest_file(manifest_path);
+    if (!manifest_file.is_open()){
+        throw std::runtime_error("Could not open file: " + manifest_path);
+    }
+    std::stringstream buffer;
+    buffer << manifest_file.rdbuf();
+    json::value parsed_json = json::parse(buffer.str());
+
+    std::vector<manifest_job> jobs;
+    std::set<std::string> rootdirs;
+    unsigned int seed = time(NULL);
+    const json::value* list = parsed_json.as_object().if_contains("jobs");
+    if (!list){
+        throw std::runtime_error("No jobs in manifest: " + manifest_path);
+    }
+    for (const json::value& entry: list->as_array()){
+        const json::object& obj = entry.as_object();
+        manifest_job job;
+        const json::value* params = obj.if_contains("params");
+        if (!params){
+            throw std::runtime_error("Job " + std::to_string(jobs.size()) + " of " + manifest_path + " has no params");
+        }
+        job.params = params->as_string().c_str();
+        if (auto v = obj.if_contains("init")) job.init = v->as_string().c_str();
+        job.observables = observables;
+        if (auto v = obj.if_contains("observables")){
+            job.observables.clear();
+            for (const json::value& name: v->as_array()) job.observables.push_back(name.as_string().c_str());
+        }
+        job.seed = seed + jobs.size();
+        if (auto v = obj.if_contains("seed")) job.seed = v->to_number<unsigned int>();
+        job.restart = opts.restart;
+        if (auto v = obj.if_contains("restart")) job.restart = v->as_bool();
+        job.generate = opts.generate;
+        if (auto v = obj.if_contains("generate")) job.generate = v->as_bool();
+        if (job.generate && !job.init.empty()){
+            throw std::runtime_error("Job " + std::to_string(jobs.size()) + " of " + manifest_path + 
+                                     " has both an init and generate");
+        }
+
+        // Output directory, which must be distinct for each job
+        if (auto v = obj.if_contains("rootdir")){
+            job.rootdir = v->as_string().c_str();
+        } else {
+            int n, tau, tw, cycles, logPoints, linPoints;
+            double T, p_flip;
+            if (!ReadJSONParams(job.params, job.rootdir, n, T, tau, tw, cycles, logPoints, linPoints, p_flip)){
+                throw std::runtime_error("Could not read parameters: " + job.params);
+            }
+        }
+        if (job.rootdir.empty() || job.rootdir.back() != '/') job.rootdir += "/";
+        if (!rootdirs.insert(job.rootdir).second){
+            throw std::runtime_error("Several jobs of " + manifest_path + " write into " + job.rootdir);
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// Runs one job on the calling thread
+void RunJob(const manifest_job& job, const run_options& cmd_opts){
+    std::string rootdir;
+    double T, p_flip;
+    int tau, tw, cycles, logPoints, linPoints;
+    run_options opts = cmd_opts;
+    if (!ReadJSONParams(job.params, rootdir, N, T, tau, tw, cycles, logPoints, linPoints, p_flip) ||
+        !ReadJSONOptions(job.params, opts)){
+        throw std::runtime_error("Could not read parameters: " + job.params);
+    }
+    opts.restart = job.restart;
+    opts.generate = job.generate;
+    rootdir = job.rootdir;
+    std::vector<std::string> observables = job.observables;
+
+    // Globals of this thread
+    generator.Seed(job.seed);
+    Size = pow(N/density, 1./3.);
+
+    if (job.init.empty() && !opts.restart && !opts.generate){
+        ComputeObservables(T, tau, cycles, tw, observables, rootdir, logPoints, false, opts);
+    } else {
+        MakeOutDir(rootdir, job.params);
+        configuration initconf;
+        if (opts.generate && !opts.restart){
+            initconf = GenerateTrimers();
+            WriteTrimCFG(initconf, rootdir + "init.xyz");
+        } else if (!opts.restart) {
+            initconf = ReadTrimCFG(job.init);
+        }
+        MonteCarloRun(initconf, T, tau, cycles, tw, p_flip, observables, rootdir, logPoints, linPoints, false, opts);
+    }
+}
+
+// Status of a job
+struct job_status {
+    std::string state;   // pending, running, done or failed
+    double seconds;      // wall-clock time of the job
+    std::string error;   // message of the failure
+};
+
+// Writes the status of all jobs, replacing the previous file atomically
+void WriteStatus(const std::vector<manifest_job>& jobs, const std::vector<job_status>& status, std::string output){
+    int counts[4] = {0, 0, 0, 0};
+    const char* states[4] = {"pending", "running", "done", "failed"};
+    for (const job_status& s: status){
+        for (int k = 0; k < 4; k++) counts[k] += (s.state == states[k]);
+    }
+    std::string tmp = output + ".tmp";
+    {
+        std::ofstream summary(tmp);
+        summary << std::setprecision(8);
+        summary << "{" << std::endl << "    \"jobs\": " << jobs.size() << "," << std::endl;
+        for (int k = 0; k < 4; k++) summary << "    \"" << states[k] << "\": " << counts[k] << "," << std::endl;
+        summary << "    \"status\": [" << std::endl;
+        for (size_t j = 0; j < jobs.size(); j++){
+            summary << "        {\"job\": " << j << ", \"params\": " << JSONString(jobs[j].params)
+                    << ", \"init\": " << JSONString(jobs[j].init) << ", \"rootdir\": " << JSONString(jobs[j].rootdir)
+                    << ", \"seed\": " << jobs[j].seed << ", \"state\": \"" << status[j].state
+                    << "\", \"seconds\": " << status[j].seconds << ", \"error\": " << JSONString(status[j].error)
+                    << "}" << (j+1 < jobs.size() ? "," : "") << std::endl;
+        }
+        summary << "    ]" << std::endl << "}" << std::endl;
+    }
+    fs::rename(tmp, output);
+}
+
+// Runs the jobs on a pool of threads
+int RunManifest(const std::vector<manifest_job>& jobs, int concurrency, const run_options& opts,
+                const std::string& status_path){
+    int workers = concurrency > 0 ? concurrency : std::thread::hardware_concurrency();
+    workers = std::max(1, std::min(workers, (int)jobs.size()));
+    run_options job_opts = opts;
+    if (job_opts.threads == 0) job_opts.threads = 1; // the pool already uses the cores
+
+    std::vector<job_status> status(jobs.size(), job_status{"pending", 0, ""});
+    std::mutex mtx;
+    std::atomic<int> next(0);
+    int failed = 0;
+    WriteStatus(jobs, status, status_path);
+
+    auto work = [&](){
+        for (int j = next++; j < (int)jobs.size(); j = next++){
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                status[j].state = "running";
+                WriteStatus(jobs, status, status_path);
+            }
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::string error;
+            try {
+                RunJob(jobs[j], job_opts);
+            } catch (const std::exception& ex) {
+                error = ex.what();
+            } catch (...) {
+                error = "unknown error";
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mtx);
+            status[j].state = error.empty() ? "done" : "failed";
+            status[j].seconds = seconds; status[j].error = error;
+            failed += !error.empty();
+            WriteStatus(jobs, status, status_path);
+            if (error.empty()){
+                std::cout << "Job " << j << " done in " << seconds << " seconds (" << jobs[j].rootdir << ")" << std::endl;
+            } else {
+                std::cerr << "Job " << j << " failed: " << error << std::endl;
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int k = 0; k < workers; k++) pool.emplace_back(work);
+    for (std::thread& worker: pool) worker.join();
+    return failed;
+}
@@ -0,0 +1,134 @@
+#include <cstring>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include "npy.hpp"
+
+namespace fs = boost::filesystem;
+
+// Byte order mark of the fields, the records being written in the order of the machine
+char ByteOrder(){
+    const uint16_t probe = 1;
+    char first;
+    std::memcpy(&first, &probe, 1);
+    return first ? '<' : '>';
+}
+
+// Builds the header of the structured array
+std::string npy_table::Header() const{
+    const char order = ByteOrder();
+    std::ostringstream dict;
+    dict << "{'descr': [('t', '" << order << "i8'), ('cycle', '" << order << "i8')";
+    for (const std::string& column: columns){
+        dict << ", ('" << column << "', '" << order << "f8')";
+    }
+    dict << "], 'fortran_order': False, 'shape': (" << std::setw(20) << rows << ",), }";
+    std::string text = dict.str();
+
+    // Format 1.0 stores the length of the dictionary on 2 bytes, 2.0 on 4 bytes
+    int version = text.size() + 74 < 65536 ? 1 : 2;
+    std::size_t prefix = version == 1 ? 10 : 12;
+    std::size_t total = (prefix + text.size() + 1 + 63)/64*64;
+    text.append(total - prefix - text.size() - 1, ' ');
+    text += '\n';
+    std::string header = "\x93NUMPY";
+    header += char(version); header += char(0);
+    uint32_t length = text.size();
+    for (std::size_t k = 0; k < prefix - 8; k++) header += char((length >> (8*k)) & 0xff);
+    return header + text;
+}
+
+// Flushes the buffered rows when closing
+npy_table::~npy_table(){
+    try {
+        Close();
+    } catch (...) {
+        // The rows of the last batch are lost
+    }
+}
+
+// Creates the file with an empty array
+void npy_table::Create(std::string output, const std::vector<std::string>& columns, int batch){
+    this->columns = columns; this->batch = batch;
+    rows = 0; buffer.clear();
+    record_bytes = 8*(2 + columns.size());
+    file.open(output, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()){
+        throw std::runtime_error("Could not open file: " + output);
+    }
+    std::string header = Header();
+    header_bytes = header.size();
+    file.write(header.data(), header.size());
+    file.flush();
+}
+
+// Reopens the file, keeping the rows written before the checkpoint
+void npy_table::Reopen(std::string output, const std::vector<std::string>& columns, std::streamoff offset, int batch){
+    this->columns = columns; this->batch = batch;
+    rows = 0; buffer.clear();
+    record_bytes = 8*(2 + columns.size());
+    std::string expected = Header();
+    header_bytes = expected.size();
+    if (!fs::exists(output) || (std::streamoff)fs::file_size(output) < offset || offset < (std::streamoff)header_bytes ||
+        (offset - header_bytes) % record_bytes != 0){
+        throw std::runtime_error("Binary observables file does not match the checkpoint: " + output);
+    }
+    // Same fields, whatever the number of rows
+    std::vector<char> found(header_bytes);
+    std::ifstream input(output, std::ios::binary);
+    input.read(found.data(), header_bytes);
+    std::size_t fields = expected.find("'shape'");
+    if (!input || std::memcmp(found.data(), expected.data(), fields) != 0){
+        throw std::runtime_error("Binary observables file holds other columns: " + output);
+    }
+    input.close();
+
+    fs::resize_file(output, offset);
+    rows = (offset - header_bytes)/record_bytes;
+    file.open(output, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open()){
+        throw std::runtime_error("Could not open file: " + output);
+    }
+    Flush();
+}
+
+// Appends one row to the buffer
+void npy_table::Write(int t, int cycle, const std::vector<double>& values){
+    if (values.size() != columns.size()){
+        throw std::invalid_argument("Row of " + std::to_string(values.size()) + " values for " +
+                                    std::to_string(columns.size()) + " columns");
+    }
+    int64_t integers[2] = {t, cycle};
+    std::size_t start = buffer.size();
+    buffer.resize(start + record_bytes);
+    std::memcpy(&buffer[start], integers, sizeof(integers));
+    std::memcpy(&buffer[start + sizeof(integers)], values.data(), values.size()*sizeof(double));
+    if ((long long)(buffer.size()/record_bytes) >= batch) Flush();
+}
+
+// Writes the buffered rows, then the number of rows
+std::streamoff npy_table::Flush(){
+    if (!buffer.empty()){
+        file.seekp(0, std::ios::end);
+        file.write(buffer.data(), buffer.size());
+        rows += buffer.size()/record_bytes;
+        buffer.clear();
+    }
+    std::string header = Header();
+    file.seekp(0);
+    file.write(header.data(), header.size());
+    file.flush();
+    if (!file){
+        throw std::runtime_error("Could not write binary observables file");
+    }
+    return header_bytes + rows*record_bytes;
+}
+
+// Flushes and closes the file
+void npy_table::Close(){
+    if (!file.is_open()) return;
+    Flush();
+    file.close();
+}
@@ -1,4 +1,10 @@
 #include <cmath> // For math operations
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <boost/filesystem.hpp>
 #include "globals.hpp"
 #include "observables.hpp"
 
@@ -6,15 +12,16 @@
 const double pi = 3.14159265358979323846;
 
 //  Calculates the pairwise WCA potential between two particles
-double WCAPair(double x1, double y1, double z1, double s1, double x2, double y2, double z2, double s2){
+template <typename Real>
+double WCAPair(Real x1, Real y1, Real z1, double s1, Real x2, Real y2, Real z2, double s2){
     // int idx1 = s1-1, idx2 = s2-1;
     // double sigmaij = (diameters[idx1]+diameters[idx2])/2;
     double sigmaij = (s1+s2)/2;
     double sigma2 = sigmaij*sigmaij;
     double rc2 = pow(2., 1./3.) * sigma2;
-    double xij = MinimumImageDistance(x1, x2); 
-    double yij = MinimumImageDistance(y1, y2); 
-    double zij = MinimumImageDistance(z1, z2);
+    Real xij = MinimumImageDistance(x1, x2); 
+    Real yij = MinimumImageDistance(y1, y2); 
+    Real zij = MinimumImageDistance(z1, z2);
     double rij2 = (xij*xij) + (yij*yij) + (zij*zij);
     if (rij2 > rc2) return 0;
     else {
@@ -24,16 +31,17 @@ double WCAPair(double x1, double y1, double z1, double s1, double x2, double y2,
 }
 
 //  Calculates the pairwise FENE potential between two particles
-double FENEPair(double x1, double y1, double z1, double s1, double x2, double y2, double z2, double s2){
+template <typename Real>
+double FENEPair(Real x1, Real y1, Real z1, double s1, Real x2, Real y2, Real z2, double s2){
     // int idx1 = s1-1, idx2 = s2-1;
     // double sigmaij = (diameters[idx1]+diameters[idx2])/2;
     double sigmaij = (s1+s2)/2;
     double sigma2 = sigmaij*sigmaij;
     double kij = 30/sigma2;
     double R02 = 1.5*1.5*sigma2;
-    double xij = MinimumImageDistance(x1, x2); 
-    double yij = MinimumImageDistance(y1, y2); 
-    double zij = MinimumImageDistance(z1, z2);
+    Real xij = MinimumImageDistance(x1, x2); 
+    Real yij = MinimumImageDistance(y1, y2); 
+    Real zij = MinimumImageDistance(z1, z2);
     double rij2 = (xij*xij) + (yij*yij) + (zij*zij);
     if (rij2 > R02) return 0;
     else {
@@ -42,28 +50,132 @@ double FENEPair(double x1, double y1, double z1, double s1, double x2, double y2
 }
 
 //  Calculates potential associated to particle j
-double V(const configuration& cfg, int j){
+template <typename Real>
+double V(const basic_configuration<Real>& cfg, int j){
     double total = 0, sj, sk;
     for (int k: cfg.neighbours_list[j]){
         sj = diameters[int(cfg.S[j]-1)]; sk = diameters[int(cfg.S[k]-1)];
         total += WCAPair(cfg.X[j], cfg.Y[j], cfg.Z[j], sj, 
                          cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
     }
-    for (int k: cfg.bonded_neighbours[j]){
+    for (int b = cfg.bond_start[j]; b < cfg.bond_start[j+1]; b++){
+        int k = cfg.bond_partner[b];
         sj = diameters[int(cfg.S[j]-1)]; sk = diameters[int(cfg.S[k]-1)];
         total += FENEPair(cfg.X[j], cfg.Y[j], cfg.Z[j], sj, 
                           cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
     } return total;
 }
 
+//  Calculates the potential of particle j at its position and at a trial position in one pass
+template <typename Real>
+void VDisp(const basic_configuration<Real>& cfg, int j, Real x, Real y, Real z, double& V_old, double& V_new){
+    double sj = diameters[int(cfg.S[j]-1)], sk;
+    Real xj = cfg.X[j], yj = cfg.Y[j], zj = cfg.Z[j];
+    V_old = 0; V_new = 0;
+    for (int k: cfg.neighbours_list[j]){
+        sk = diameters[int(cfg.S[k]-1)];
+        V_old += WCAPair(xj, yj, zj, sj, cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
+        V_new += WCAPair(x, y, z, sj, cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
+    }
+    for (int b = cfg.bond_start[j]; b < cfg.bond_start[j+1]; b++){
+        int k = cfg.bond_partner[b];
+        sk = diameters[int(cfg.S[k]-1)];
+        V_old += FENEPair(xj, yj, zj, sj, cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
+        V_new += FENEPair(x, y, z, sj, cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
+    }
+}
+
+//  Calculates the potential of particle j with other molecules for each of the three diameters in one pass
+template <typename Real>
+void VTypes(const basic_configuration<Real>& cfg, int j, double U[3]){
+    static const double wca_cut = pow(2., 1./3.);
+    Real xj = cfg.X[j], yj = cfg.Y[j], zj = cfg.Z[j];
+    int molecule = cfg.molecule[j];
+    U[0] = 0; U[1] = 0; U[2] = 0;
+    for (int k: cfg.neighbours_list[j]){
+        if (cfg.molecule[k] == molecule) continue;
+        double sk = diameters[int(cfg.S[k]-1)];
+        Real xij = MinimumImageDistance(xj, cfg.X[k]);
+        Real yij = MinimumImageDistance(yj, cfg.Y[k]);
+        Real zij = MinimumImageDistance(zj, cfg.Z[k]);
+        double rij2 = (xij*xij) + (yij*yij) + (zij*zij);
+        // Beyond the cutoff of the largest diameter
+        double widest = (sigmaMax + sk)/2;
+        if (rij2 > wca_cut*widest*widest) continue;
+        for (int d = 0; d < 3; d++){
+            double sigmaij = (diameters[d] + sk)/2, sigma2 = sigmaij*sigmaij;
+            if (rij2 > wca_cut*sigma2) continue;
+            double a2 = sigma2/rij2, a6 = a2*a2*a2;
+            U[d] += 4*(a6*a6-a6+0.25);
+        }
+    }
+}
+
 //  Calculates total system energy (double)
-double VTotal(const configuration& cfg){
+template <typename Real>
+double VTotal(const basic_configuration<Real>& cfg){
     double vTot = 0;
     for (int j = 0; j < N; j++)
         vTot += V(cfg, j);
     return vTot;
 }
 
+//  Calculates the total energy, the virial and the energy of the scaled configuration in one pass
+template <typename Real>
+void VTotalScaled(const basic_configuration<Real>& cfg, double scale, double& U, double& U_scaled, double& W){
+    const double scale2 = scale*scale, wca_cut = pow(2., 1./3.);
+    U = 0; U_scaled = 0; W = 0;
+    for (int j = 0; j < N; j++){
+        double sj = diameters[int(cfg.S[j]-1)];
+        for (int k: cfg.neighbours_list[j]){
+            if (k < j) continue; // each pair once
+            double sigmaij = (sj + diameters[int(cfg.S[k]-1)])/2, sigma2 = sigmaij*sigmaij;
+            Real xij = MinimumImageDistance(cfg.X[j], cfg.X[k]);
+            Real yij = MinimumImageDistance(cfg.Y[j], cfg.Y[k]);
+            Real zij = MinimumImageDistance(cfg.Z[j], cfg.Z[k]);
+            double rij2 = (xij*xij) + (yij*yij) + (zij*zij);
+            if (rij2 <= wca_cut*sigma2){
+                double a2 = sigma2/rij2, a6 = a2*a2*a2;
+                U += 4*(a6*a6-a6+0.25); W += 24*(2*a6*a6-a6);
+            }
+            if (scale2*rij2 <= wca_cut*sigma2){
+                double a2 = sigma2/(scale2*rij2), a6 = a2*a2*a2;
+                U_scaled += 4*(a6*a6-a6+0.25);
+            }
+        }
+        for (int b = cfg.bond_start[j]; b < cfg.bond_start[j+1]; b++){
+            int k = cfg.bond_partner[b];
+            if (k < j) continue;
+            double sigmaij = (sj + diameters[int(cfg.S[k]-1)])/2, sigma2 = sigmaij*sigmaij;
+            double kij = 30/sigma2, R02 = 1.5*1.5*sigma2;
+            Real xij = MinimumImageDistance(cfg.X[j], cfg.X[k]);
+            Real yij = MinimumImageDistance(cfg.Y[j], cfg.Y[k]);
+            Real zij = MinimumImageDistance(cfg.Z[j], cfg.Z[k]);
+            double rij2 = (xij*xij) + (yij*yij) + (zij*zij);
+            if (rij2 <= R02){
+                U += -0.5*kij*R02*log(1-rij2/R02); W -= kij*rij2/(1-rij2/R02);
+            }
+            U_scaled += (scale2*rij2 < R02) ? -0.5*kij*R02*log(1-scale2*rij2/R02) : HUGE_VAL;
+        }
+    }
+}
+
+// Double and single precision instantiations
+template double WCAPair(double x1, double y1, double z1, double s1, double x2, double y2, double z2, double s2);
+template double WCAPair(float x1, float y1, float z1, double s1, float x2, float y2, float z2, double s2);
+template double FENEPair(double x1, double y1, double z1, double s1, double x2, double y2, double z2, double s2);
+template double FENEPair(float x1, float y1, float z1, double s1, float x2, float y2, float z2, double s2);
+template double V(const basic_configuration<double>& cfg, int j);
+template double V(const basic_configuration<float>& cfg, int j);
+template void VDisp(const basic_configuration<double>& cfg, int j, double x, double y, double z, double& V_old, double& V_new);
+template void VDisp(const basic_configuration<float>& cfg, int j, float x, float y, float z, double& V_old, double& V_new);
+template void VTypes(const basic_configuration<double>& cfg, int j, double U[3]);
+template void VTypes(const basic_configuration<float>& cfg, int j, double U[3]);
+template double VTotal(const basic_configuration<double>& cfg);
+template double VTotal(const basic_configuration<float>& cfg);
+template void VTotalScaled(const basic_configuration<double>& cfg, double scale, double& U, double& U_scaled, double& W);
+template void VTotalScaled(const basic_configuration<float>& cfg, double scale, double& U, double& U_scaled, double& W);
+
 //  Calculates avg. mean square displacements
 double MSD(const configuration& cfg, const configuration& cfg0){
     double sum = 0, deltaX, deltaY, deltaZ;
@@ -95,4 +207,189 @@ double FS(const configuration& cfg, const configuration& cfg0){
         }
     }
     return sum/(ang*N);
-}
\ No newline at end of file
+}
+
+//  Calculates the overlap function
+double Overlap(const configuration& cfg, const configuration& cfg0, double a){
+    int overlapping = 0;
+    double deltaX, deltaY, deltaZ;
+    for (int i = 0; i < N; i++){
+        deltaX = cfg.Xfull[i]-cfg0.Xfull[i]; deltaX -= (cfg.XCM-cfg0.XCM);
+        deltaY = cfg.Yfull[i]-cfg0.Yfull[i]; deltaY -= (cfg.YCM-cfg0.YCM);
+        deltaZ = cfg.Zfull[i]-cfg0.Zfull[i]; deltaZ -= (cfg.ZCM-cfg0.ZCM);
+        overlapping += (deltaX*deltaX + deltaY*deltaY + deltaZ*deltaZ < a*a);
+    }
+    return double(overlapping)/N;
+}
+
+//  Adds the overlap of one cycle and returns the four-point susceptibility
+double overlap_moments::Add(int lag, double Q){
+    sumQ[lag] += Q; sumQ2[lag] += Q*Q; samples[lag]++;
+    double meanQ = sumQ[lag]/samples[lag], meanQ2 = sumQ2[lag]/samples[lag];
+    return N*(meanQ2 - meanQ*meanQ);
+}
+
+// Adds the observables of one cycle (Welford's update)
+void cycle_averages::Add(int lag, const std::vector<double>& values){
+    std::vector<double>& mu = mean[lag];
+    std::vector<double>& dev = m2[lag];
+    mu.resize(values.size(), 0.); dev.resize(values.size(), 0.);
+    long long n = ++samples[lag];
+    for (size_t k = 0; k < values.size(); k++){
+        double delta = values[k] - mu[k];
+        mu[k] += delta/n;
+        dev[k] += delta*(values[k] - mu[k]);
+    }
+}
+
+// Writes the averaged table
+void cycle_averages::Write(std::string output, const std::vector<std::string>& names) const{
+    std::string tmp = output + ".tmp";
+    {
+        std::ofstream table(tmp);
+        table << "lag samples";
+        for (const std::string& name: names){
+            table << " " << name << " " << name << "_var " << name << "_err";
+            if (name == "Q") table << " chi4";
+        }
+        table << std::endl << std::scientific << std::setprecision(8);
+        for (const std::pair<const int, long long>& entry: samples){
+            int lag = entry.first;
+            long long n = entry.second;
+            const std::vector<double>& mu = mean.at(lag);
+            const std::vector<double>& dev = m2.at(lag);
+            table << lag << " " << n;
+            for (size_t k = 0; k < names.size() && k < mu.size(); k++){
+                double var = n > 1 ? dev[k]/(n-1) : 0.;
+                table << " " << mu[k] << " " << var << " " << sqrt(var/n);
+                if (names[k] == "Q") table << " " << N*dev[k]/n;
+            }
+            table << std::endl;
+        }
+    }
+    boost::filesystem::rename(tmp, output);
+}
+
+
+// Looks up the requested observables in the registry
+observables_set::observables_set(const std::vector<std::string>& names, double a, double T)
+    : a(a), T(T), energy(false), displacements(false) {
+    for (const std::string& name: names){
+        entry e = {name, ENERGY, 0};
+        if (name == "U") e.type = ENERGY;
+        else if (name == "MSD") e.type = MSD_ALL;
+        else if (name == "MSD_A" || name == "MSD_B" || name == "MSD_C"){
+            e.type = MSD_TYPE; e.param = name[4] - 'A' + 1;
+        }
+        else if (name == "MSD_CM") e.type = MSD_MOLECULE;
+        else if (name == "alpha2") e.type = ALPHA2;
+        else if (name == "Fs") {e.type = SELF_SCATTERING; e.param = 2*pi/sigmaMax;}
+        else if (name.compare(0, 3, "Fs:") == 0){
+            char* end;
+            e.type = SELF_SCATTERING; e.param = strtod(name.c_str()+3, &end);
+            if (*end != '\0' || end == name.c_str()+3 || e.param <= 0){
+                throw std::invalid_argument("Invalid wave-vector in observable " + name);
+            }
+        }
+        else if (name == "Q") e.type = OVERLAP;
+        else if (name == "P") e.type = PRESSURE;
+        else if (name == "rho") e.type = DENSITY;
+        else throw std::invalid_argument("Unknown observable " + name + 
+                    " (known: U MSD MSD_A MSD_B MSD_C MSD_CM alpha2 Fs Fs:q Q P rho)");
+
+        if (e.type == ENERGY || e.type == PRESSURE) energy = true;
+        else if (e.type != DENSITY) displacements = true;
+        if (e.type == SELF_SCATTERING && std::count(qs.begin(), qs.end(), e.param) == 0) qs.push_back(e.param);
+        entries.push_back(e);
+    }
+}
+
+// Names of the output columns
+std::vector<std::string> observables_set::Columns() const{
+    std::vector<std::string> columns;
+    for (const entry& e: entries){
+        columns.push_back(e.name);
+        if (e.type == OVERLAP) columns.push_back("chi4");
+    }
+    return columns;
+}
+
+// Computes all observables, displacement-based ones in one fused sweep
+std::vector<double> observables_set::Compute(const configuration& cfg, const configuration& cfg0) const{
+    double sum2 = 0, sum4 = 0, sumCM = 0;
+    double sumType[3] = {0, 0, 0}; int countType[3] = {0, 0, 0};
+    int overlapping = 0;
+    std::vector<double> fs(qs.size(), 0.);
+
+    if (displacements){
+        std::vector<double> dX(N), dY(N), dZ(N);
+        double a2 = a*a;
+        double mX = 0, mY = 0, mZ = 0;
+        int m = 0;
+        for (int i = 0; i < N; i++){
+            dX[i] = cfg.Xfull[i]-cfg0.Xfull[i]; dX[i] -= (cfg.XCM-cfg0.XCM);
+            dY[i] = cfg.Yfull[i]-cfg0.Yfull[i]; dY[i] -= (cfg.YCM-cfg0.YCM);
+            dZ[i] = cfg.Zfull[i]-cfg0.Zfull[i]; dZ[i] -= (cfg.ZCM-cfg0.ZCM);
+            double dr2 = dX[i]*dX[i] + dY[i]*dY[i] + dZ[i]*dZ[i];
+            sum2 += dr2; sum4 += dr2*dr2;
+            sumType[cfg0.S[i]-1] += dr2; countType[cfg0.S[i]-1]++;
+            overlapping += (dr2 < a2);
+            // Molecules are stored contiguously
+            mX += dX[i]; mY += dY[i]; mZ += dZ[i];
+            if (i+1 == cfg0.mol_start[m+1]){
+                int size = cfg0.mol_start[m+1] - cfg0.mol_start[m];
+                mX /= size; mY /= size; mZ /= size;
+                sumCM += mX*mX + mY*mY + mZ*mZ;
+                mX = 0; mY = 0; mZ = 0; m++;
+            }
+        }
+
+        // Self-scattering functions, averaged over directions of the XY plane
+        if (!qs.empty()){
+            int ang = 360;
+            for (int theta=0; theta<ang; theta++){
+                double cosTheta = cos(theta*pi/180), sinTheta = sin(theta*pi/180);
+                for (int i = 0; i < N; i++){
+                    double projection = (cosTheta*dX[i])+(sinTheta*dY[i]);
+                    for (size_t k = 0; k < qs.size(); k++) fs[k] += cos(qs[k]*projection);
+                }
+            }
+            for (double& value: fs) value /= (ang*N);
+        }
+    }
+
+    std::vector<double> values;
+    values.reserve(entries.size());
+    for (const entry& e: entries){
+        switch (e.type){
+            case ENERGY: values.push_back(VTotal(cfg)/(2*N)); break;
+            case MSD_ALL: values.push_back(sum2/N); break;
+            case MSD_TYPE: {
+                int t = int(e.param)-1;
+                values.push_back(countType[t] > 0 ? sumType[t]/countType[t] : 0.); break;
+            }
+            case MSD_MOLECULE: values.push_back(sumCM/cfg0.Molecules()); break;
+            case ALPHA2: values.push_back(sum2 > 0 ? 3*(sum4/N)/(5*(sum2/N)*(sum2/N)) - 1 : 0.); break;
+            case SELF_SCATTERING: 
+                values.push_back(fs[std::find(qs.begin(), qs.end(), e.param) - qs.begin()]); break;
+            case OVERLAP: values.push_back(double(overlapping)/N); break;
+            case PRESSURE: {
+                double U, U_scaled, W;
+                VTotalScaled(cfg, 1., U, U_scaled, W);
+                values.push_back((N*T + W/3)/(Size*Size*Size)); break;
+            }
+            case DENSITY: values.push_back(N/(Size*Size*Size)); break;
+        }
+    }
+    return values;
+}
+
+// Inserts the four-point susceptibility after each overlap value
+void observables_set::AddSusceptibilities(int lag, std::vector<double>& values, overlap_moments& moments) const{
+    for (size_t k = 0, column = 0; k < entries.size(); k++, column++){
+        if (entries[k].type == OVERLAP){
+            double chi4 = moments.Add(lag, values[column]);
+            values.insert(values.begin() + (++column), chi4);
+        }
+    }
+}
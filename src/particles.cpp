@@ -1,16 +1,17 @@
 #include <cmath>
 #include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <unordered_set>
 #include "globals.hpp"
 #include "particles.hpp"
 
 // Neighbours lists parameters
 const double r_cutoff = pow(2., 1./6.) * sigmaMax; // Cutoff radius for calculating potential
-const double r_skin = 0.7; // Margin added to the neighbours list radius
-const double neighbours_radius_squared = pow(r_cutoff+r_skin,2); // NL radius squared
-const double maximum_displacement_before_update_squared = pow(r_skin,2)/4; // When R2Max exceeds this, update NL
 
 // Method to calculate center of mass coordinates
-void configuration::UpdateCM_coord(){
+template <typename Real>
+void basic_configuration<Real>::UpdateCM_coord(){
     XCM = 0; YCM = 0; ZCM = 0;
     // std::vector <double>* coordinates;
     // (coord_index == 0) ? coordinates = &Xfull : 
@@ -23,56 +24,267 @@ void configuration::UpdateCM_coord(){
 }
 
 // Method to calculate the verlet lists associated to each particle
-void configuration::UpdateNL(){
-    neighbours_list.clear(); neighbours_list = std::vector < std::vector <int> > (N);
-    for (int j=0; j<N-1; j++){
-        for (int i=j+1; i<N; i++){
-            double xij = MinimumImageDistance(X[i], X[j]); 
-            double yij = MinimumImageDistance(Y[i], Y[j]); 
-            double zij = MinimumImageDistance(Z[i], Z[j]);
-            double rij2 = (xij*xij)+(yij*yij)+(zij*zij);
-            if (rij2 < neighbours_radius_squared && i != j){
-                neighbours_list[j].push_back(i);
-                neighbours_list[i].push_back(j);
+template <typename Real>
+void basic_configuration<Real>::UpdateNL(){
+    neighbours_list.resize(N);
+    for (std::vector <int>& neighbours: neighbours_list) neighbours.clear();
+    const double neighbours_radius_squared = pow(r_cutoff+skin,2); // NL radius squared
+    nl_size = Size;
+
+    cell_list cells;
+    cells.Build(*this, sqrt(neighbours_radius_squared));
+    if (cells.nc < 3){
+        // Box too small for cells, looping over all pairs
+        for (int j=0; j<N-1; j++){
+            for (int i=j+1; i<N; i++){
+                Real xij = MinimumImageDistance(X[i], X[j]); 
+                Real yij = MinimumImageDistance(Y[i], Y[j]); 
+                Real zij = MinimumImageDistance(Z[i], Z[j]);
+                Real rij2 = (xij*xij)+(yij*yij)+(zij*zij);
+                if (rij2 < neighbours_radius_squared && i != j){
+                    neighbours_list[j].push_back(i);
+                    neighbours_list[i].push_back(j);
+                }
             }
         }
+        return;
+    }
+
+    for (int j=0; j<N; j++){
+        int c = cells.cell[j];
+        int cx = c/(cells.nc*cells.nc), cy = (c/cells.nc)%cells.nc, cz = c%cells.nc;
+        for (int dx=-1; dx<=1; dx++){
+            for (int dy=-1; dy<=1; dy++){
+                for (int dz=-1; dz<=1; dz++){
+                    for (int i = cells.head[cells.Index(cx+dx, cy+dy, cz+dz)]; i != -1; i = cells.next[i]){
+                        Real xij = MinimumImageDistance(X[i], X[j]); 
+                        Real yij = MinimumImageDistance(Y[i], Y[j]); 
+                        Real zij = MinimumImageDistance(Z[i], Z[j]);
+                        Real rij2 = (xij*xij)+(yij*yij)+(zij*zij);
+                        if (rij2 < neighbours_radius_squared && i != j){
+                            neighbours_list[j].push_back(i);
+                        }
+                    }
+                }
+            }
+        }
+        // Same ordering as the all-pairs loop (energies are summed in this order)
+        std::sort(neighbours_list[j].begin(), neighbours_list[j].end());
     }
 }
 
-// Retrieves bonded particles for all particles (done only once)
-// ATM it is implicit that configurations are written in the trimers index order
-void configuration::GetBonds(){
-    bonded_neighbours.clear(); bonded_neighbours = std::vector < std::vector<int> > (N);
-    for (int i=0; i<N; i+=3){
-        bonded_neighbours[i].push_back(i+1); bonded_neighbours[i].push_back(i+2);
-        bonded_neighbours[i+1].push_back(i); bonded_neighbours[i+1].push_back(i+2);
-        bonded_neighbours[i+2].push_back(i); bonded_neighbours[i+2].push_back(i+1);
+// Bins particles into cells of side at least rmin
+template <typename Real>
+void cell_list::Build(const basic_configuration<Real>& cfg, double rmin){
+    nc = std::max(1, int(Size/rmin)); lc = Size/nc;
+    head.assign(nc*nc*nc, -1); next.assign(N, -1); cell.resize(N);
+    for (int i=N-1; i>=0; i--){
+        int cx = std::min(int(cfg.X[i]/lc), nc-1);
+        int cy = std::min(int(cfg.Y[i]/lc), nc-1);
+        int cz = std::min(int(cfg.Z[i]/lc), nc-1);
+        cell[i] = (cx*nc + cy)*nc + cz;
+        next[i] = head[cell[i]]; head[cell[i]] = i;
     }
 }
 
-// Checking whether to update the neighbours list
-void configuration::CheckNL(){
-    double deltaX, deltaY, deltaZ, maximum_displacement = 0;
-    std::vector <double> deltaR2(N);
+// Molecule of each particle for trimers of consecutive particles
+std::vector<int> TrimerMolecules(){
+    std::vector<int> index(N);
+    for (int i = 0; i < N; i++) index[i] = i/3;
+    return index;
+}
+
+// Builds the bonds of every particle from the molecules
+template <typename Real>
+void basic_configuration<Real>::GetBonds(){
+    bond_start.assign(1, 0); bond_partner.clear();
+    bond_start.reserve(N+1); bond_partner.reserve(2*N);
+    for (int m = 0; m < Molecules(); m++){
+        int first = mol_start[m], last = mol_start[m+1];
+        for (int i = first; i < last; i++){
+            if (last - first <= 3){
+                for (int k = first; k < last; k++) if (k != i) bond_partner.push_back(k);
+            } else {
+                if (i > first) bond_partner.push_back(i-1);
+                if (i+1 < last) bond_partner.push_back(i+1);
+            }
+            bond_start.push_back(bond_partner.size());
+        }
+    }
+}
+
+// Groups the particles into contiguous molecules
+template <typename Real>
+void basic_configuration<Real>::SetMolecules(const std::vector<int>& index){
+    if ((int)index.size() != N){
+        throw std::invalid_argument("Expected " + std::to_string(N) + " molecule indices, got " + std::to_string(index.size()));
+    }
+    std::vector<int> renumbered(N), start;
+    std::unordered_set<int> seen;
     for (int i = 0; i < N; i++){
-        deltaX = MinimumImageDistance(X[i],X0[i]);
-        deltaY = MinimumImageDistance(Y[i],Y0[i]);
-        deltaZ = MinimumImageDistance(Z[i],Z0[i]);
+        if (i == 0 || index[i] != index[i-1]){
+            if (!seen.insert(index[i]).second){
+                throw std::invalid_argument("Particles of molecule " + std::to_string(index[i]) + " are not contiguous");
+            }
+            start.push_back(i);
+        }
+        renumbered[i] = start.size() - 1;
+    }
+    start.push_back(N);
+    if (renumbered == molecule && (int)bond_start.size() == N+1) return;
+    molecule.swap(renumbered); mol_start.swap(start);
+    GetBonds();
+}
+
+// Whether particles are grouped into trimers of consecutive particles
+template <typename Real>
+bool basic_configuration<Real>::Trimers() const{
+    for (int m = 0; m < Molecules(); m++){
+        if (mol_start[m] != 3*m || mol_start[m+1] != std::min(3*m+3, N)) return false;
+    }
+    return true;
+}
+
+// Margin left to the displacements by the neighbours lists, which shrinks if the box was compressed
+template <typename Real>
+double EffectiveSkin(const basic_configuration<Real>& cfg, double box){
+    if (box == cfg.nl_size) return cfg.skin;
+    return box/cfg.nl_size*(r_cutoff+cfg.skin) - r_cutoff;
+}
+
+// Largest squared displacement since the last neighbours update
+template <typename Real>
+Real MaximumDisplacement(const basic_configuration<Real>& cfg){
+    Real deltaX, deltaY, deltaZ;
+    std::vector <Real> deltaR2(N);
+    for (int i = 0; i < N; i++){
+        deltaX = MinimumImageDistance(cfg.X[i],cfg.X0[i]);
+        deltaY = MinimumImageDistance(cfg.Y[i],cfg.Y0[i]);
+        deltaZ = MinimumImageDistance(cfg.Z[i],cfg.Z0[i]);
         deltaR2[i] = deltaX*deltaX + deltaY*deltaY + deltaZ*deltaZ;
-    } maximum_displacement = *(std::max_element(deltaR2.begin(), deltaR2.end()));
-    if(maximum_displacement > maximum_displacement_before_update_squared){
+    } return *(std::max_element(deltaR2.begin(), deltaR2.end()));
+}
+
+// Checking whether to update the neighbours list
+template <typename Real>
+bool basic_configuration<Real>::CheckNL(){
+    const double margin = EffectiveSkin(*this, Size);
+    const double maximum_displacement_before_update_squared = margin*margin/4; // When R2Max exceeds this, update NL
+    Real maximum_displacement = MaximumDisplacement(*this);
+    if(margin < 0 || maximum_displacement > maximum_displacement_before_update_squared){
         // std::cout << (t-1) << std::endl;
         UpdateNL();
         maximum_displacement = 0;
         X0 = X; Y0 = Y; Z0 = Z;
+        return true;
     }
+    return false;
+}
+
+// Changes the skin and rebuilds the neighbours list
+template <typename Real>
+void basic_configuration<Real>::SetSkin(double new_skin){
+    if (new_skin < 0) throw std::invalid_argument("The skin of the neighbours lists must be positive");
+    skin = new_skin;
+    UpdateNL();
+    X0 = X; Y0 = Y; Z0 = Z;
 }
+
+// Checks whether the neighbours lists hold all interacting pairs of the rescaled box
+template <typename Real>
+bool basic_configuration<Real>::NLValidAfterScaling(double factor) const{
+    // Displacements are rescaled with the box
+    double margin = EffectiveSkin(*this, factor*Size);
+    return margin > 0 && factor*factor*MaximumDisplacement(*this) < margin*margin/4;
+}
+
+// Rescales all positions about the origin
+template <typename Real>
+void basic_configuration<Real>::Rescale(double factor){
+    for (int i = 0; i < N; i++){
+        X[i] *= factor; Y[i] *= factor; Z[i] *= factor;
+        X0[i] *= factor; Y0[i] *= factor; Z0[i] *= factor;
+        Xfull[i] *= factor; Yfull[i] *= factor; Zfull[i] *= factor;
+    }
+}
+
+// Reorders the elements of an array
+template <typename T>
+void PermuteArray(std::vector<T>& values, const std::vector<int>& perm){
+    std::vector<T> buffer(N);
+    for (int i = 0; i < N; i++) buffer[i] = values[perm[i]];
+    values.swap(buffer);
+}
+
+// Reorders the particles
+template <typename Real>
+void basic_configuration<Real>::Permute(const std::vector<int>& perm){
+    std::vector<int> inverse(N);
+    for (int i = 0; i < N; i++) inverse[perm[i]] = i;
+    PermuteArray(X, perm); PermuteArray(Y, perm); PermuteArray(Z, perm);
+    PermuteArray(Xfull, perm); PermuteArray(Yfull, perm); PermuteArray(Zfull, perm);
+    PermuteArray(X0, perm); PermuteArray(Y0, perm); PermuteArray(Z0, perm);
+    PermuteArray(S, perm);
+    std::vector<std::vector<int>> lists(N);
+    for (int i = 0; i < N; i++){
+        lists[i].swap(neighbours_list[perm[i]]);
+        for (int& k: lists[i]) k = inverse[k];
+        std::sort(lists[i].begin(), lists[i].end());
+    }
+    neighbours_list.swap(lists);
+    std::vector<int> index = molecule;
+    PermuteArray(index, perm);
+    SetMolecules(index);
+}
+
+// Spreads the 10 lowest bits of a cell coordinate over every third bit
+unsigned int SpreadBits(unsigned int v){
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Orders molecules along a Morton curve of the box
+template <typename Real>
+std::vector<int> MortonOrder(const basic_configuration<Real>& cfg){
+    const int cells = 1024;
+    int molecules = cfg.Molecules();
+    std::vector<std::pair<unsigned int, int>> keys(molecules);
+    for (int m = 0; m < molecules; m++){
+        int i = cfg.mol_start[m];
+        unsigned int cx = std::min(int(cfg.X[i]/Size*cells), cells-1);
+        unsigned int cy = std::min(int(cfg.Y[i]/Size*cells), cells-1);
+        unsigned int cz = std::min(int(cfg.Z[i]/Size*cells), cells-1);
+        keys[m] = std::make_pair(SpreadBits(cx) | (SpreadBits(cy) << 1) | (SpreadBits(cz) << 2), m);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<int> perm;
+    perm.reserve(N);
+    for (int m = 0; m < molecules; m++){
+        for (int i = cfg.mol_start[keys[m].second]; i < cfg.mol_start[keys[m].second+1]; i++) perm.push_back(i);
+    }
+    return perm;
+}
+
 //  Calculates difference of a and b while applying periodic boundary conditions
-double MinimumImageDistance(double coord1, double coord2) {return Size/2 - std::abs(std::abs(coord1-coord2)-Size/2);}
+template <typename Real>
+Real MinimumImageDistance(Real coord1, Real coord2) {return Real(Size)/2 - std::abs(std::abs(coord1-coord2)-Real(Size)/2);}
 
 // Shifts coordinate inside main box
 double ShiftInMainBox(double coord){
     double shift = fmod(coord, Size);//- Size*floor((a+Size/2)/Size);
     if (shift < 0) {shift += Size;}
     return shift;
-}
\ No newline at end of file
+}
+
+// Double and single precision instantiations
+template struct basic_configuration<double>;
+template struct basic_configuration<float>;
+template void cell_list::Build(const basic_configuration<double>& cfg, double rmin);
+template void cell_list::Build(const basic_configuration<float>& cfg, double rmin);
+template std::vector<int> MortonOrder(const basic_configuration<double>& cfg);
+template std::vector<int> MortonOrder(const basic_configuration<float>& cfg);
+template double MinimumImageDistance(double coord1, double coord2);
+template float MinimumImageDistance(float coord1, float coord2);
@@ -0,0 +1,30 @@
+#include "rng.hpp"
+
+// Generator shared by all Monte Carlo moves of a thread, in the state of Seed(1)
+__thread rng generator = {
+    {-1726662223, 379960547, 1735697613, 1040273694, 1313901226, 1627687941,
+     -179304937, -2073333483, 1780058412, -1989503057, -615974602, 344556628,
+     939512070, -1249116260, 1507946756, -812545463, 154635395, 1388815473,
+     -1926676823, 525320961, -1009028674, 968117788, -123449607, 1284210865,
+     435012392, -2017506339, -911064859, -370259173, 1132637927, 1398500161,
+     -205601318},
+    3, 0
+};
+
+// Seeds the table exactly like glibc's srandom (TYPE_3, degree 31, separation 3)
+void rng::Seed(unsigned int seed){
+    if (seed == 0) seed = 1;
+    state[0] = (int32_t)seed;
+    int32_t word = state[0];
+    for (int i = 1; i < 31; i++){
+        // state[i] = (16807 * state[i-1]) % 2147483647 without overflowing 31 bits
+        long hi = word / 127773;
+        long lo = word % 127773;
+        word = 16807*lo - 2836*hi;
+        if (word < 0) word += 2147483647;
+        state[i] = word;
+    }
+    front = 3; rear = 0;
+    // Discarding the first draws to decorrelate from the seed
+    for (int i = 0; i < 310; i++) Next();
+}
@@ -3,16 +3,74 @@
 #include <boost/filesystem.hpp>
 #include <algorithm>
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <stdexcept>
 #include <indicators/progress_bar.hpp>
 #include "globals.hpp"
 #include "simulation.hpp"
 #include "utils.hpp"
 #include "observables.hpp"
+#include "checkpoint.hpp"
+#include "stats.hpp"
+#include "live.hpp"
+#include "npy.hpp"
 
 namespace fs = boost::filesystem;
 
-// Constants
-const double maximum_displacement = 0.17; // Max particle displacement
+// Max particle displacement (per thread, set by MonteCarloRun)
+__thread double maximum_displacement = 0.17;
+
+// Clock of the runtime statistics
+typedef std::chrono::steady_clock timer_clock;
+
+// Adds the seconds elapsed since the last lap to a timer and to the total time
+void Lap(double& timer, double& total, timer_clock::time_point& lap){
+    timer_clock::time_point now = timer_clock::now();
+    double seconds = std::chrono::duration<double>(now - lap).count();
+    timer += seconds; total += seconds; lap = now;
+}
+
+// Sorts molecules along a Morton curve, cycle references and particles' order following
+void SortMolecules(configuration& cfg, run_state& state){
+    std::vector <int> perm = MortonOrder(cfg);
+    cfg.Permute(perm);
+    for (configuration& ref: state.cfgsCycles) ref.Permute(perm);
+    std::vector <int> order(N);
+    for (int i = 0; i < N; i++) order[i] = state.order[perm[i]];
+    state.order.swap(order);
+}
+
+// Counts a rebuild of the neighbours list, sorting molecules every sort_every rebuilds
+void CountRebuild(configuration& cfg, run_state& state, const run_options& opts){
+    state.window.nl_rebuilds++;
+    // Sorting molecules for cache locality
+    if (opts.sort_every > 0 && (state.stats.nl_rebuilds + state.window.nl_rebuilds)%opts.sort_every == 0){
+        SortMolecules(cfg, state);
+    }
+}
+
+// Checks the neighbours list, tuning the skin and sorting molecules every sort_every rebuilds
+void UpdateNeighbours(configuration& cfg, run_state& state, const run_options& opts, bool progress_bar){
+    bool rebuilt = cfg.CheckNL();
+    if (!state.tuner.done){
+        // Cost of the sweeps performed with the current skin
+        const run_stats &stats = state.stats, &window = state.window;
+        double skin = state.tuner.Update(stats.sweeps + window.sweeps, stats.time_sweeps + window.time_sweeps +
+                                         stats.time_neighbours + window.time_neighbours);
+        if (skin != cfg.skin) {cfg.SetSkin(skin); rebuilt = true;}
+        if (state.tuner.done && progress_bar){
+            std::cout << "Neighbours lists skin tuned to " << skin << std::endl;
+        }
+    }
+    if (rebuilt) CountRebuild(cfg, state, opts);
+}
+
 
 // Progress bar
 indicators::ProgressBar bar{
@@ -29,13 +87,16 @@ indicators::ProgressBar bar{
 
 // Monte Carlo Simulation loop
 void MonteCarloRun(configuration& cfg, double T, int tau, int cycles, int tw, double p_flip, 
-        std::vector <std::string>& observables, std::string& out, int n_log, int n_lin, bool progress_bar){
+        std::vector <std::string>& observables, std::string& out, int n_log, int n_lin, bool progress_bar,
+        const run_options& opts){
             
     int steps = tw*(cycles-1)+tau;
-    int dataCounter=0;
     int cycle;
-    int cycleCounter = 0;
-    std::vector <configuration> cfgsCycles;
+    run_state state;
+    if (opts.step <= 0){
+        throw std::invalid_argument("The width of the trial displacements must be positive");
+    }
+    maximum_displacement = opts.step;
     configuration* cfg0;
 
     // Building snapshots list
@@ -49,24 +110,214 @@ void MonteCarloRun(configuration& cfg, double T, int tau, int cycles, int tw, do
     // Linspaced
     linpoints = GetLinspacedSnapshots(cycles, tau, tw, n_lin);
 
-    // Observables file
-    std::ofstream log_obs = MakeObsFile(observables, out + "obs.txt");
     std::string out_cfg = out + "configs/";
-    
-    // First neighbours
-    cfg.GetBonds(); cfg.UpdateNL();
+    observables_set obs_set(observables, opts.overlap_a, T);
+    observables_set histogram_set(opts.histogram_observables, opts.overlap_a, T);
+    if (histogram_set.RequiresReference()){
+        throw std::invalid_argument("Energy histograms only average static observables (U, P, rho)");
+    }
+    sweep_kernel sweep = SelectSweep(p_flip, opts.flip_heat_bath);
+    std::string out_ckpt = out + "checkpoint.bin";
+    std::string out_structure = out + "structure/";
+    if (opts.structure_every > 0) fs::create_directories(out_structure);
+    std::ofstream log_obs, log_stats;
+    npy_table log_binary;
+
+    if (opts.restart){
+        // Resuming from last checkpoint
+        ReadCheckpoint(cfg, state, out_ckpt);
+        if (opts.histogram_every > 0){
+            // Samples of another ensemble must not be added to the same bins
+            energy_histogram& histogram = state.histogram;
+            bool isobaric = opts.volume_every > 0;
+            if (histogram.columns != histogram_set.Columns() || histogram.width <= 0 ||
+                histogram.sums.size() != histogram.keys.size()*histogram.Stride() ||
+                histogram.width != opts.histogram_width || histogram.T != T || histogram.isobaric != isobaric ||
+                (isobaric && histogram.pressure != opts.pressure) || histogram.particles != N){
+                throw std::runtime_error("Energy histogram settings differ from the checkpoint");
+            }
+        }
+        if (opts.obs_raw) log_obs = ReopenObsFile(out + "obs.txt", state.obsOffset);
+        if (opts.obs_binary) log_binary.Reopen(out + "obs.npy", obs_set.Columns(), state.obsBinaryOffset);
+        if (opts.stats_every > 0) log_stats = ReopenObsFile(out + "stats.txt", state.statsOffset);
+        if (progress_bar) bar.set_progress(100*(state.t-1)/steps);
+    } else {
+        // Observables file
+        if (opts.obs_raw) log_obs = MakeObsFile(obs_set, out + "obs.txt");
+        if (opts.obs_binary) log_binary.Create(out + "obs.npy", obs_set.Columns());
+        if (opts.stats_every > 0) log_stats = MakeStatsFile(out + "stats.txt");
+        // First neighbours
+        cfg.GetBonds();
+        if (opts.sort_every > 0){
+            state.order.resize(N);
+            for (int i = 0; i < N; i++) state.order[i] = i;
+            SortMolecules(cfg, state);
+        }
+        cfg.SetSkin(opts.skin);
+        if (opts.skin_tune > 0) state.tuner = skin_tuner(opts.skin_tune, opts.skin);
+        // Static structure
+        if (opts.structure_every > 0){
+            state.structure = structure_accumulator(opts.gr_rmax, opts.gr_bins, WaveVectorShells(opts.sq_nmax, opts.sq_q),
+                                                    opts.sq_modes);
+        }
+        // Multiple-tau correlator
+        if (opts.correlator_every > 0){
+            state.correlator = multi_tau_correlator(opts.correlator_p, opts.correlator_m, 
+                                                    opts.correlator_every, tau, opts.correlator_q);
+        }
+        // Energy histogram
+        if (opts.histogram_every > 0){
+            state.histogram = energy_histogram(opts.histogram_width, T, opts.pressure, opts.volume_every > 0,
+                                               histogram_set.Columns());
+        }
+        // Equilibration monitor
+        if (opts.equil_max_sweeps > 0){
+            state.equilibration = equilibration_monitor(opts.equil_every, opts.equil_relaxations, opts.equil_fs);
+        }
+    }
+
+    bool checkpointing = opts.checkpoint_every > 0 || opts.checkpoint_walltime > 0;
+    std::chrono::steady_clock::time_point last_checkpoint = std::chrono::steady_clock::now();
+    run_stats& stats = state.window;
+    timer_clock::time_point lap = timer_clock::now();
+
+    // Publishing the state reached after sweep t to the live export (neighbours lists up to date)
+    std::unique_ptr<live_export> live;
+    if (opts.live_every > 0){
+        live.reset(new live_export(LiveName(out)));
+        if (progress_bar) std::cout << "Live export in shared memory " << LiveName(out) << std::endl;
+    }
+    auto publish = [&](int t, bool equilibrating){
+        if (!live || t%opts.live_every != 0) return;
+        live_frame frame;
+        frame.t = t; frame.equilibrating = equilibrating; frame.Size = Size;
+        frame.U = VTotal(cfg)/(2*N);
+        frame.stats = state.stats; frame.stats.Merge(stats); frame.stats.SampleNeighbours(cfg);
+        live->Publish(cfg, frame, state.order);
+        Lap(stats.time_io, stats.time_total, lap);
+    };
+
+    // Inter-molecular swaps after each sweep
+    if (opts.swap_fraction < 0){
+        throw std::invalid_argument("The fraction of swap trials must be positive");
+    }
+    const long long swaps = llround(opts.swap_fraction*N);
+    auto swap_moves = [&](){
+        for (long long s = 0; s < swaps; s++){
+            stats.swap_trials++;
+            stats.swap_accepted += TrySwap(cfg, floor(ranf()*N), T, opts.swap_local);
+        }
+        if (swaps > 0) Lap(stats.time_sweeps, stats.time_total, lap);
+    };
+
+    // Isobaric volume move after sweep t
+    if (opts.volume_every > 0 && opts.volume_max <= 0){
+        throw std::invalid_argument("Volume moves require volume_max > 0");
+    }
+    auto volume_move = [&](int t){
+        if (opts.volume_every <= 0 || t%opts.volume_every != 0) return;
+        stats.volume_trials++;
+        bool rebuilt = false;
+        if (TryVolume(cfg, T, opts.pressure, opts.volume_max, &rebuilt)) stats.volume_accepted++;
+        Lap(stats.time_sweeps, stats.time_total, lap);
+        if (rebuilt){
+            CountRebuild(cfg, state, opts);
+            Lap(stats.time_neighbours, stats.time_total, lap);
+        }
+    };
+
+    // Checkpointing the state reached after sweep t-1 (of the equilibration or of the run)
+    auto checkpoint = [&](int t, int t_start){
+        if (!checkpointing || t <= t_start) return;
+        bool sweeps_due = opts.checkpoint_every > 0 && (t-1)%opts.checkpoint_every == 0;
+        bool walltime_due = opts.checkpoint_walltime > 0 && 
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - last_checkpoint).count() 
+                >= opts.checkpoint_walltime;
+        if (sweeps_due || walltime_due){
+            if (opts.obs_raw) {log_obs.flush(); state.obsOffset = log_obs.tellp();}
+            if (opts.obs_binary) state.obsBinaryOffset = log_binary.Flush();
+            if (opts.stats_every > 0) {log_stats.flush(); state.statsOffset = log_stats.tellp();}
+            WriteCheckpoint(cfg, state, out_ckpt);
+            if (opts.correlator_every > 0) state.correlator.Write(out + "correlator.txt");
+            if (opts.obs_average) state.averages.Write(out + "obs_avg.txt", observables);
+            if (opts.histogram_every > 0) state.histogram.Write(out + "histogram.txt");
+            last_checkpoint = std::chrono::steady_clock::now();
+            Lap(stats.time_io, stats.time_total, lap);
+        }
+    };
+
+    // Equilibration sweeps, stopped once the energy is stationary
+    equilibration_monitor& equil = state.equilibration;
+    if (!equil.done){
+        int t_start = equil.t;
+        while (!equil.done){
+            int t = equil.t;
+            checkpoint(t, t_start);
+            UpdateNeighbours(cfg, state, opts, progress_bar);
+            Lap(stats.time_neighbours, stats.time_total, lap);
+            publish(t-1, true);
+            if ((t-1)%equil.every == 0){
+                cfg.UpdateCM_coord();
+                equil.done = equil.Sample(cfg, t-1, state.order);
+            }
+            if (t-1 >= opts.equil_max_sweeps) equil.done = true;
+            Lap(stats.time_observables, stats.time_total, lap);
+            if (equil.done) break;
+            sweep(cfg, T, p_flip, stats);
+            Lap(stats.time_sweeps, stats.time_total, lap);
+            swap_moves();
+            volume_move(t);
+            equil.t++;
+        }
+        // Equilibrated configuration and relaxation times
+        WriteTrimCFG(cfg, out + "equilibrated.xy", state.order);
+        equil.WriteSeries(out + "equilibration.txt");
+        equil.WriteSummary(out + "equilibration.json");
+        if (!equil.equilibrated){
+            std::cerr << "Warning: energy not stationary after " << equil.t-1 << " equilibration sweeps" << std::endl;
+        } else if (progress_bar){
+            std::cout << "Equilibrated after " << equil.t-1 << " sweeps (tau_alpha = " << equil.tau_alpha << " sweeps)" << std::endl;
+        }
+        // Rows of the stats file only cover the run
+        state.stats.Merge(stats); stats = run_stats();
+        Lap(stats.time_io, stats.time_total, lap);
+    }
 
     // Monte Carlo sweeps
-    for(int t = 1; t <= steps; t++){
+    int t_start = state.t;
+    for(; state.t <= steps; state.t++){
+        int t = state.t;
+
+        checkpoint(t, t_start);
+
         // Checking whether to update the neighbours list
-        cfg.CheckNL();
+        UpdateNeighbours(cfg, state, opts, progress_bar);
+        Lap(stats.time_neighbours, stats.time_total, lap);
+        publish(t-1, false);
     
         // Updating reference observables
-        if((t-1)%tw == 0 && cycleCounter < cycles){
+        if((t-1)%tw == 0 && state.cycleCounter < cycles){
             cfg.UpdateCM_coord();
-            cfgsCycles.push_back(cfg); cycleCounter++;
+            state.cfgsCycles.push_back(cfg); state.cycleCounter++;
         } 
 
+        // Accumulating static structure
+        if (opts.structure_every > 0 && (t-1)%opts.structure_every == 0){
+            state.structure.Sample(cfg);
+        }
+
+        // Accumulating the energy histogram
+        if (opts.histogram_every > 0 && (t-1)%opts.histogram_every == 0){
+            state.histogram.Sample(VTotal(cfg)/(2*N), Size*Size*Size, histogram_set.Compute(cfg, cfg));
+        }
+
+        // Updating multiple-tau correlator
+        if (opts.correlator_every > 0 && (t-1)%opts.correlator_every == 0){
+            cfg.UpdateCM_coord();
+            state.correlator.Push(cfg, state.order);
+        }
+        Lap(stats.time_observables, stats.time_total, lap);
+
         // // Writing observables to text file
         int lin = std::count(linpoints.begin(), linpoints.end(), t);
         int log = std::count(logpoints.begin(), logpoints.end(), t);
@@ -74,54 +325,96 @@ void MonteCarloRun(configuration& cfg, double T, int tau, int cycles, int tw, do
         if(lin>0){ // checking if linear saving time
             // Configs
             if(! fs::exists (out_cfg + "cfg_" + std::to_string(t) + ".xy")){
-                WriteTrimCFG(cfg, out_cfg + "cfg_" + std::to_string(t) + ".xy");
+                WriteTrimCFG(cfg, out_cfg + "cfg_" + std::to_string(t) + ".xy", state.order);
             }
+            Lap(stats.time_io, stats.time_total, lap);
         }
 
         if(log>0){ // checking if log saving time
             cfg.UpdateCM_coord();
             for(int s=0; s<log; s++){
                 // looping different eventual tws
-                cycle = twpoints[dataCounter];
-                cfg0 = &cfgsCycles[cycle];
+                cycle = twpoints[state.dataCounter];
+                cfg0 = &state.cfgsCycles[cycle];
                 // Configs
                 if(! fs::exists (out_cfg + "cfg_" + std::to_string(t) + ".xy")){
-                    WriteTrimCFG(cfg, out_cfg + "cfg_" + std::to_string(t) + ".xy");
+                    WriteTrimCFG(cfg, out_cfg + "cfg_" + std::to_string(t) + ".xy", state.order);
                 } 
+                Lap(stats.time_io, stats.time_total, lap);
                 // Observables
-                WriteObs(cfg, *cfg0, t, cycle, observables, log_obs);
+                std::vector <double> values = obs_set.Compute(cfg, *cfg0);
+                if (opts.obs_average) state.averages.Add(t-tw*cycle-1, values);
+                obs_set.AddSusceptibilities(t-tw*cycle-1, values, state.moments);
+                Lap(stats.time_observables, stats.time_total, lap);
+                if (opts.obs_raw) WriteObs(t, cycle, values, log_obs);
+                if (opts.obs_binary) log_binary.Write(t, cycle, values);
+                Lap(stats.time_io, stats.time_total, lap);
 
-                dataCounter++;
+                state.dataCounter++;
             }  
         };
         // Doing the MC
-        for (int i = 0; i < N; i++){
-            if (ranf() > p_flip) TryDisp(cfg, floor(ranf()*N), T); //Displacement probability 0.8
-            else TryFlip(cfg, floor(ranf()*N), T); //Flip probability 0.2
+        sweep(cfg, T, p_flip, stats);
+        Lap(stats.time_sweeps, stats.time_total, lap);
+        swap_moves();
+        volume_move(t);
+
+        // Writing static structure at the end of each cycle
+        if (opts.structure_every > 0 && t >= tau && (t-tau)%tw == 0 && (t-tau)/tw < cycles){
+            std::string c = std::to_string((t-tau)/tw);
+            state.structure.Write(out_structure + "gr_" + c + ".txt", out_structure + "sq_" + c + ".txt");
+            state.structure.Reset();
+            Lap(stats.time_io, stats.time_total, lap);
+        }
+
+        // Writing runtime statistics of the last stats_every sweeps
+        if (opts.stats_every > 0 && t%opts.stats_every == 0){
+            stats.SampleNeighbours(cfg);
+            stats.WriteRow(t, log_stats);
+            state.stats.Merge(stats); stats = run_stats();
+            Lap(stats.time_io, stats.time_total, lap);
         }
         
-        if (progress_bar){
-            if((t-1)%(steps/100)==0) bar.tick();
+        if (progress_bar && 100LL*t/steps != 100LL*(t-1)/steps){
+            bar.set_progress(100LL*t/steps);
         }
     }; 
     
     log_obs.close();
+    log_binary.Close();
+    log_stats.close();
+    if (opts.correlator_every > 0) state.correlator.Write(out + "correlator.txt");
+    if (opts.obs_average) state.averages.Write(out + "obs_avg.txt", observables);
+    if (opts.histogram_every > 0) state.histogram.Write(out + "histogram.txt");
+
+    // Restoring the original particles' order
+    if (!state.order.empty()){
+        std::vector <int> perm(N);
+        for (int i = 0; i < N; i++) perm[state.order[i]] = i;
+        cfg.Permute(perm);
+    }
+
+    // Summarizing runtime statistics
+    stats.SampleNeighbours(cfg);
+    state.stats.Merge(stats);
+    state.stats.WriteSummary(out + "stats.json");
+    if (progress_bar) state.stats.Print(std::cout);
 }
 
 //  Tries displacing one particle j by vector dr = (dx, dy, dz)
-void TryDisp(configuration& cfg, int j, double T){
+template <typename Real>
+bool TryDisp(basic_configuration<Real>& cfg, int j, double T){
     double dx = (ranf()-0.5)*maximum_displacement;
     double dy = (ranf()-0.5)*maximum_displacement;
     double dz = (ranf()-0.5)*maximum_displacement;
-    double Xold = cfg.X[j], Xnew = ShiftInMainBox(cfg.X[j]+dx); 
-    double Yold = cfg.Y[j], Ynew = ShiftInMainBox(cfg.Y[j]+dy);
-    double Zold = cfg.Z[j], Znew = ShiftInMainBox(cfg.Z[j]+dz);
-    // Energy before the displacement
-    double V_old = V(cfg, j);
-    // Energy after the displacement
+    Real Xold = cfg.X[j], Xnew = ShiftInMainBox(cfg.X[j]+dx); 
+    Real Yold = cfg.Y[j], Ynew = ShiftInMainBox(cfg.Y[j]+dy);
+    Real Zold = cfg.Z[j], Znew = ShiftInMainBox(cfg.Z[j]+dz);
+    // Energies before and after the displacement
+    double V_old, V_new;
+    VDisp(cfg, j, Xnew, Ynew, Znew, V_old, V_new);
     cfg.X[j] = Xnew; cfg.Y[j] = Ynew; cfg.Z[j] = Znew;
     cfg.Xfull[j] += dx; cfg.Yfull[j] += dy; cfg.Zfull[j] += dz;
-    double V_new = V(cfg, j);
 
     double deltaE = V_new - V_old;
     if (deltaE < 0){
@@ -130,12 +423,17 @@ void TryDisp(configuration& cfg, int j, double T){
     else if (exp(-deltaE/T) < ranf()){
         cfg.X[j] = Xold; cfg.Y[j] = Yold; cfg.Z[j] = Zold;
         cfg.Xfull[j] -= dx; cfg.Yfull[j] -= dy; cfg.Zfull[j] -= dz;
+        return false;
     }
+    return true;
 }
 
-//  Tries swapping two particles diameters in the molecule containing particle j
-void TryFlip(configuration& cfg, int j, double T){
-    int a = rand() % 2; int k = cfg.bonded_neighbours[j][a]; 
+//  Tries swapping the diameters of particle j and of a particle bonded to it
+template <typename Real>
+bool TryFlip(basic_configuration<Real>& cfg, int j, double T){
+    int bonds = cfg.bond_start[j+1] - cfg.bond_start[j];
+    if (bonds == 0) return false;
+    int k = cfg.bond_partner[cfg.bond_start[j] + generator.Next() % bonds];
     // Energy of the two clusters before the move attempt
     double V_old = V(cfg, j) + V(cfg, k);
     // Temporarily saving old configurations
@@ -150,54 +448,290 @@ void TryFlip(configuration& cfg, int j, double T){
     }
     else if (exp(-deltaE/T) < ranf()){
         cfg.S[j] = Sj_old; cfg.S[k] = Sk_old;
+        return false;
     }
+    return true;
 }
 
-// Observables-only run
-void ComputeObservables(int tau, int cycles, int tw,  
-        std::vector <std::string>& observables, std::string& out, int n_log){
-    
-    double steps = tw*(cycles-1)+tau;
-    int dataCounter=0;
-    int cycle;
-    int cycleCounter = 0;
-    std::vector <configuration> cfgsCycles;
-    configuration cfg;
-    configuration* cfg0;
+//  Draws the types of the molecule of particle j among their arrangements with Boltzmann weights
+template <typename Real>
+bool TryHeatBathFlip(basic_configuration<Real>& cfg, int j, double T){
+    int m = cfg.molecule[j], first = cfg.mol_start[m], size = cfg.mol_start[m+1] - first;
+    if (size < 2) return false;
+    if (size > 3) return TryFlip(cfg, j, T);
 
-    // Building snapshots list
-    std::vector <int> logpoints, twpoints;
+    // Energies with the other molecules for each diameter, one pass per particle
+    double external[3][3];
+    for (int a = 0; a < size; a++) VTypes(cfg, first+a, external[a]);
 
-    // Logspaced
+    // Energies of every distinct arrangement of the types (at most 6)
+    int current[3], arrangement[3], arrangements[6][3], count = 0;
+    double energies[6], lowest = HUGE_VAL;
+    for (int a = 0; a < size; a++) current[a] = arrangement[a] = cfg.S[first+a];
+    std::sort(arrangement, arrangement+size);
+    do {
+        double E = 0;
+        for (int a = 0; a < size; a++){
+            int i = first+a;
+            double si = diameters[arrangement[a]-1];
+            E += external[a][arrangement[a]-1];
+            for (int b = a+1; b < size; b++){
+                int k = first+b;
+                double sk = diameters[arrangement[b]-1];
+                E += WCAPair(cfg.X[i], cfg.Y[i], cfg.Z[i], si, cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
+                if (std::binary_search(cfg.bond_partner.begin() + cfg.bond_start[i], cfg.bond_partner.begin() + cfg.bond_start[i+1], k)){
+                    E += FENEPair(cfg.X[i], cfg.Y[i], cfg.Z[i], si, cfg.X[k], cfg.Y[k], cfg.Z[k], sk);
+                }
+            }
+        }
+        std::copy(arrangement, arrangement+size, arrangements[count]);
+        energies[count++] = E; lowest = std::min(lowest, E);
+    } while (std::next_permutation(arrangement, arrangement+size));
+
+    // Heat-bath choice, independent of the current arrangement
+    double weights[6], total = 0;
+    for (int c = 0; c < count; c++) {weights[c] = exp(-(energies[c] - lowest)/T); total += weights[c];}
+    double r = ranf()*total;
+    int chosen = 0;
+    while (chosen < count-1 && r >= weights[chosen]) r -= weights[chosen++];
+    if (std::equal(current, current+size, arrangements[chosen])) return false;
+    for (int a = 0; a < size; a++) cfg.S[first+a] = arrangements[chosen][a];
+    return true;
+}
+
+//  Tries swapping the diameters of particle j and of a particle of another molecule
+template <typename Real>
+bool TrySwap(basic_configuration<Real>& cfg, int j, double T, bool local){
+    int k;
+    if (local){
+        const std::vector <int>& neighbours = cfg.neighbours_list[j];
+        if (neighbours.empty()) return false;
+        k = neighbours[generator.Next() % neighbours.size()];
+    } else {
+        k = generator.Next() % N;
+    }
+    if (cfg.S[j] == cfg.S[k] || cfg.molecule[j] == cfg.molecule[k]) return false;
+    // Energy of both particles before the move attempt (their own pair does not change)
+    double V_old = V(cfg, j) + V(cfg, k);
+    int Sj_old = cfg.S[j], Sk_old = cfg.S[k];
+    cfg.S[j] = Sk_old; cfg.S[k] = Sj_old;
+    double V_new = V(cfg, j) + V(cfg, k);
+
+    double deltaE = V_new - V_old;
+    if (deltaE < 0){
+        // pass
+    }
+    else if (exp(-deltaE/T) < ranf()){
+        cfg.S[j] = Sj_old; cfg.S[k] = Sk_old;
+        return false;
+    }
+    return true;
+}
+
+//  Tries rescaling the box and all positions at constant pressure
+template <typename Real>
+bool TryVolume(basic_configuration<Real>& cfg, double T, double P, double max_dlnV, bool* rebuilt){
+    double dlnV = (ranf()-0.5)*2*max_dlnV;
+    double factor = exp(dlnV/3);
+    // Lists built in the current box if the compression would exhaust their margin
+    if (!cfg.NLValidAfterScaling(factor)){
+        cfg.UpdateNL();
+        cfg.X0 = cfg.X; cfg.Y0 = cfg.Y; cfg.Z0 = cfg.Z;
+        if (rebuilt) *rebuilt = true;
+    }
+    double U_old, U_new, W;
+    VTotalScaled(cfg, factor, U_old, U_new, W);
+    double V_old = Size*Size*Size, V_new = V_old*exp(dlnV);
+
+    double deltaH = U_new - U_old + P*(V_new - V_old) - (N+1)*T*dlnV;
+    if (deltaH < 0){
+        // pass
+    }
+    else if (exp(-deltaH/T) < ranf()){
+        return false;
+    }
+    cfg.Rescale(factor);
+    Size *= factor;
+    return true;
+}
+
+// Flip move of the sweep kernels
+template <bool HeatBath>
+inline bool Flip(configuration& cfg, int j, double T){
+    return HeatBath ? TryHeatBathFlip(cfg, j, T) : TryFlip(cfg, j, T);
+}
+
+// Performs one MC sweep of N trial moves, the move type being drawn only for mixed moves
+template <move_set Moves, bool HeatBath>
+void Sweep(configuration& cfg, double T, double p_flip, run_stats& stats){
+    long long accepted = 0;
+    for (int i = 0; i < N; i++){
+        if (Moves == displacement_moves){
+            accepted += TryDisp(cfg, floor(ranf()*N), T);
+        } else if (Moves == flip_moves){
+            accepted += Flip<HeatBath>(cfg, floor(ranf()*N), T);
+        } else if (ranf() > p_flip){ //Displacement probability 0.8
+            stats.disp_trials++; stats.disp_accepted += TryDisp(cfg, floor(ranf()*N), T);
+        } else { //Flip probability 0.2
+            stats.flip_trials++; stats.flip_accepted += Flip<HeatBath>(cfg, floor(ranf()*N), T);
+        }
+    }
+    if (Moves == displacement_moves) {stats.disp_trials += N; stats.disp_accepted += accepted;}
+    if (Moves == flip_moves) {stats.flip_trials += N; stats.flip_accepted += accepted;}
+    stats.sweeps++;
+}
+
+// Selects the sweep kernel of a move mix
+sweep_kernel SelectSweep(double p_flip, bool heat_bath){
+    if (p_flip < 0 || p_flip > 1){
+        throw std::invalid_argument("p_flip must be between 0 and 1");
+    }
+    if (p_flip == 0) return &Sweep<displacement_moves>;
+    if (p_flip == 1) return heat_bath ? &Sweep<flip_moves, true> : &Sweep<flip_moves>;
+    return heat_bath ? &Sweep<mixed_moves, true> : &Sweep<mixed_moves>;
+}
+
+// Sweep kernels
+template void Sweep<mixed_moves>(configuration& cfg, double T, double p_flip, run_stats& stats);
+template void Sweep<displacement_moves>(configuration& cfg, double T, double p_flip, run_stats& stats);
+template void Sweep<flip_moves>(configuration& cfg, double T, double p_flip, run_stats& stats);
+template void Sweep<mixed_moves, true>(configuration& cfg, double T, double p_flip, run_stats& stats);
+template void Sweep<flip_moves, true>(configuration& cfg, double T, double p_flip, run_stats& stats);
+
+// Double and single precision instantiations
+template bool TryDisp(basic_configuration<double>& cfg, int j, double T);
+template bool TryDisp(basic_configuration<float>& cfg, int j, double T);
+template bool TryFlip(basic_configuration<double>& cfg, int j, double T);
+template bool TryFlip(basic_configuration<float>& cfg, int j, double T);
+template bool TryHeatBathFlip(basic_configuration<double>& cfg, int j, double T);
+template bool TryHeatBathFlip(basic_configuration<float>& cfg, int j, double T);
+template bool TrySwap(basic_configuration<double>& cfg, int j, double T, bool local);
+template bool TrySwap(basic_configuration<float>& cfg, int j, double T, bool local);
+template bool TryVolume(basic_configuration<double>& cfg, double T, double P, double max_dlnV, bool* rebuilt);
+template bool TryVolume(basic_configuration<float>& cfg, double T, double P, double max_dlnV, bool* rebuilt);
+
+// Observables-only run
+void ComputeObservables(double T, int tau, int cycles, int tw,  
+        std::vector <std::string>& observables, std::string& out, int n_log, bool progress_bar,
+        const run_options& opts){
+    
+    // Building snapshots list, cycles sharing a snapshot are grouped together
+    std::vector <int> logpoints;
+    std::vector < std::vector <int>> twpoints;
     std::vector < std::pair <int, int>> log_and_tws = GetLogspacedSnapshots(cycles, tau, tw, n_log);
     for (auto p: log_and_tws){
-        logpoints.push_back(p.first); twpoints.push_back(p.second);
+        if (logpoints.empty() || logpoints.back() != p.first){
+            logpoints.push_back(p.first); twpoints.push_back(std::vector <int>());
+        } twpoints.back().push_back(p.second);
     }
+    int snapshots = logpoints.size();
 
     // File writing
     std::string out_cfg = out + "configs/";
-    std::ofstream log_obs = MakeObsFile(observables, out + "obs.txt");
+    observables_set obs_set(observables, opts.overlap_a, T);
+    std::ofstream log_obs;
+    npy_table log_binary;
+    if (opts.obs_raw) log_obs = MakeObsFile(obs_set, out + "obs.txt");
+    if (opts.obs_binary) log_binary.Create(out + "obs.npy", obs_set.Columns());
+    bool neighbours = obs_set.RequiresNeighbours();
 
-    // Looping over the saved snapshots
-    for(int t: logpoints){
-        cfg = ReadTrimCFG(out_cfg + "cfg_" + std::to_string(t) + ".xy");
-        cfg.GetBonds(); cfg.UpdateNL();
-        cfg.UpdateCM_coord();
-        
-        // Updating reference observables
-        if((t-1)%tw == 0 && cycleCounter < cycles){
-            cfgsCycles.push_back(cfg); cycleCounter++;
-        } 
-        
-        cycle = twpoints[dataCounter];
-        cfg0 = &cfgsCycles[cycle];
+    // Worker threads, which take the number of particles and box size of the calling thread
+    const int jobN = N;
+    const double jobSize = Size;
+    int threads = opts.threads > 0 ? opts.threads : std::thread::hardware_concurrency();
+    threads = std::max(1, std::min(threads, snapshots));
+    const int window = 4*threads; // Maximum number of snapshots awaiting to be written
+    std::mutex mtx;
+    std::condition_variable computed, written;
+    std::exception_ptr error;
+
+    // Reference configurations of each cycle (written at the beginning of the cycle)
+    std::vector <configuration> cfgsCycles(cycles);
+    std::atomic <int> nextRef(0);
+    auto read_references = [&](){
+        N = jobN; Size = jobSize;
+        for (int c = nextRef++; c < cycles; c = nextRef++){
+            try {
+                ReadTrimCFG(out_cfg + "cfg_" + std::to_string(tw*c+1) + ".xy", cfgsCycles[c]);
+                cfgsCycles[c].UpdateCM_coord();
+            } catch (...) {
+                std::lock_guard <std::mutex> lock(mtx);
+                if (!error) error = std::current_exception();
+            }
+        }
+    };
+    std::vector <std::thread> pool;
+    for (int k = 0; k < threads; k++) pool.emplace_back(read_references);
+    for (std::thread& worker: pool) worker.join();
+    pool.clear();
+    if (error) std::rethrow_exception(error);
 
-        // Observables
-        WriteObs(cfg, *cfg0, t, cycle, observables, log_obs);
+    // Observables of each snapshot, filled by the workers and emptied by the writer
+    std::vector < std::vector < std::vector <double>>> results(snapshots);
+    std::vector <bool> done(snapshots, false);
+    int next = 0, flushed = 0;
 
-        dataCounter++;
-        bar.tick();
-   
+    auto replay = [&](){
+        N = jobN; Size = jobSize;
+        configuration cfg; // buffer reused for all the snapshots of this worker
+        while (true){
+            int k;
+            {
+                std::unique_lock <std::mutex> lock(mtx);
+                written.wait(lock, [&](){ return next < flushed + window || next >= snapshots; });
+                if (next >= snapshots) return;
+                k = next++;
+            }
+            std::vector < std::vector <double>> values;
+            try {
+                ReadTrimCFG(out_cfg + "cfg_" + std::to_string(logpoints[k]) + ".xy", cfg);
+                if (neighbours) cfg.UpdateNL();
+                cfg.UpdateCM_coord();
+                for (int cycle: twpoints[k]){
+                    values.push_back(obs_set.Compute(cfg, cfgsCycles[cycle]));
+                }
+            } catch (...) {
+                std::lock_guard <std::mutex> lock(mtx);
+                if (!error) error = std::current_exception();
+                next = snapshots; // stopping the other workers
+            }
+            std::lock_guard <std::mutex> lock(mtx);
+            results[k].swap(values); done[k] = true;
+            computed.notify_all();
+        }
     };
+    for (int k = 0; k < threads; k++) pool.emplace_back(replay);
+
+    // Writing the snapshots in order
+    overlap_moments moments;
+    cycle_averages averages;
+    for (int k = 0; k < snapshots; k++){
+        std::vector < std::vector <double>> values;
+        {
+            std::unique_lock <std::mutex> lock(mtx);
+            computed.wait(lock, [&](){ return done[k] || error; });
+            if (error) break;
+            values.swap(results[k]);
+            flushed++;
+        }
+        written.notify_all();
+        for (size_t s = 0; s < values.size(); s++){
+            int lag = logpoints[k]-tw*twpoints[k][s]-1;
+            if (opts.obs_average) averages.Add(lag, values[s]);
+            obs_set.AddSusceptibilities(lag, values[s], moments);
+            if (opts.obs_raw) WriteObs(logpoints[k], twpoints[k][s], values[s], log_obs);
+            if (opts.obs_binary) log_binary.Write(logpoints[k], twpoints[k][s], values[s]);
+        }
+        if (progress_bar) bar.set_progress(100*(k+1)/snapshots);
+    };
+    {
+        std::lock_guard <std::mutex> lock(mtx);
+        next = snapshots;
+    }
+    written.notify_all();
+    for (std::thread& worker: pool) worker.join();
     log_obs.close();
-}
\ No newline at end of file
+    log_binary.Close();
+    if (error) std::rethrow_exception(error);
+    if (opts.obs_average) averages.Write(out + "obs_avg.txt", observables);
+}
@@ -0,0 +1,133 @@
+#include <iomanip>
+#include <stdexcept>
+#include "globals.hpp"
+#include "stats.hpp"
+
+// Ratio guarding against empty ranges
+double SafeRatio(double num, double den){
+    return den > 0 ? num/den : 0;
+}
+
+// Adds the counters of another range of sweeps
+void run_stats::Merge(const run_stats& other){
+    sweeps += other.sweeps;
+    disp_trials += other.disp_trials; disp_accepted += other.disp_accepted;
+    flip_trials += other.flip_trials; flip_accepted += other.flip_accepted;
+    swap_trials += other.swap_trials; swap_accepted += other.swap_accepted;
+    nl_rebuilds += other.nl_rebuilds;
+    neighbours += other.neighbours; neighbours_samples += other.neighbours_samples;
+    time_sweeps += other.time_sweeps; time_neighbours += other.time_neighbours;
+    time_observables += other.time_observables; time_io += other.time_io;
+    time_total += other.time_total;
+    volume_trials += other.volume_trials; volume_accepted += other.volume_accepted;
+    if (other.neighbours_samples > 0) {skin = other.skin; density = other.density;}
+}
+
+// Samples the mean number of neighbours per particle
+void run_stats::SampleNeighbours(const configuration& cfg){
+    long long count = 0;
+    for (int i = 0; i < N; i++) count += cfg.neighbours_list[i].size();
+    neighbours += double(count)/N; neighbours_samples++;
+    skin = cfg.skin;
+    density = N/(Size*Size*Size);
+}
+
+// Writes one row of the stats file
+void run_stats::WriteRow(int t, std::ostream& log_stats) const{
+    log_stats << t << " " << SafeRatio(sweeps, time_total) << " "
+              << SafeRatio(disp_accepted, disp_trials) << " " << SafeRatio(flip_accepted, flip_trials) << " "
+              << nl_rebuilds << " " << SafeRatio(sweeps, nl_rebuilds) << " "
+              << SafeRatio(neighbours, neighbours_samples) << " "
+              << time_sweeps << " " << time_neighbours << " " << time_observables << " " << time_io << " " << skin << " "
+              << SafeRatio(volume_accepted, volume_trials) << " " << density << " "
+              << SafeRatio(swap_accepted, swap_trials) << std::endl;
+}
+
+// Writes the summary of a run in JSON format
+void run_stats::WriteSummary(std::string output) const{
+    std::ofstream summary(output);
+    summary << std::setprecision(8);
+    summary << "{" << std::endl
+            << "    \"sweeps\": " << sweeps << "," << std::endl
+            << "    \"sweeps_per_second\": " << SafeRatio(sweeps, time_total) << "," << std::endl
+            << "    \"disp_acceptance\": " << SafeRatio(disp_accepted, disp_trials) << "," << std::endl
+            << "    \"flip_acceptance\": " << SafeRatio(flip_accepted, flip_trials) << "," << std::endl
+            << "    \"swap_acceptance\": " << SafeRatio(swap_accepted, swap_trials) << "," << std::endl
+            << "    \"nl_rebuilds\": " << nl_rebuilds << "," << std::endl
+            << "    \"nl_interval\": " << SafeRatio(sweeps, nl_rebuilds) << "," << std::endl
+            << "    \"mean_neighbours\": " << SafeRatio(neighbours, neighbours_samples) << "," << std::endl
+            << "    \"skin\": " << skin << "," << std::endl
+            << "    \"volume_acceptance\": " << SafeRatio(volume_accepted, volume_trials) << "," << std::endl
+            << "    \"density\": " << density << "," << std::endl
+            << "    \"time_sweeps\": " << time_sweeps << "," << std::endl
+            << "    \"time_neighbours\": " << time_neighbours << "," << std::endl
+            << "    \"time_observables\": " << time_observables << "," << std::endl
+            << "    \"time_io\": " << time_io << "," << std::endl
+            << "    \"time_total\": " << time_total << std::endl
+            << "}" << std::endl;
+}
+
+// Prints a human-readable summary
+void run_stats::Print(std::ostream& os) const{
+    os << "Sweeps: " << sweeps << " (" << SafeRatio(sweeps, time_total) << " sweeps/s)" << std::endl;
+    os << "Acceptance: " << 100*SafeRatio(disp_accepted, disp_trials) << "% displacements, "
+       << 100*SafeRatio(flip_accepted, flip_trials) << "% flips";
+    if (swap_trials > 0) os << ", " << 100*SafeRatio(swap_accepted, swap_trials) << "% swaps";
+    os << std::endl;
+    os << "Neighbours lists: " << nl_rebuilds << " rebuilds (every " << SafeRatio(sweeps, nl_rebuilds)
+       << " sweeps), " << SafeRatio(neighbours, neighbours_samples) << " neighbours per particle, skin "
+       << skin << std::endl;
+    if (volume_trials > 0){
+        os << "Volume moves: " << 100*SafeRatio(volume_accepted, volume_trials) << "% accepted, density "
+           << density << std::endl;
+    }
+    os << "Time: " << 100*SafeRatio(time_sweeps, time_total) << "% sweeps, "
+       << 100*SafeRatio(time_neighbours, time_total) << "% neighbours lists, "
+       << 100*SafeRatio(time_observables, time_total) << "% observables, "
+       << 100*SafeRatio(time_io, time_total) << "% I/O" << std::endl;
+}
+
+// Range of skins explored by the tuner
+const double min_skin = 0.1, max_skin = 1.5;
+
+// Starts a search from a given skin
+skin_tuner::skin_tuner(int sweeps, double skin, double step)
+    : sweeps(sweeps), step(step), initial(skin), skin(skin), direction(1), best_skin(skin), best_cost(-1),
+      start_sweeps(-1), start_seconds(0), done(false) {
+    if (sweeps < 1 || skin <= 0 || step <= 0){
+        throw std::invalid_argument("Skin tuning requires sweeps >= 1, skin > 0 and step > 0");
+    }
+}
+
+// Measures the cost of the current skin and moves to the next one
+double skin_tuner::Update(long long total_sweeps, double total_seconds){
+    if (done) return best_skin;
+    if (start_sweeps < 0){
+        // Measurement starting after the rebuild with the new skin
+        start_sweeps = total_sweeps; start_seconds = total_seconds;
+        return skin;
+    }
+    if (total_sweeps - start_sweeps < sweeps) return skin;
+
+    double cost = (total_seconds - start_seconds)/(total_sweeps - start_sweeps);
+    bool improved = best_cost < 0 || cost < best_cost;
+    if (improved) {best_cost = cost; best_skin = skin;}
+    double next = best_skin + direction*step;
+    if (!improved || next > max_skin + 1e-9){
+        // Larger skins do not help: trying smaller ones once
+        if (direction < 0 || best_skin != initial) {done = true; return best_skin;}
+        direction = -1; next = best_skin - step;
+    }
+    if (next < min_skin - 1e-9) {done = true; return best_skin;}
+    skin = next; start_sweeps = -1;
+    return skin;
+}
+
+// Creates the stats file
+std::ofstream MakeStatsFile(std::string output){
+    std::ofstream log_stats(output);
+    log_stats << "t sweeps_per_s disp_acceptance flip_acceptance nl_rebuilds nl_interval mean_neighbours "
+              << "time_sweeps time_neighbours time_observables time_io skin volume_acceptance density swap_acceptance" << std::endl;
+    log_stats << std::scientific << std::setprecision(8);
+    return log_stats;
+}
@@ -0,0 +1,222 @@
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include "globals.hpp"
+#include "structure.hpp"
+
+// Universal constants
+const double pi = 3.14159265358979323846;
+
+// Sums (ar + i*ai)*(br + i*sign*bi) over [begin, end) with independent partial sums (vectorizable)
+void ComplexDot(const double* ar, const double* ai, const double* br, const double* bi, double sign,
+                int begin, int end, double& re, double& im){
+    double re4[4] = {0, 0, 0, 0}, im4[4] = {0, 0, 0, 0};
+    int i = begin;
+    for (; i + 4 <= end; i += 4){
+        for (int l = 0; l < 4; l++){
+            double b_im = sign*bi[i+l];
+            re4[l] += ar[i+l]*br[i+l] - ai[i+l]*b_im;
+            im4[l] += ar[i+l]*b_im + ai[i+l]*br[i+l];
+        }
+    }
+    re = (re4[0]+re4[1]) + (re4[2]+re4[3]); im = (im4[0]+im4[1]) + (im4[2]+im4[3]);
+    for (; i < end; i++){
+        double b_im = sign*bi[i];
+        re += ar[i]*br[i] - ai[i]*b_im; im += ar[i]*b_im + ai[i]*br[i];
+    }
+}
+
+// Shells of the requested wave-vectors
+std::vector<int> WaveVectorShells(int nmax, const std::vector<double>& q){
+    std::vector<int> shells;
+    if (q.empty()){
+        for (int n = 1; n <= nmax; n++) shells.push_back(n);
+    } else {
+        for (double value: q) shells.push_back(std::max(1L, lround(value*Size/(2*pi))));
+        std::sort(shells.begin(), shells.end());
+        shells.erase(std::unique(shells.begin(), shells.end()), shells.end());
+    }
+    return shells;
+}
+
+// Allocates the histograms and picks the wave-vectors of each shell
+structure_accumulator::structure_accumulator(double rmax, int bins, const std::vector<int>& shells, int max_modes)
+    : rmax(std::min(rmax, Size/2)), bins(bins), samples(0), shells(shells), gr(bins*(typePairs+1)), norm(typePairs+1),
+      sq(shells.size()*(typePairs+1)), qs(shells.size()), modes(shells.size()) {
+    if (max_modes < 0){
+        throw std::invalid_argument("The number of wave-vectors per shell cannot be negative");
+    }
+    std::vector<std::vector<int>> kept;
+    for (std::size_t k = 0; k < shells.size(); k++){
+        int n = shells[k];
+        if (n < 1){
+            throw std::invalid_argument("Shells of wave-vectors must be positive");
+        }
+        // Wave-vectors of the shell (half space since S(q) = S(-q))
+        std::vector<std::vector<int>> shell;
+        for (int nx = 0; nx <= n; nx++){
+            for (int ny = -n; ny <= n; ny++){
+                for (int nz = -n; nz <= n; nz++){
+                    if (nx == 0 && (ny < 0 || (ny == 0 && nz <= 0))) continue;
+                    if (lround(sqrt(nx*nx + ny*ny + nz*nz)) == n) shell.push_back({nx, ny, nz, int(k)});
+                }
+            }
+        }
+        // Evenly spaced subset, so that every direction of the shell stays represented
+        int count = shell.size(), keep = (max_modes > 0) ? std::min(count, max_modes) : count;
+        for (int m = 0; m < keep; m++) kept.push_back(shell[(long long)m*count/keep]);
+        modes[k] = keep;
+    }
+    // Sorted so that the products of the x and y phase factors are shared by consecutive wave-vectors
+    std::sort(kept.begin(), kept.end());
+    for (const std::vector<int>& v: kept){
+        vectors.insert(vectors.end(), v.begin(), v.begin()+3);
+        vector_shell.push_back(v[3]);
+    }
+}
+
+// Accumulates g(r) and S(q) of a configuration
+void structure_accumulator::Sample(const configuration& cfg){
+    double volume = Size*Size*Size;
+    int counts[3] = {0, 0, 0};
+    for (int i = 0; i < N; i++) counts[cfg.S[i]-1]++;
+
+    // Radial distribution functions
+    if (bins > 0){
+        double dr = rmax/bins, rmax2 = rmax*rmax;
+        auto add_pair = [&](int i, int j){
+            double xij = MinimumImageDistance(cfg.X[i], cfg.X[j]);
+            double yij = MinimumImageDistance(cfg.Y[i], cfg.Y[j]);
+            double zij = MinimumImageDistance(cfg.Z[i], cfg.Z[j]);
+            double rij2 = (xij*xij)+(yij*yij)+(zij*zij);
+            if (rij2 >= rmax2) return;
+            int bin = std::min(int(sqrt(rij2)/dr), bins-1);
+            gr[bin*(typePairs+1) + TypePair(cfg.S[i]-1, cfg.S[j]-1)] += 1;
+            gr[bin*(typePairs+1) + typePairs] += 1;
+        };
+        cell_list cells;
+        cells.Build(cfg, rmax);
+        if (cells.nc < 3){
+            for (int j = 0; j < N-1; j++)
+                for (int i = j+1; i < N; i++) add_pair(i, j);
+        } else {
+            for (int j = 0; j < N; j++){
+                int c = cells.cell[j];
+                int cx = c/(cells.nc*cells.nc), cy = (c/cells.nc)%cells.nc, cz = c%cells.nc;
+                for (int dx = -1; dx <= 1; dx++)
+                    for (int dy = -1; dy <= 1; dy++)
+                        for (int dz = -1; dz <= 1; dz++)
+                            for (int i = cells.head[cells.Index(cx+dx, cy+dy, cz+dz)]; i != -1; i = cells.next[i])
+                                if (i > j) add_pair(i, j);
+            }
+        }
+        for (int a = 0; a < 3; a++){
+            for (int b = a; b < 3; b++){
+                double pairs = (a == b) ? 0.5*counts[a]*(counts[a]-1) : double(counts[a])*counts[b];
+                norm[TypePair(a, b)] += pairs/volume;
+            }
+        }
+        norm[typePairs] += 0.5*double(N)*(N-1)/volume;
+    }
+
+    // Static structure factors
+    if (!vector_shell.empty()){
+        // Particles grouped by type so that densities are sums over contiguous ranges
+        int begin[4] = {0, counts[0], counts[0]+counts[1], N};
+        int fill[3] = {begin[0], begin[1], begin[2]};
+        std::vector<int> order(N);
+        for (int i = 0; i < N; i++) order[fill[cfg.S[i]-1]++] = i;
+
+        // Phase factors exp(i*2*pi*k*x/L) for k = 0...nmax, nmax being the largest shell, obtained by recurrence
+        int stride = N, nmax = shells.back();
+        std::vector<double> cx((nmax+1)*stride), sx((nmax+1)*stride);
+        std::vector<double> cy((nmax+1)*stride), sy((nmax+1)*stride);
+        std::vector<double> cz((nmax+1)*stride), sz((nmax+1)*stride);
+        const std::vector<real>* coords[3] = {&cfg.X, &cfg.Y, &cfg.Z};
+        std::vector<double>* cosines[3] = {&cx, &cy, &cz};
+        std::vector<double>* sines[3] = {&sx, &sy, &sz};
+        for (int d = 0; d < 3; d++){
+            std::vector<double>& c = *cosines[d];
+            std::vector<double>& s = *sines[d];
+            for (int p = 0; p < N; p++){
+                double angle = 2*pi*(*coords[d])[order[p]]/Size;
+                double c1 = cos(angle), s1 = sin(angle);
+                c[p] = 1; s[p] = 0;
+                for (int k = 1; k <= nmax; k++){
+                    c[k*stride+p] = c[(k-1)*stride+p]*c1 - s[(k-1)*stride+p]*s1;
+                    s[k*stride+p] = s[(k-1)*stride+p]*c1 + c[(k-1)*stride+p]*s1;
+                }
+            }
+        }
+
+        std::vector<double> pr(N), pim(N);
+        for (std::size_t v = 0; v < vector_shell.size(); v++){
+            int nx = vectors[3*v], ny = vectors[3*v+1], nz = vectors[3*v+2];
+            if (v == 0 || nx != vectors[3*v-3] || ny != vectors[3*v-2]){
+                // Products exp(i*qx*x)*exp(i*qy*y), shared by all nz
+                const double* ax = &cx[nx*stride]; const double* bx = &sx[nx*stride];
+                const double* ay = &cy[std::abs(ny)*stride]; const double* by = &sy[std::abs(ny)*stride];
+                double sign_y = (ny < 0) ? -1 : 1;
+                for (int p = 0; p < N; p++){
+                    pr[p] = ax[p]*ay[p] - bx[p]*sign_y*by[p];
+                    pim[p] = ax[p]*sign_y*by[p] + bx[p]*ay[p];
+                }
+            }
+            double re[3], im[3];
+            for (int a = 0; a < 3; a++){
+                ComplexDot(pr.data(), pim.data(), &cz[std::abs(nz)*stride], &sz[std::abs(nz)*stride],
+                           (nz < 0) ? -1 : 1, begin[a], begin[a+1], re[a], im[a]);
+            }
+            int shell = vector_shell[v];
+            double* row = &sq[shell*(typePairs+1)];
+            for (int a = 0; a < 3; a++)
+                for (int b = a; b < 3; b++)
+                    row[TypePair(a, b)] += (re[a]*re[b] + im[a]*im[b])/N;
+            double re_tot = re[0]+re[1]+re[2], im_tot = im[0]+im[1]+im[2];
+            row[typePairs] += (re_tot*re_tot + im_tot*im_tot)/N;
+            qs[shell] += 2*pi*sqrt(nx*nx + ny*ny + nz*nz)/Size;
+        }
+    }
+    samples++;
+}
+
+// Writes the averaged g(r) and S(q)
+void structure_accumulator::Write(std::string output_gr, std::string output_sq) const{
+    if (bins > 0){
+        std::ofstream log_gr(output_gr);
+        log_gr << "r gAA gAB gAC gBB gBC gCC g" << std::endl;
+        log_gr << std::scientific << std::setprecision(8);
+        double dr = rmax/bins;
+        for (int bin = 0; bin < bins; bin++){
+            double r_lo = bin*dr, r_hi = (bin+1)*dr;
+            double shell = 4*pi/3*(r_hi*r_hi*r_hi - r_lo*r_lo*r_lo);
+            log_gr << (bin+0.5)*dr;
+            for (int p = 0; p <= typePairs; p++){
+                double expected = norm[p]*shell;
+                log_gr << " " << ((expected > 0) ? gr[bin*(typePairs+1)+p]/expected : 0.);
+            } log_gr << std::endl;
+        }
+    }
+    if (!shells.empty()){
+        std::ofstream log_sq(output_sq);
+        log_sq << "q SAA SAB SAC SBB SBC SCC S" << std::endl;
+        log_sq << std::scientific << std::setprecision(8);
+        for (std::size_t shell = 0; shell < shells.size(); shell++){
+            double count = double(modes[shell])*samples;
+            if (count == 0) continue;
+            log_sq << qs[shell]/count;
+            for (int p = 0; p <= typePairs; p++){
+                log_sq << " " << sq[shell*(typePairs+1)+p]/count;
+            } log_sq << std::endl;
+        }
+    }
+}
+
+// Discards the accumulated samples
+void structure_accumulator::Reset(){
+    samples = 0;
+    std::fill(gr.begin(), gr.end(), 0.); std::fill(norm.begin(), norm.end(), 0.);
+    std::fill(sq.begin(), sq.end(), 0.); std::fill(qs.begin(), qs.end(), 0.);
+}
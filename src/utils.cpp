@@ -19,14 +19,33 @@ bool ParseCMDLine(int argc, const char* argv[],
                         std::string& input,
                         std::string& params,
                         std::vector<std::string>& observables) {
+    run_options opts;
+    return ParseCMDLine(argc, argv, input, params, observables, opts);
+}
+
+// Parse command line arguments and optional run settings
+bool ParseCMDLine(int argc, const char* argv[],
+                        std::string& input,
+                        std::string& params,
+                        std::vector<std::string>& observables,
+                        run_options& opts) {
     // Define the command-line options
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help,h", "Produce help message")
         ("init", po::value<std::string>(&input)->default_value(""), "Path to initial configuration file")
-        ("params", po::value<std::string>(&params)->required(), "Path to JSON file for simulation parameters")
+        ("params", po::value<std::string>(&params)->default_value(""), "Path to JSON file for simulation parameters")
         ("observables", po::value<std::vector<std::string>>(&observables)->multitoken(),
-                        "List of observables to compute (e.g., MSD Fs U; separated by spaces)");
+                        "List of observables to compute (e.g., MSD Fs U; separated by spaces)")
+        ("restart", po::bool_switch(&opts.restart), "Resume the run from the checkpoint stored in rootdir")
+        ("generate", po::bool_switch(&opts.generate), 
+                     "Start from a generated configuration (written to rootdir/init.xyz) instead of --init")
+        ("threads", po::value<int>(&opts.threads)->default_value(0), 
+                    "Number of threads of observables-only runs (0 for all cores, 1 per job with --manifest)")
+        ("manifest", po::value<std::string>(&opts.manifest)->default_value(""), 
+                     "Path to a JSON manifest of jobs to run instead of a single run")
+        ("jobs", po::value<int>(&opts.jobs)->default_value(0), 
+                 "Number of jobs of the manifest running at the same time (0 for all cores)");
 
     // Parse the command-line arguments
     po::variables_map vm;
@@ -44,6 +63,14 @@ bool ParseCMDLine(int argc, const char* argv[],
         std::cerr << "Error: " << ex.what() << std::endl;
         return false;
     }
+    if (params.empty() && opts.manifest.empty()) {
+        std::cerr << "Error: the option '--params' is required but missing" << std::endl;
+        return false;
+    }
+    if (opts.generate && !input.empty()) {
+        std::cerr << "Error: the options '--init' and '--generate' are exclusive" << std::endl;
+        return false;
+    }
 
     return true; // Successfully parsed arguments
 }
@@ -76,13 +103,75 @@ bool ReadJSONParams(const std::string& params_path,
     auto& obj = parsed_json.as_object();
     rootdir = obj["rootdir"].as_string().c_str();
     N = obj["N"].as_int64();
-    T = obj["T"].as_double();
+    T = obj["T"].to_number<double>();
     tau = obj["tau"].as_int64();
     tw = obj["tw"].as_int64();
     cycles = obj["cycles"].as_int64();
     logPoints = obj["logPoints"].as_int64();
     linPoints = obj["linPoints"].as_int64();
-    p_flip = obj["p_flip"].as_double();
+    p_flip = obj["p_flip"].to_number<double>(); // integers accepted (e.g. 0 for displacements only)
+
+    return true;
+}
+
+// Read optional run settings from JSON file
+bool ReadJSONOptions(const std::string& params_path, run_options& opts) {
+    std::ifstream json_file(params_path);
+
+    // Check if the file is open
+    if (!json_file.is_open()) {
+        std::cerr << "Error opening JSON file.\n";
+        return false;
+    }
+
+    // Read and parse the JSON file
+    std::stringstream buffer;
+    buffer << json_file.rdbuf();
+    json::value parsed_json = json::parse(buffer.str());
+
+    // Access optional JSON fields
+    auto& obj = parsed_json.as_object();
+    if (auto v = obj.if_contains("checkpoint_every")) opts.checkpoint_every = v->to_number<int>();
+    if (auto v = obj.if_contains("checkpoint_walltime")) opts.checkpoint_walltime = v->to_number<double>();
+    if (auto v = obj.if_contains("structure_every")) opts.structure_every = v->to_number<int>();
+    if (auto v = obj.if_contains("gr_rmax")) opts.gr_rmax = v->to_number<double>();
+    if (auto v = obj.if_contains("gr_bins")) opts.gr_bins = v->to_number<int>();
+    if (auto v = obj.if_contains("sq_nmax")) opts.sq_nmax = v->to_number<int>();
+    if (auto v = obj.if_contains("sq_q")){
+        opts.sq_q.clear();
+        for (const json::value& q: v->as_array()) opts.sq_q.push_back(q.to_number<double>());
+    }
+    if (auto v = obj.if_contains("sq_modes")) opts.sq_modes = v->to_number<int>();
+    if (auto v = obj.if_contains("overlap_a")) opts.overlap_a = v->to_number<double>();
+    if (auto v = obj.if_contains("correlator_every")) opts.correlator_every = v->to_number<int>();
+    if (auto v = obj.if_contains("correlator_p")) opts.correlator_p = v->to_number<int>();
+    if (auto v = obj.if_contains("correlator_m")) opts.correlator_m = v->to_number<int>();
+    if (auto v = obj.if_contains("correlator_q")) opts.correlator_q = v->to_number<double>();
+    if (auto v = obj.if_contains("stats_every")) opts.stats_every = v->to_number<int>();
+    if (auto v = obj.if_contains("sort_every")) opts.sort_every = v->to_number<int>();
+    if (auto v = obj.if_contains("equil_max_sweeps")) opts.equil_max_sweeps = v->to_number<int>();
+    if (auto v = obj.if_contains("equil_every")) opts.equil_every = v->to_number<int>();
+    if (auto v = obj.if_contains("equil_relaxations")) opts.equil_relaxations = v->to_number<int>();
+    if (auto v = obj.if_contains("equil_fs")) opts.equil_fs = v->to_number<double>();
+    if (auto v = obj.if_contains("skin")) opts.skin = v->to_number<double>();
+    if (auto v = obj.if_contains("skin_tune")) opts.skin_tune = v->to_number<int>();
+    if (auto v = obj.if_contains("obs_average")) opts.obs_average = v->as_bool();
+    if (auto v = obj.if_contains("obs_raw")) opts.obs_raw = v->as_bool();
+    if (auto v = obj.if_contains("obs_binary")) opts.obs_binary = v->as_bool();
+    if (auto v = obj.if_contains("live_every")) opts.live_every = v->to_number<int>();
+    if (auto v = obj.if_contains("pressure")) opts.pressure = v->to_number<double>();
+    if (auto v = obj.if_contains("volume_every")) opts.volume_every = v->to_number<int>();
+    if (auto v = obj.if_contains("volume_max")) opts.volume_max = v->to_number<double>();
+    if (auto v = obj.if_contains("step")) opts.step = v->to_number<double>();
+    if (auto v = obj.if_contains("swap_fraction")) opts.swap_fraction = v->to_number<double>();
+    if (auto v = obj.if_contains("swap_local")) opts.swap_local = v->as_bool();
+    if (auto v = obj.if_contains("flip_heat_bath")) opts.flip_heat_bath = v->as_bool();
+    if (auto v = obj.if_contains("histogram_every")) opts.histogram_every = v->to_number<int>();
+    if (auto v = obj.if_contains("histogram_width")) opts.histogram_width = v->to_number<double>();
+    if (auto v = obj.if_contains("histogram_observables")){
+        opts.histogram_observables.clear();
+        for (const json::value& name: v->as_array()) opts.histogram_observables.push_back(std::string(name.as_string()));
+    }
 
     return true;
 }
@@ -90,39 +179,50 @@ bool ReadJSONParams(const std::string& params_path,
 // Read trimer configs
 configuration ReadTrimCFG(std::string input){
     configuration C;
-    int type;
+    ReadTrimCFG(input, C);
+    return C;
+}
+
+// Read trimer configs into an existing configuration
+void ReadTrimCFG(std::string input, configuration& C){
     std::string line;
     std::ifstream input_file(input);
     if (!input_file.is_open()){
         throw std::runtime_error("Could not open file: " + input);
     }
     int i = 0; // particle index
-    std::vector<std::vector<double>> cfg; // array of configurations
-    while (std::getline(input_file, line)){
-        double value;
-        std::stringstream ss(line);
-
-        cfg.push_back(std::vector<double>());
-        while (ss >> value){
-            cfg[i].push_back(value);
+    double values[5]; // columns of the current line
+    std::vector<int> molecules = TrimerMolecules(); // trimers unless the MOL_INDEX column is given
+    while (std::getline(input_file, line) && i < N){
+        const char* start = line.c_str();
+        char* end;
+        int columns = 0;
+        while (columns < 5){
+            double value = strtod(start, &end);
+            if (end == start) break;
+            values[columns++] = value; start = end;
         }
-        // mol_index[i] = cfg[i][0];
-        // type = cfg[i][1]-1; 
-        // C.S[i] = (diameters[type]);
-        if (cfg[i].size() == 5){
-            C.S[i] = cfg[i][1];
-            C.Xfull[i] = cfg[i][2]; C.Yfull[i] = cfg[i][3]; C.Zfull[i] = cfg[i][4];
-        } else{
-            C.S[i] = cfg[i][0];
-            C.Xfull[i] = cfg[i][1]; C.Yfull[i] = cfg[i][2]; C.Zfull[i] = cfg[i][3];
+        if (columns == 0) continue;
+        if (columns < 4){
+            throw std::runtime_error("Invalid line " + std::to_string(i+1) + " of configuration file " + input + ": " + line);
         }
+        // MOL_INDEX column is optional
+        int first = (columns == 5) ? 1 : 0;
+        if (first) molecules[i] = values[0];
+        C.S[i] = values[first];
+        C.Xfull[i] = values[first+1]; C.Yfull[i] = values[first+2]; C.Zfull[i] = values[first+3];
         
         C.X[i] = ShiftInMainBox(C.Xfull[i]); C.X0[i] = C.X[i]; 
         C.Y[i] = ShiftInMainBox(C.Yfull[i]); C.Y0[i] = C.Y[i];
         C.Z[i] = ShiftInMainBox(C.Zfull[i]); C.Z0[i] = C.Z[i];
         i++;}
     input_file.close();
-    return C;
+    // A truncated snapshot would keep positions of the previous one in a reused buffer
+    if (i < N){
+        throw std::runtime_error("Configuration file " + input + " holds " + std::to_string(i) + " particles instead of " +
+                                 std::to_string(N));
+    }
+    C.SetMolecules(molecules);
 }
 
 // Write trimer configs
@@ -130,7 +230,29 @@ void WriteTrimCFG(const configuration& cfg, std::string output){
     std::ofstream log_cfg;
     log_cfg.open(output);
     log_cfg << std::scientific << std::setprecision(8);
+    bool trimers = cfg.Trimers();
     for (int i = 0; i<N; i++){
+        if (!trimers) log_cfg << cfg.molecule[i] << " ";
+        log_cfg << cfg.S[i] << " " << cfg.Xfull[i] << " " << cfg.Yfull[i] << " " << cfg.Zfull[i] << std::endl;
+    }
+    log_cfg.close();
+}
+
+// Write trimer configs in the original particles' order
+void WriteTrimCFG(const configuration& cfg, std::string output, const std::vector<int>& order){
+    if (order.empty()){
+        WriteTrimCFG(cfg, output);
+        return;
+    }
+    std::vector<int> slot(N);
+    for (int i = 0; i < N; i++) slot[order[i]] = i;
+    std::ofstream log_cfg;
+    log_cfg.open(output);
+    log_cfg << std::scientific << std::setprecision(8);
+    bool trimers = cfg.Trimers();
+    for (int k = 0; k<N; k++){
+        int i = slot[k];
+        if (!trimers) log_cfg << cfg.molecule[i] << " ";
         log_cfg << cfg.S[i] << " " << cfg.Xfull[i] << " " << cfg.Yfull[i] << " " << cfg.Zfull[i] << std::endl;
     }
     log_cfg.close();
@@ -158,28 +280,31 @@ void MakeOutDir(std::string rootdir, std::string params_path) {
 }
 
 // Create observables file
-std::ofstream MakeObsFile(std::vector <std::string>& observables, std::string output){
+std::ofstream MakeObsFile(const observables_set& observables, std::string output){
     std::ofstream log_obs; 
     log_obs.open(output);
     log_obs << "t" << " " << "cycle";
-    for (const std::string obs: observables){
-        log_obs << " " << obs;
+    for (const std::string& column: observables.Columns()){
+        log_obs << " " << column;
     } log_obs << std::endl;
     log_obs << std::scientific << std::setprecision(8);
     return log_obs;
 }
 
-// Write observables at specific timestep
-void WriteObs(const configuration& cfg, const configuration& cfg0, 
-              int t, int cycle, std::vector <std::string>& observables, 
-              std::ofstream& log_obs){
-    
+// Reopen observables file after a restart
+std::ofstream ReopenObsFile(std::string output, std::streamoff offset){
+    fs::resize_file(output, offset);
+    std::ofstream log_obs;
+    log_obs.open(output, std::ios::app);
+    log_obs << std::scientific << std::setprecision(8);
+    return log_obs;
+}
+
+// Write already computed observables at specific timestep
+void WriteObs(int t, int cycle, const std::vector <double>& values, std::ostream& log_obs){
     log_obs << t << " " << cycle;
-    for (std::string obs: observables){
-        log_obs << " ";
-        (obs == "U")   ? log_obs << VTotal(cfg)/(2*N) : 
-        (obs == "MSD") ? log_obs << MSD(cfg, cfg0) : 
-                         log_obs << FS(cfg, cfg0);
+    for (double value: values){
+        log_obs << " " << value;
     } log_obs << std::endl;
 }
 
@@ -1,8 +1,13 @@
-#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_RUNNER
 #include <catch2/catch.hpp>
 #include <cmath>
 #include "globals.hpp"
 
-// Globals that are normally defined in the main file
-int N = 3000;
-double Size = pow(N/density, 1/3.);
\ No newline at end of file
+// Globals that are normally defined in the main file (thread-local, hence constant initializers)
+__thread int N = 3000;
+__thread double Size = 0;
+
+int main(int argc, char* argv[]) {
+    Size = pow(N/density, 1/3.);
+    return Catch::Session().run(argc, argv);
+}
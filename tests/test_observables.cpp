@@ -5,6 +5,12 @@
 #include "particles.hpp"
 #include "observables.hpp"
 #include "utils.hpp"
+#include "structure.hpp"
+#include "correlator.hpp"
+#include "equilibration.hpp"
+#include "histogram.hpp"
+#include <random>
+#include <boost/filesystem.hpp>
 
 TEST_CASE("Test WCAPair function", "[test_observables][WCAPair]") {
     
@@ -45,6 +51,365 @@ TEST_CASE("Test WCAPair function", "[test_observables][WCAPair]") {
     }
 }
 
+TEST_CASE("Test static structure accumulator", "[test_observables][Structure]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    const double pi = 3.14159265358979323846;
+
+    SECTION("Check that g(r) counts every pair closer than the cutoff") {
+        double rmax = 3.0;
+        structure_accumulator structure(rmax, 60, {});
+        structure.Sample(cfg);
+
+        double counted = 0;
+        for (int bin = 0; bin < structure.bins; bin++) counted += structure.gr[bin*(typePairs+1) + typePairs];
+        double partials = 0;
+        for (size_t k = 0; k < structure.gr.size(); k++) 
+            if (int(k % (typePairs+1)) != typePairs) partials += structure.gr[k];
+
+        double expected = 0;
+        for (int j = 0; j < N-1; j++) {
+            for (int i = j+1; i < N; i++) {
+                double xij = MinimumImageDistance(cfg.X[i], cfg.X[j]);
+                double yij = MinimumImageDistance(cfg.Y[i], cfg.Y[j]);
+                double zij = MinimumImageDistance(cfg.Z[i], cfg.Z[j]);
+                if (xij*xij + yij*yij + zij*zij < rmax*rmax) expected += 1;
+            }
+        }
+        REQUIRE(counted == expected);
+        REQUIRE(partials == expected);
+    }
+
+    SECTION("Check that S(q) matches a direct evaluation on the first shell") {
+        structure_accumulator structure(3.0, 0, WaveVectorShells(1, {}));
+        structure.Sample(cfg);
+
+        double direct = 0; int modes = 0;
+        for (int nx = 0; nx <= 1; nx++) {
+            for (int ny = -1; ny <= 1; ny++) {
+                for (int nz = -1; nz <= 1; nz++) {
+                    if (nx == 0 && (ny < 0 || (ny == 0 && nz <= 0))) continue;
+                    int n2 = nx*nx + ny*ny + nz*nz;
+                    if (n2 > 2.25 || lround(sqrt(n2)) != 1) continue;
+                    double re = 0, im = 0;
+                    for (int i = 0; i < N; i++) {
+                        double phase = 2*pi*(nx*double(cfg.X[i]) + ny*double(cfg.Y[i]) + nz*double(cfg.Z[i]))/Size;
+                        re += cos(phase); im += sin(phase);
+                    }
+                    direct += (re*re + im*im)/N; modes++;
+                }
+            }
+        }
+        REQUIRE(structure.modes[0] == modes);
+        REQUIRE(structure.sq[typePairs]/modes == Approx(direct/modes).epsilon(1e-8));
+    }
+
+    SECTION("Check that only the requested shells are sampled, with at most max_modes wave-vectors") {
+        REQUIRE(WaveVectorShells(3, {}) == std::vector<int>{1, 2, 3});
+        double q7 = 7*2*pi/Size, q9 = 9*2*pi/Size;
+        REQUIRE(WaveVectorShells(3, {q9, q7, 1.05*q7, 1e-3}) == std::vector<int>{1, 7, 9});
+        REQUIRE_THROWS_AS(structure_accumulator(3.0, 0, {0}), std::invalid_argument);
+
+        structure_accumulator all(3.0, 0, {7});
+        structure_accumulator capped(3.0, 0, {7}, 50);
+        REQUIRE(all.modes[0] > 50);
+        REQUIRE(capped.modes[0] == 50);
+        REQUIRE(capped.vector_shell.size() == 50);
+        capped.Sample(cfg);
+
+        double direct = 0;
+        for (int v = 0; v < 50; v++) {
+            int nx = capped.vectors[3*v], ny = capped.vectors[3*v+1], nz = capped.vectors[3*v+2];
+            REQUIRE(lround(sqrt(nx*nx + ny*ny + nz*nz)) == 7);
+            double re = 0, im = 0;
+            for (int i = 0; i < N; i++) {
+                double phase = 2*pi*(nx*double(cfg.X[i]) + ny*double(cfg.Y[i]) + nz*double(cfg.Z[i]))/Size;
+                re += cos(phase); im += sin(phase);
+            }
+            direct += (re*re + im*im)/N;
+        }
+        REQUIRE(capped.sq[typePairs] == Approx(direct).epsilon(1e-8));
+    }
+}
+
+TEST_CASE("Test overlap function and susceptibility", "[test_observables][Overlap]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg0 = ReadTrimCFG(config_path);
+    cfg0.UpdateCM_coord();
+
+    SECTION("Check that the overlap counts the particles which did not move by more than a") {
+        configuration cfg = cfg0;
+        REQUIRE(Overlap(cfg, cfg0, 0.3) == Approx(1.0));
+        for (int i = 0; i < N; i += 4) cfg.Xfull[i] += 0.5;
+        cfg.UpdateCM_coord();
+        int moved = (N+3)/4;
+        // Center of mass correction shifts everybody by less than a
+        REQUIRE(Overlap(cfg, cfg0, 0.3) == Approx(double(N-moved)/N));
+    }
+
+    SECTION("Check that chi4 is the variance of the overlap over cycles") {
+        overlap_moments moments;
+        REQUIRE(moments.Add(10, 0.5) == Approx(0.0));
+        REQUIRE(moments.Add(20, 0.9) == Approx(0.0));
+        REQUIRE(moments.Add(10, 0.7) == Approx(N*0.01));
+    }
+}
+
+TEST_CASE("Test multiple-tau correlator", "[test_observables][Correlator]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg0 = ReadTrimCFG(config_path);
+    const double v = 0.01, q = 3.0;
+    const int p = 8, m = 2, every = 2, max_lag = 100, pushes = 200;
+
+    // Ballistic motion with a fixed center of mass
+    multi_tau_correlator correlator(p, m, every, max_lag, q);
+    REQUIRE(correlator.levels == 4);
+    configuration cfg = cfg0;
+    for (int k = 0; k < pushes; k++) {
+        for (int i = 0; i < N; i++) cfg.Xfull[i] = cfg0.Xfull[i] + (i%2 ? v : -v)*k*every;
+        cfg.UpdateCM_coord();
+        correlator.Push(cfg);
+    }
+
+    SECTION("Check that every lag is averaged over all time origins") {
+        long long stride = every;
+        for (int level = 0; level < correlator.levels; level++, stride *= m) {
+            for (int j = (level == 0 ? 1 : p/m); j < p; j++) {
+                double lag = j*stride;
+                REQUIRE(correlator.samples[level*p+j] == pushes/(stride/every) - j);
+                REQUIRE(correlator.msd[level*p+j]/correlator.samples[level*p+j] == Approx(v*v*lag*lag));
+                REQUIRE(correlator.fs[level*p+j]/correlator.samples[level*p+j] == Approx((cos(q*v*lag)+2)/3));
+            }
+        }
+    }
+
+    SECTION("Check that higher levels correlate decimated positions, exact for any motion") {
+        // Accelerated motion, whose block averages would not keep the displacements
+        const double a = 1e-4;
+        multi_tau_correlator accelerated(p, m, every, max_lag, q);
+        for (int k = 0; k < pushes; k++) {
+            for (int i = 0; i < N; i++) cfg.Xfull[i] = cfg0.Xfull[i] + (i%2 ? a : -a)*k*k;
+            cfg.UpdateCM_coord();
+            accelerated.Push(cfg);
+        }
+        int stride = 1;
+        for (int level = 0; level < accelerated.levels; level++, stride *= m) {
+            // Pushes k = stride*(s+1)-1 reach this level
+            int stored = pushes/stride;
+            for (int j = (level == 0 ? 1 : p/m); j < p; j++) {
+                double msd = 0, fs = 0;
+                for (int s = j; s < stored; s++) {
+                    double k1 = stride*(s+1)-1, k0 = stride*(s-j+1)-1;
+                    double d = a*(k1*k1 - k0*k0);
+                    msd += d*d; fs += (cos(q*d)+2)/3;
+                }
+                REQUIRE(accelerated.samples[level*p+j] == stored - j);
+                REQUIRE(accelerated.msd[level*p+j] == Approx(msd));
+                REQUIRE(accelerated.fs[level*p+j] == Approx(fs));
+            }
+        }
+    }
+
+    SECTION("Check that invalid block sizes are rejected") {
+        REQUIRE_THROWS_AS(multi_tau_correlator(15, 2, 1, 100, q), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Test integrated autocorrelation time", "[test_observables][Equilibration]") {
+    const double pi = 3.14159265358979323846;
+    const int n = 100000;
+    const double phi = 0.5;
+    generator.Seed(12345);
+
+    // Gaussian noise and AR(1) process x_k = phi*x_{k-1} + noise, whose tau is (1+phi)/(2(1-phi))
+    std::vector<double> noise(n), ar(n);
+    for (int k = 0; k < n; k++) {
+        double u1 = 1 - ranf(), u2 = ranf();
+        noise[k] = sqrt(-2*log(u1))*cos(2*pi*u2);
+        ar[k] = (k ? phi*ar[k-1] : 0) + noise[k];
+    }
+    REQUIRE(IntegratedAutocorrelationTime(noise, 0, n) == Approx(0.5).epsilon(0.1));
+    REQUIRE(IntegratedAutocorrelationTime(ar, 0, n) == Approx((1+phi)/(2*(1-phi))).epsilon(0.1));
+    // Constant series are uncorrelated
+    REQUIRE(IntegratedAutocorrelationTime(std::vector<double>(100, 1.), 0, 100) == 0.5);
+
+    SECTION("Check that invalid parameters are rejected") {
+        REQUIRE_THROWS_AS(equilibration_monitor(10, 10, 1.5), std::invalid_argument);
+        REQUIRE_THROWS_AS(equilibration_monitor(0, 10, 0.5), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Test observables registry", "[test_observables][Registry]") {
+    const double pi = 3.14159265358979323846;
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg0 = ReadTrimCFG(config_path);
+    cfg0.UpdateCM_coord();
+    configuration cfg = cfg0;
+    for (int i = 0; i < N; i++) {
+        cfg.Xfull[i] += 0.1*sin(i); cfg.Yfull[i] += 0.2*cos(3*i); cfg.Zfull[i] += 0.05*(i%7);
+    }
+    cfg.UpdateCM_coord();
+
+    SECTION("Check that unknown observables are rejected") {
+        REQUIRE_THROWS_AS(observables_set({"MSD", "Fz"}), std::invalid_argument);
+        REQUIRE_THROWS_AS(observables_set({"Fs:abc"}), std::invalid_argument);
+        observables_set obs({"U", "Q", "Fs:3.5"});
+        REQUIRE(obs.Columns() == std::vector<std::string>({"U", "Q", "chi4", "Fs:3.5"}));
+        REQUIRE(obs.RequiresNeighbours() == true);
+        REQUIRE(observables_set({"MSD", "Fs"}).RequiresNeighbours() == false);
+    }
+
+    SECTION("Check that the fused sweep reproduces the individual observables") {
+        observables_set obs({"MSD", "Fs", "Q", "MSD_A", "MSD_CM", "alpha2", "Fs:3.5"}, 0.3);
+        std::vector<double> values = obs.Compute(cfg, cfg0);
+        REQUIRE(values.size() == 7);
+        REQUIRE(values[0] == MSD(cfg, cfg0));
+        REQUIRE(values[1] == FS(cfg, cfg0));
+        REQUIRE(values[2] == Overlap(cfg, cfg0, 0.3));
+
+        double sumA = 0, sum2 = 0, sum4 = 0, sumCM = 0; int countA = 0;
+        for (int i = 0; i < N; i++) {
+            double dx = cfg.Xfull[i]-cfg0.Xfull[i]-(cfg.XCM-cfg0.XCM);
+            double dy = cfg.Yfull[i]-cfg0.Yfull[i]-(cfg.YCM-cfg0.YCM);
+            double dz = cfg.Zfull[i]-cfg0.Zfull[i]-(cfg.ZCM-cfg0.ZCM);
+            double dr2 = dx*dx + dy*dy + dz*dz;
+            sum2 += dr2; sum4 += dr2*dr2;
+            if (cfg0.S[i] == 1) {sumA += dr2; countA++;}
+        }
+        for (int m = 0; m < N; m += 3) {
+            double d[3] = {0, 0, 0};
+            for (int i = m; i < m+3; i++) {
+                d[0] += (cfg.Xfull[i]-cfg0.Xfull[i]-(cfg.XCM-cfg0.XCM))/3;
+                d[1] += (cfg.Yfull[i]-cfg0.Yfull[i]-(cfg.YCM-cfg0.YCM))/3;
+                d[2] += (cfg.Zfull[i]-cfg0.Zfull[i]-(cfg.ZCM-cfg0.ZCM))/3;
+            }
+            sumCM += d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+        }
+        REQUIRE(values[3] == Approx(sumA/countA));
+        REQUIRE(values[4] == Approx(sumCM/(N/3)));
+        REQUIRE(values[5] == Approx(3*(sum4/N)/(5*(sum2/N)*(sum2/N)) - 1));
+
+        double fs = 0;
+        for (int theta = 0; theta < 360; theta++) {
+            for (int i = 0; i < N; i++) {
+                double dx = cfg.Xfull[i]-cfg0.Xfull[i]-(cfg.XCM-cfg0.XCM);
+                double dy = cfg.Yfull[i]-cfg0.Yfull[i]-(cfg.YCM-cfg0.YCM);
+                fs += cos(3.5*(cos(theta*pi/180)*dx + sin(theta*pi/180)*dy));
+            }
+        }
+        REQUIRE(values[6] == Approx(fs/(360*N)));
+    }
+}
+
+TEST_CASE("Test virial pressure", "[test_observables][Pressure]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    cfg.UpdateNL(); cfg.GetBonds();
+    double U, U_scaled, W;
+
+    SECTION("Check that the single pass reproduces the energy of the current and scaled configurations") {
+        VTotalScaled(cfg, 1., U, U_scaled, W);
+        REQUIRE(U == Approx(VTotal(cfg)/2));
+        REQUIRE(U_scaled == Approx(U));
+
+        // Compressed box with its own neighbours lists
+        double size = Size, scale = 0.995;
+        VTotalScaled(cfg, scale, U, U_scaled, W);
+        configuration compressed = cfg;
+        compressed.Rescale(scale); Size *= scale;
+        compressed.UpdateNL();
+        double U_compressed = VTotal(compressed)/2;
+        Size = size;
+        REQUIRE(U_scaled == Approx(U_compressed));
+    }
+
+    SECTION("Check that the virial is minus the derivative of the energy with the length scale") {
+        double h = 1e-5, U_plus, U_minus;
+        VTotalScaled(cfg, 1+h, U, U_plus, W);
+        VTotalScaled(cfg, 1-h, U, U_minus, W);
+        REQUIRE(W == Approx(-(U_plus-U_minus)/(2*h)).epsilon(1e-4));
+
+        observables_set obs({"P", "rho"}, 0.3, 0.5);
+        REQUIRE(obs.RequiresNeighbours() == true);
+        std::vector<double> values = obs.Compute(cfg, cfg);
+        REQUIRE(values[0] == Approx((N*0.5 + W/3)/(Size*Size*Size)));
+        REQUIRE(values[1] == Approx(density));
+    }
+}
+
+TEST_CASE("Test energy histograms and reweighting", "[test_observables][Histogram]") {
+
+    SECTION("Check that samples are binned and read back with their sums") {
+        energy_histogram histogram(0.1, 2.0, 0, false, {"P", "rho"});
+        histogram.Sample(1.23, N/1.2, {3.0, 1.2});
+        histogram.Sample(1.27, N/1.2, {4.0, 1.2});
+        histogram.Sample(-0.05, N/1.2, {5.0, 1.2});
+        REQUIRE(histogram.keys == std::vector<long long>{-1, 12});
+        REQUIRE(histogram.Samples() == 3);
+        REQUIRE(histogram.sums[histogram.Stride()] == 2);
+        REQUIRE(histogram.sums[histogram.Stride()+1] == Approx(2.5));
+        // The kinetic part of the pressure is left out
+        REQUIRE(histogram.sums[histogram.Stride()+4] == Approx(7.0 - 2*1.2*2.0));
+
+        std::string out = std::string(PROJECT_ROOT_DIR) + "/tests/output/histogram/";
+        boost::filesystem::create_directories(out);
+        histogram.Write(out + "histogram.txt");
+        energy_histogram copy = ReadHistogram(out + "histogram.txt");
+        boost::filesystem::remove_all(out);
+        REQUIRE(copy.columns == histogram.columns);
+        REQUIRE(copy.keys == histogram.keys);
+        REQUIRE(copy.T == histogram.T);
+        REQUIRE(copy.particles == N);
+        for (size_t k = 0; k < copy.sums.size(); k++) REQUIRE(copy.sums[k] == Approx(histogram.sums[k]));
+    }
+
+    SECTION("Check that reweighting to the run temperature gives the sample means") {
+        energy_histogram histogram(0.01, 1.5, 0, false, {"P"});
+        double e = 0, P = 0;
+        for (int k = 0; k < 100; k++) {
+            histogram.Sample(2 + 0.003*k, N/1.2, {1 + 0.01*k});
+            e += (2 + 0.003*k)/100; P += (1 + 0.01*k)/100;
+        }
+        reweighted_averages averages = Reweight({histogram}, {1.5})[0];
+        REQUIRE(averages.energy == Approx(e));
+        REQUIRE(averages.values[0] == Approx(P));
+        REQUIRE(averages.effective_samples == Approx(100));
+    }
+
+    SECTION("Check that single and multiple histograms recover exact Boltzmann averages") {
+        // Density of states E^(k-1), whose canonical distribution is a Gamma distribution of mean k*T
+        const int particles = 100;
+        const double k = 150, width = 0.001;
+        std::mt19937 engine(12345);
+        std::vector<energy_histogram> runs;
+        for (double T: {1.0, 1.2}) {
+            energy_histogram histogram(width, T, 0, false, {});
+            histogram.particles = particles;
+            std::gamma_distribution<double> energy(k, T);
+            for (int s = 0; s < 200000; s++) histogram.Sample(energy(engine)/particles, 1, {});
+            runs.push_back(histogram);
+        }
+        std::vector<reweighted_averages> single = Reweight({runs[0]}, {1.0, 1.05});
+        REQUIRE(single[0].energy == Approx(k*1.0/particles).epsilon(0.002));
+        REQUIRE(single[1].energy == Approx(k*1.05/particles).epsilon(0.005));
+        REQUIRE(single[1].heat_capacity == Approx(k/particles).epsilon(0.05));
+        REQUIRE(single[1].effective_samples < single[0].effective_samples);
+
+        std::vector<reweighted_averages> multiple = Reweight(runs, {1.1});
+        REQUIRE(multiple[0].energy == Approx(k*1.1/particles).epsilon(0.003));
+        REQUIRE(multiple[0].heat_capacity == Approx(k/particles).epsilon(0.05));
+    }
+
+    SECTION("Check that histograms which cannot be combined are rejected") {
+        energy_histogram a(0.01, 1.0, 0, false, {"P"}), b(0.02, 1.0, 0, false, {"P"});
+        a.Sample(1, 1, {0}); b.Sample(1, 1, {0});
+        REQUIRE_THROWS_AS(Reweight({a, b}, {1.0}), std::invalid_argument);
+        REQUIRE_THROWS_AS(Reweight({energy_histogram(0.01, 1.0, 0, false, {})}, {1.0}), std::invalid_argument);
+        REQUIRE_THROWS_AS(Reweight({a}, {-1.0}), std::invalid_argument);
+        REQUIRE_THROWS_AS(energy_histogram(0, 1.0, 0, false, {}), std::invalid_argument);
+    }
+}
+
 // TEST_CASE("Test FENEPair function", "[FENEPair]") {
 //     double result = FENEPair(0.0, 0.0, 0.0, 1.0, 1.0, 1.0, 1.0, 1.0);
 //     REQUIRE(result == Approx(expected_value)); // Replace expected_value with the correct value
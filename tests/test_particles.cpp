@@ -2,6 +2,14 @@
 #include "globals.hpp"
 #include "particles.hpp"
 #include "utils.hpp"
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
 
 // Reference configuration
 // std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
@@ -32,6 +40,155 @@ TEST_CASE("Test ShiftInMainBox function", "[test_particles][ShiftInMainBox]") {
     
 }
 
+// Test the UpdateNL method
+TEST_CASE("Test UpdateNL method", "[test_particles][UpdateNL]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    cfg.UpdateNL();
+
+    // Brute-force verlet lists, sorted by construction
+    double radius = pow(2., 1./6.)*sigmaMax + 0.7;
+    for (int j = 0; j < N; j += 97) {
+        std::vector<int> expected;
+        for (int i = 0; i < N; i++) {
+            double xij = MinimumImageDistance(cfg.X[i], cfg.X[j]);
+            double yij = MinimumImageDistance(cfg.Y[i], cfg.Y[j]);
+            double zij = MinimumImageDistance(cfg.Z[i], cfg.Z[j]);
+            if (i != j && xij*xij + yij*yij + zij*zij < radius*radius) expected.push_back(i);
+        }
+        REQUIRE(cfg.neighbours_list[j] == expected);
+    }
+}
+
+TEST_CASE("Test spatial sorting of molecules", "[test_particles][MortonOrder]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg0 = ReadTrimCFG(config_path);
+    cfg0.GetBonds(); cfg0.UpdateNL();
+    std::vector<int> perm = MortonOrder(cfg0);
+
+    SECTION("Check that molecules stay contiguous") {
+        std::vector<int> seen(N, 0);
+        for (int i = 0; i < N; i++) {
+            seen[perm[i]]++;
+            REQUIRE(perm[i] == perm[i - i%3] + i%3);
+        }
+        REQUIRE(std::count(seen.begin(), seen.end(), 1) == N);
+    }
+
+    SECTION("Check that reordering relabels particles and neighbours consistently") {
+        configuration cfg = cfg0;
+        cfg.Permute(perm);
+        long long span0 = 0, span = 0;
+        for (int i = 0; i < N; i++) {
+            REQUIRE(cfg.Xfull[i] == cfg0.Xfull[perm[i]]);
+            REQUIRE(cfg.S[i] == cfg0.S[perm[i]]);
+            std::vector<int> expected;
+            for (int k: cfg.neighbours_list[i]) expected.push_back(perm[k]);
+            std::sort(expected.begin(), expected.end());
+            REQUIRE(expected == cfg0.neighbours_list[perm[i]]);
+            for (int k: cfg0.neighbours_list[i]) span0 += std::abs(k - i);
+            for (int k: cfg.neighbours_list[i]) span += std::abs(k - i);
+        }
+        // Neighbours end up closer in memory
+        REQUIRE(span < span0);
+    }
+}
+
+TEST_CASE("Test molecules and bonds", "[test_particles][Topology]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    std::string out = std::string(PROJECT_ROOT_DIR) + "/tests/output/topology/";
+    std::string chains_path = out + "chains.xyz";
+    boost::filesystem::create_directories(out);
+    configuration trimers = ReadTrimCFG(config_path);
+    // Molecules of 2, 5, 1, 3 and 4 particles
+    const int sizes[5] = {2, 5, 1, 3, 4};
+    std::vector<int> molecules(N), first;
+    for (int i = 0, m = 0; i < N; m++) {
+        first.push_back(i);
+        for (int r = 0; r < sizes[m%5] && i < N; r++, i++) molecules[i] = 10*m + 7;
+    }
+    {
+        std::ofstream chains(chains_path);
+        for (int i = 0; i < N; i++) {
+            chains << molecules[i] << " " << trimers.S[i] << " " << trimers.Xfull[i] << " " << trimers.Yfull[i] << " " << trimers.Zfull[i] << std::endl;
+        }
+    }
+    configuration cfg = ReadTrimCFG(chains_path);
+    std::remove(chains_path.c_str());
+
+    SECTION("Check that files without MOL_INDEX hold trimers") {
+        std::string plain_path = out + "plain.xyz";
+        {
+            std::ofstream plain(plain_path);
+            for (int i = 0; i < N; i++) {
+                plain << trimers.S[i] << " " << trimers.Xfull[i] << " " << trimers.Yfull[i] << " " << trimers.Zfull[i] << std::endl;
+            }
+        }
+        configuration plain = ReadTrimCFG(plain_path);
+        std::remove(plain_path.c_str());
+        REQUIRE(plain.Trimers());
+        REQUIRE(plain.Molecules() == N/3);
+        REQUIRE(plain.S == trimers.S);
+        for (int i = 0; i < N; i++) {
+            std::vector<int> expected;
+            for (int k = i - i%3; k < i - i%3 + 3; k++) if (k != i) expected.push_back(k);
+            REQUIRE(std::vector<int>(plain.bond_partner.begin() + plain.bond_start[i],
+                                     plain.bond_partner.begin() + plain.bond_start[i+1]) == expected);
+        }
+        REQUIRE(trimers.bond_partner == plain.bond_partner);
+    }
+
+    SECTION("Check that MOL_INDEX groups particles into fully bonded trimers and chains") {
+        REQUIRE(!cfg.Trimers());
+        REQUIRE(cfg.Molecules() == (int)first.size());
+        REQUIRE(cfg.bond_start[N] == (int)cfg.bond_partner.size());
+        for (int m = 0; m < cfg.Molecules(); m++) {
+            REQUIRE(cfg.mol_start[m] == first[m]);
+            int size = cfg.mol_start[m+1] - cfg.mol_start[m];
+            for (int i = cfg.mol_start[m]; i < cfg.mol_start[m+1]; i++) {
+                REQUIRE(cfg.molecule[i] == m);
+                int bonds = cfg.bond_start[i+1] - cfg.bond_start[i];
+                bool end = (i == cfg.mol_start[m] || i+1 == cfg.mol_start[m+1]);
+                REQUIRE(bonds == (size <= 3 ? size-1 : (end ? 1 : 2)));
+                for (int b = cfg.bond_start[i]; b < cfg.bond_start[i+1]; b++) {
+                    int k = cfg.bond_partner[b];
+                    REQUIRE(cfg.molecule[k] == m);
+                    REQUIRE((size <= 3 || std::abs(k - i) == 1));
+                }
+            }
+        }
+    }
+
+    SECTION("Check that molecules survive writing and sorting") {
+        WriteTrimCFG(cfg, chains_path);
+        configuration copy = ReadTrimCFG(chains_path);
+        std::remove(chains_path.c_str());
+        REQUIRE(copy.molecule == cfg.molecule);
+        REQUIRE(copy.bond_partner == cfg.bond_partner);
+
+        cfg.UpdateNL();
+        std::vector<int> perm = MortonOrder(cfg);
+        configuration sorted = cfg;
+        sorted.Permute(perm);
+        REQUIRE(sorted.Molecules() == cfg.Molecules());
+        for (int i = 0; i < N; i++) {
+            REQUIRE(sorted.S[i] == cfg.S[perm[i]]);
+            std::vector<int> expected;
+            for (int b = sorted.bond_start[i]; b < sorted.bond_start[i+1]; b++) expected.push_back(perm[sorted.bond_partner[b]]);
+            REQUIRE(expected == std::vector<int>(cfg.bond_partner.begin() + cfg.bond_start[perm[i]],
+                                                 cfg.bond_partner.begin() + cfg.bond_start[perm[i]+1]));
+        }
+    }
+
+    SECTION("Check that molecules which are not contiguous are rejected") {
+        std::vector<int> split = molecules;
+        std::swap(split[0], split[2]);
+        REQUIRE_THROWS_AS(cfg.SetMolecules(split), std::invalid_argument);
+        REQUIRE_THROWS_AS(cfg.SetMolecules(std::vector<int>(N-1, 0)), std::invalid_argument);
+    }
+    boost::filesystem::remove_all(out);
+}
+
 // Test the UpdateCM_coord method
 // TEST_CASE("Test UpdateCM_coord method", "[test_particles][UpdateCM_coord]") {
 //     configuration cfg;
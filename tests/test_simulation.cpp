@@ -1,11 +1,22 @@
 #include <catch2/catch.hpp>
 #include <string>
 #include <vector>
+#include <map>
 #include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 #include <boost/filesystem.hpp>
 #include "globals.hpp"
 #include "utils.hpp"
 #include "simulation.hpp"
+#include "observables.hpp"
+#include "manifest.hpp"
+#include "generator.hpp"
+#include "live.hpp"
+#include "npy.hpp"
 
 namespace fs = boost::filesystem;
 
@@ -39,6 +50,70 @@ bool AreFilesIdentical(const std::string& file1, const std::string& file2) {
     return true; // Files are identical
 }
 
+// Function to read the numerical rows of an observables file
+std::vector<std::vector<double>> ReadObsTable(const std::string& file) {
+    std::ifstream f(file);
+    std::string line;
+    std::vector<std::vector<double>> rows;
+    std::getline(f, line); // header
+    while (std::getline(f, line)) {
+        std::stringstream ss(line);
+        std::vector<double> row;
+        double value;
+        while (ss >> value) row.push_back(value);
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+// Function to read the rows of a binary observables file, returning its header
+std::string ReadNpyTable(const std::string& file, std::vector<std::vector<double>>& rows) {
+    std::ifstream f(file, std::ios::binary);
+    char prefix[10];
+    f.read(prefix, 10);
+    int length = (unsigned char)prefix[8] + 256*(unsigned char)prefix[9];
+    std::string header(length, ' ');
+    f.read(&header[0], length);
+    size_t shape = header.find("'shape': (");
+    long long count = std::stoll(header.substr(shape + 10));
+    int columns = std::count(header.begin(), header.end(), '(') - 1; // fields, besides the shape
+    rows.clear();
+    for (long long k = 0; k < count; k++) {
+        int64_t integers[2];
+        std::vector<double> row(columns);
+        f.read(reinterpret_cast<char*>(integers), sizeof(integers));
+        f.read(reinterpret_cast<char*>(&row[2]), (columns-2)*sizeof(double));
+        row[0] = integers[0]; row[1] = integers[1];
+        rows.push_back(row);
+    }
+    return header;
+}
+
+// Function to count the lines of a file containing a pattern
+int CountLines(const std::string& file, const std::string& pattern) {
+    std::ifstream f(file);
+    std::string line;
+    int count = 0;
+    while (std::getline(f, line)) {
+        if (line.find(pattern) != std::string::npos) count++;
+    }
+    return count;
+}
+
+// Function to run MC sweeps on a configuration of any precision, returning the acceptance rate
+template <typename Real>
+double RunSweeps(basic_configuration<Real>& cfg, double T, double p_flip, int sweeps) {
+    long long accepted = 0;
+    for (int t = 0; t < sweeps; t++) {
+        cfg.CheckNL();
+        for (int i = 0; i < N; i++) {
+            if (ranf() > p_flip) accepted += TryDisp(cfg, floor(ranf()*N), T);
+            else accepted += TryFlip(cfg, floor(ranf()*N), T);
+        }
+    }
+    return double(accepted)/(double(sweeps)*N);
+}
+
 TEST_CASE("Test Monte Carlo Run", "[test_simulation][MonteCarloRun]") {
     // Reference configuration
     std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
@@ -61,7 +136,7 @@ TEST_CASE("Test Monte Carlo Run", "[test_simulation][MonteCarloRun]") {
     );
 
     int seed = 12345; // Specific seed for reproducibility
-    srand(seed);
+    generator.Seed(seed);
 
     // Making the out directory
     MakeOutDir(out, params_path);
@@ -70,6 +145,8 @@ TEST_CASE("Test Monte Carlo Run", "[test_simulation][MonteCarloRun]") {
     bool progress_bar = false;
     MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, progress_bar);
 
+    // The reference trajectory was produced by a double precision build
+#ifndef TFMC_MIXED_PRECISION
     SECTION("Check if the dynamics is correct") {
         std::string last_cfg = out + "configs/cfg_500.xy";
         std::string ref_cfg = std::string(PROJECT_ROOT_DIR) + "/tests/reference/cfg_500.xy";
@@ -81,7 +158,1054 @@ TEST_CASE("Test Monte Carlo Run", "[test_simulation][MonteCarloRun]") {
         std::string ref_obs = std::string(PROJECT_ROOT_DIR) + "/tests/reference/obs.txt";
         REQUIRE(AreFilesIdentical(obs, ref_obs)==true);
     }
+#endif
+
+    // Cleanup: Remove the output directory
+    fs::remove_all(out);
+}
+
+TEST_CASE("Test checkpoint and restart", "[test_simulation][Checkpoint]") {
+    // Reference configuration
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+
+    // Params 
+    double T;
+    int tau;
+    int cycles;
+    int tw;
+    double p_flip;
+    std::vector<std::string> observables = {"U", "MSD", "Fs"};
+    std::string out;
+    int n_log;
+    int n_lin;
+    std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+
+    ReadJSONParams(
+        params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip
+    );
+    generator.Seed(12345);
+    MakeOutDir(out, params_path);
+
+    // Checkpointing must not perturb the run
+    run_options opts;
+    opts.checkpoint_every = 150;
+    opts.correlator_every = 10;
+    opts.stats_every = 100;
+    opts.obs_average = true;
+    opts.obs_binary = true;
+    opts.histogram_every = 10;
+    opts.histogram_observables = {"P"};
+    MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+    std::string correlator = out + "correlator.txt";
+    std::string ref_correlator = out + "correlator_ref.txt";
+    fs::copy_file(correlator, ref_correlator);
+    REQUIRE(CountLines(correlator, "lag MSD Fs_axes samples") == 1);
+    std::string averages = out + "obs_avg.txt";
+    std::string ref_averages = out + "obs_avg_ref.txt";
+    fs::copy_file(averages, ref_averages);
+    std::string binary = out + "obs.npy";
+    std::string ref_binary = out + "obs_ref.npy";
+    fs::copy_file(binary, ref_binary);
+    std::string histogram = out + "histogram.txt";
+    std::string ref_histogram = out + "histogram_ref.txt";
+    fs::copy_file(histogram, ref_histogram);
+    REQUIRE(ReadHistogram(histogram).Samples() == 50);
+    std::string stats = out + "stats.txt";
+    std::vector<std::vector<double>> rows = ReadObsTable(stats);
+    REQUIRE(rows.size() == 5);
+    REQUIRE(rows[4][0] == 500);
+    REQUIRE((rows[4][2] > 0 && rows[4][2] < 1)); // displacements acceptance
+    REQUIRE(CountLines(out + "stats.json", "\"sweeps\": 500,") == 1);
+
+    std::string last_cfg = out + "configs/cfg_500.xy";
+    std::string ref_cfg = out + "cfg_500_ref.xy";
+    std::string obs = out + "obs.txt";
+    std::string ref_obs = out + "obs_ref.txt";
+    fs::copy_file(last_cfg, ref_cfg);
+    fs::copy_file(obs, ref_obs);
+#ifndef TFMC_MIXED_PRECISION
+    REQUIRE(AreFilesIdentical(last_cfg, std::string(PROJECT_ROOT_DIR) + "/tests/reference/cfg_500.xy")==true);
+    REQUIRE(AreFilesIdentical(obs, std::string(PROJECT_ROOT_DIR) + "/tests/reference/obs.txt")==true);
+#endif
+
+    // Restarting from the last checkpoint (sweep 451) reproduces the end of the run
+    fs::remove(last_cfg);
+    run_options restart;
+    restart.restart = true;
+    restart.correlator_every = 10;
+    restart.stats_every = 100;
+    restart.obs_average = true;
+    restart.obs_binary = true;
+    restart.histogram_every = 10;
+    restart.histogram_observables = {"P"};
+    configuration cfg_restart;
+    generator.Seed(0); // the checkpoint restores the generator
+    MonteCarloRun(cfg_restart, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, restart);
+
+    REQUIRE(AreFilesIdentical(last_cfg, ref_cfg)==true);
+    REQUIRE(AreFilesIdentical(obs, ref_obs)==true);
+    REQUIRE(AreFilesIdentical(correlator, ref_correlator)==true);
+    REQUIRE(AreFilesIdentical(averages, ref_averages)==true);
+    REQUIRE(AreFilesIdentical(binary, ref_binary)==true);
+    REQUIRE(AreFilesIdentical(histogram, ref_histogram)==true);
+    // Rows written after the checkpoint are replaced and the totals include the resumed sweeps
+    REQUIRE(ReadObsTable(stats).size() == 5);
+    REQUIRE(CountLines(out + "stats.json", "\"sweeps\": 500,") == 1);
+
+    // Histograms are not resumed in another ensemble or with other bins or observables
+    run_options other_width = restart;
+    other_width.histogram_width = 0.002;
+    REQUIRE_THROWS_WITH(MonteCarloRun(cfg_restart, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, other_width),
+                        "Energy histogram settings differ from the checkpoint");
+    REQUIRE_THROWS_WITH(MonteCarloRun(cfg_restart, 2*T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, restart),
+                        "Energy histogram settings differ from the checkpoint");
+    run_options isobaric = restart;
+    isobaric.volume_every = 2; isobaric.pressure = 10;
+    REQUIRE_THROWS_WITH(MonteCarloRun(cfg_restart, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, isobaric),
+                        "Energy histogram settings differ from the checkpoint");
+    run_options other_observables = restart;
+    other_observables.histogram_observables = {"rho"};
+    REQUIRE_THROWS_WITH(MonteCarloRun(cfg_restart, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, other_observables),
+                        "Energy histogram settings differ from the checkpoint");
+
+    // Cleanup: Remove the output directory
+    fs::remove_all(out);
+}
+
+TEST_CASE("Test spatial sorting during a run", "[test_simulation][MortonOrder]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg0 = ReadTrimCFG(config_path);
+    configuration cfg = cfg0;
+
+    // Params 
+    double T;
+    int tau;
+    int cycles;
+    int tw;
+    double p_flip;
+    std::vector<std::string> observables = {"MSD"};
+    std::string out;
+    int n_log;
+    int n_lin;
+    std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+
+    ReadJSONParams(
+        params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip
+    );
+    generator.Seed(12345);
+    MakeOutDir(out, params_path);
+
+    run_options opts;
+    opts.sort_every = 1;
+    MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+
+    // Written configurations (taken one sweep before the end) and the final one are back in the original order
+    configuration last = ReadTrimCFG(out + "configs/cfg_500.xy");
+    for (int i = 0; i < N; i++) {
+        REQUIRE(std::abs(cfg.Xfull[i] - last.Xfull[i]) < 0.5);
+        REQUIRE(std::abs(last.Xfull[i] - cfg0.Xfull[i]) < 2.0);
+        // Particles of a molecule stay bonded
+        if (i%3 > 0) {
+            double dx = MinimumImageDistance(last.X[i], last.X[i-1]);
+            double dy = MinimumImageDistance(last.Y[i], last.Y[i-1]);
+            double dz = MinimumImageDistance(last.Z[i], last.Z[i-1]);
+            REQUIRE(dx*dx + dy*dy + dz*dz < 1.5*1.5*sigmaMax*sigmaMax);
+        }
+    }
+    std::vector<std::vector<double>> rows = ReadObsTable(out + "obs.txt");
+    configuration logged = ReadTrimCFG(out + "configs/cfg_" + std::to_string(int(rows.back()[0])) + ".xy");
+    logged.UpdateCM_coord(); cfg0.UpdateCM_coord();
+    REQUIRE(rows.back()[2] == Approx(MSD(logged, cfg0)).epsilon(1e-6));
 
     // Cleanup: Remove the output directory
     fs::remove_all(out);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Test equilibration detection", "[test_simulation][Equilibration]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+
+    // Params 
+    double T;
+    int tau;
+    int cycles;
+    int tw;
+    double p_flip;
+    std::vector<std::string> observables = {"U", "MSD"};
+    std::string out;
+    int n_log;
+    int n_lin;
+    std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+
+    ReadJSONParams(
+        params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip
+    );
+    generator.Seed(12345);
+    MakeOutDir(out, params_path);
+
+    // Short relaxations (Fs = 0.9) and a run too short to be checkpointed, so that the last checkpoint falls in the equilibration
+    run_options opts;
+    opts.equil_max_sweeps = 2000;
+    opts.equil_every = 5;
+    opts.equil_relaxations = 3;
+    opts.equil_fs = 0.9;
+    opts.checkpoint_every = 50;
+    tau = 20;
+    MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+
+    REQUIRE(CountLines(out + "equilibration.json", "\"equilibrated\": true,") == 1);
+    std::vector<std::vector<double>> series = ReadObsTable(out + "equilibration.txt");
+    int relaxations = 0;
+    for (const std::vector<double>& row: series) relaxations += (row[2] < opts.equil_fs);
+    REQUIRE(relaxations >= opts.equil_relaxations);
+    REQUIRE(series.back()[0] < opts.equil_max_sweeps);
+    // The run starts from the equilibrated configuration
+    configuration equilibrated = ReadTrimCFG(out + "equilibrated.xy");
+    equilibrated.UpdateNL(); equilibrated.GetBonds();
+    std::vector<std::vector<double>> rows = ReadObsTable(out + "obs.txt");
+    REQUIRE(rows[0][0] == 1);
+    REQUIRE(rows[0][2] == Approx(VTotal(equilibrated)/(2*N)).epsilon(1e-6));
+
+    // Restarting in the middle of the equilibration reproduces it and the run
+    std::string ref_equilibrated = out + "equilibrated_ref.xy", ref_obs = out + "obs_ref.txt";
+    fs::copy_file(out + "equilibrated.xy", ref_equilibrated);
+    fs::copy_file(out + "obs.txt", ref_obs);
+    fs::remove(out + "equilibrated.xy");
+    run_options restart = opts;
+    restart.restart = true;
+    configuration cfg_restart;
+    generator.Seed(0); // the checkpoint restores the generator
+    MonteCarloRun(cfg_restart, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, restart);
+    REQUIRE(AreFilesIdentical(out + "equilibrated.xy", ref_equilibrated)==true);
+    REQUIRE(AreFilesIdentical(out + "obs.txt", ref_obs)==true);
+
+    // Cleanup: Remove the output directory
+    fs::remove_all(out);
+}
+
+TEST_CASE("Test single precision sweeps", "[test_simulation][Precision]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    basic_configuration<double> cfg_double(ReadTrimCFG(config_path));
+    cfg_double.UpdateNL(); cfg_double.GetBonds();
+    basic_configuration<float> cfg_float(cfg_double);
+    double T = 2.0, p_flip = 0.2;
+    int sweeps = 200;
+
+    // Same configuration, energies evaluated from float positions but accumulated in double
+    double U0 = VTotal(cfg_double)/(2*N);
+    REQUIRE(VTotal(cfg_float)/(2*N) == Approx(U0).epsilon(1e-5));
+
+    // Trajectories diverge, but acceptance and energy must stay within tolerance of the double run
+    generator.Seed(12345);
+    double acc_double = RunSweeps(cfg_double, T, p_flip, sweeps);
+    generator.Seed(12345);
+    double acc_float = RunSweeps(cfg_float, T, p_flip, sweeps);
+    REQUIRE(std::abs(acc_float - acc_double) < 0.01);
+    double U_double = VTotal(cfg_double)/(2*N), U_float = VTotal(cfg_float)/(2*N);
+    REQUIRE(U_float == Approx(U_double).epsilon(0.01));
+
+    // No drift between the float energy and the double evaluation of the same positions
+    basic_configuration<double> promoted(cfg_float);
+    REQUIRE(VTotal(promoted)/(2*N) == Approx(U_float).epsilon(1e-5));
+    // Unwrapped positions stay consistent with the wrapped ones
+    for (int i = 0; i < N; i++) {
+        REQUIRE(std::abs(MinimumImageDistance(ShiftInMainBox(cfg_float.Xfull[i]), double(cfg_float.X[i]))) < 1e-3);
+    }
+}
+
+TEST_CASE("Test sweep kernels", "[test_simulation][Sweep]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    cfg.UpdateNL(); cfg.GetBonds();
+    configuration cfg_ref = cfg;
+    double T = 2.0;
+    int sweeps = 20;
+
+    // Kernels are selected from p_flip
+    REQUIRE(SelectSweep(0.0) == &Sweep<displacement_moves>);
+    REQUIRE(SelectSweep(1.0) == &Sweep<flip_moves>);
+    REQUIRE(SelectSweep(0.2) == &Sweep<mixed_moves>);
+    REQUIRE_THROWS_AS(SelectSweep(1.5), std::invalid_argument);
+
+    SECTION("Check if the mixed kernel follows the generic loop") {
+        run_stats stats;
+        generator.Seed(12345);
+        for (int t = 0; t < sweeps; t++) {cfg.CheckNL(); Sweep<mixed_moves>(cfg, T, 0.2, stats);}
+        generator.Seed(12345);
+        double acceptance = RunSweeps(cfg_ref, T, 0.2, sweeps);
+        REQUIRE(cfg.X == cfg_ref.X);
+        REQUIRE(cfg.Xfull == cfg_ref.Xfull);
+        REQUIRE(cfg.S == cfg_ref.S);
+        REQUIRE(stats.sweeps == sweeps);
+        REQUIRE(stats.disp_trials + stats.flip_trials == (long long)sweeps*N);
+        REQUIRE(double(stats.disp_accepted + stats.flip_accepted)/(sweeps*N) == Approx(acceptance));
+    }
+
+    SECTION("Check if the displacement kernel only draws displacements") {
+        run_stats stats;
+        generator.Seed(12345);
+        for (int t = 0; t < sweeps; t++) {cfg.CheckNL(); Sweep<displacement_moves>(cfg, T, 0, stats);}
+        generator.Seed(12345);
+        long long accepted = 0;
+        for (int t = 0; t < sweeps; t++) {
+            cfg_ref.CheckNL();
+            for (int i = 0; i < N; i++) accepted += TryDisp(cfg_ref, floor(ranf()*N), T);
+        }
+        REQUIRE(cfg.X == cfg_ref.X);
+        REQUIRE(cfg.Zfull == cfg_ref.Zfull);
+        REQUIRE(cfg.S == cfg_ref.S);
+        REQUIRE(stats.disp_trials == (long long)sweeps*N);
+        REQUIRE(stats.disp_accepted == accepted);
+        REQUIRE(stats.flip_trials == 0);
+    }
+
+    SECTION("Check if smaller trial displacements are accepted more often") {
+        run_stats stats, stats_small;
+        generator.Seed(12345);
+        for (int t = 0; t < sweeps; t++) {cfg.CheckNL(); Sweep<displacement_moves>(cfg, T, 0, stats);}
+        maximum_displacement = 0.05;
+        generator.Seed(12345);
+        for (int t = 0; t < sweeps; t++) {cfg_ref.CheckNL(); Sweep<displacement_moves>(cfg_ref, T, 0, stats_small);}
+        maximum_displacement = run_options().step;
+        REQUIRE(stats_small.disp_accepted > stats.disp_accepted);
+    }
+
+    SECTION("Check if the flip kernel keeps the positions") {
+        run_stats stats;
+        generator.Seed(12345);
+        for (int t = 0; t < sweeps; t++) Sweep<flip_moves>(cfg, T, 1, stats);
+        REQUIRE(cfg.X == cfg_ref.X);
+        REQUIRE(cfg.Xfull == cfg_ref.Xfull);
+        REQUIRE(stats.flip_trials == (long long)sweeps*N);
+        REQUIRE(stats.disp_trials == 0);
+        REQUIRE(stats.flip_accepted > 0);
+        // Flips only exchange diameters inside molecules
+        for (int m = 0; m < N; m += 3) {
+            std::vector<int> types(cfg.S.begin()+m, cfg.S.begin()+m+3), ref(cfg_ref.S.begin()+m, cfg_ref.S.begin()+m+3);
+            std::sort(types.begin(), types.end()); std::sort(ref.begin(), ref.end());
+            REQUIRE(types == ref);
+        }
+    }
+}
+
+TEST_CASE("Test inter-molecular swaps", "[test_simulation][Swap]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    cfg.UpdateNL(); cfg.GetBonds();
+    int counts[3] = {0, 0, 0};
+    for (int s: cfg.S) counts[s-1]++;
+    generator.Seed(12345);
+
+    SECTION("Check if swaps conserve the types but not the molecules' compositions") {
+        int accepted = 0;
+        for (int i = 0; i < 5*N; i++) accepted += TrySwap(cfg, floor(ranf()*N), 2.0, false);
+        REQUIRE(accepted > 0);
+        int swapped[3] = {0, 0, 0}, mixed = 0;
+        for (int s: cfg.S) swapped[s-1]++;
+        for (int m = 0; m < N; m += 3) mixed += (cfg.S[m] == cfg.S[m+1] || cfg.S[m] == cfg.S[m+2] || cfg.S[m+1] == cfg.S[m+2]);
+        REQUIRE(std::vector<int>(swapped, swapped+3) == std::vector<int>(counts, counts+3));
+        REQUIRE(mixed > 0);
+    }
+
+    SECTION("Check if only swaps lowering the energy are accepted at vanishing temperature") {
+        double U = VTotal(cfg);
+        bool increased = false;
+        int accepted = 0;
+        for (int i = 0; i < 2000; i++) {
+            if (TrySwap(cfg, floor(ranf()*N), 1e-12, false)) {
+                double U_new = VTotal(cfg);
+                if (U_new > U + 1e-9) increased = true;
+                U = U_new; accepted++;
+            }
+        }
+        REQUIRE(accepted > 0);
+        REQUIRE(increased == false);
+    }
+
+    SECTION("Check if local swaps exchange types with a neighbour of another molecule") {
+        bool outside = false;
+        int accepted = 0;
+        for (int i = 0; i < 500; i++) {
+            int j = floor(ranf()*N);
+            std::vector<int> before = cfg.S;
+            if (!TrySwap(cfg, j, 1e12, true)) continue;
+            accepted++;
+            for (int k = 0; k < N; k++) {
+                if (k == j || cfg.S[k] == before[k]) continue;
+                const std::vector<int>& neighbours = cfg.neighbours_list[j];
+                if (k/3 == j/3 || std::find(neighbours.begin(), neighbours.end(), k) == neighbours.end()) outside = true;
+            }
+        }
+        REQUIRE(accepted > 0);
+        REQUIRE(outside == false);
+    }
+
+    SECTION("Check if a run performs and reports the swaps") {
+        double T, p_flip;
+        int tau, cycles, tw, n_log, n_lin;
+        std::string out;
+        std::vector<std::string> observables = {"U"};
+        std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+        ReadJSONParams(params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip);
+        MakeOutDir(out, params_path);
+        run_options opts;
+        opts.swap_fraction = 0.2; opts.swap_local = true; opts.stats_every = 100;
+        MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+        std::vector<std::vector<double>> rows = ReadObsTable(out + "stats.txt");
+        REQUIRE((rows.back()[14] > 0 && rows.back()[14] < 1));
+        REQUIRE(CountLines(out + "stats.json", "\"swap_acceptance\": 0.") == 1);
+        fs::remove_all(out);
+    }
+}
+
+TEST_CASE("Test heat-bath flips", "[test_simulation][HeatBath]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    cfg.UpdateNL();
+    generator.Seed(12345);
+
+    // Kernels with heat-bath flips
+    REQUIRE(SelectSweep(0.0, true) == &Sweep<displacement_moves>);
+    REQUIRE(SelectSweep(1.0, true) == &Sweep<flip_moves, true>);
+    REQUIRE(SelectSweep(0.2, true) == &Sweep<mixed_moves, true>);
+
+    // Trimer with three different types
+    int first = -1;
+    for (int i = 0; i < N && first < 0; i += 3) {
+        if (cfg.S[i] != cfg.S[i+1] && cfg.S[i] != cfg.S[i+2] && cfg.S[i+1] != cfg.S[i+2]) first = i;
+    }
+    REQUIRE(first >= 0);
+    std::vector<std::vector<int>> arrangements;
+    std::vector<double> energies;
+    std::vector<int> types = {1, 2, 3};
+    do {
+        configuration trial = cfg;
+        for (int a = 0; a < 3; a++) trial.S[first+a] = types[a];
+        arrangements.push_back(types);
+        energies.push_back(VTotal(trial)/2);
+    } while (std::next_permutation(types.begin(), types.end()));
+
+    SECTION("Check if arrangements are drawn with their Boltzmann weights") {
+        const double T = 2.0;
+        std::vector<double> weights;
+        double total = 0;
+        for (double E: energies) {weights.push_back(exp(-(E - energies[0])/T)); total += weights.back();}
+        std::vector<int> counts(6, 0);
+        const int draws = 20000;
+        for (int n = 0; n < draws; n++) {
+            TryHeatBathFlip(cfg, first + n%3, T);
+            std::vector<int> current(cfg.S.begin() + first, cfg.S.begin() + first + 3);
+            counts[std::find(arrangements.begin(), arrangements.end(), current) - arrangements.begin()]++;
+        }
+        for (int c = 0; c < 6; c++) {
+            REQUIRE(double(counts[c])/draws == Approx(weights[c]/total).margin(0.015));
+        }
+    }
+
+    SECTION("Check if the lowest arrangement is drawn at vanishing temperature") {
+        int lowest = std::min_element(energies.begin(), energies.end()) - energies.begin();
+        TryHeatBathFlip(cfg, first, 1e-12);
+        REQUIRE(std::vector<int>(cfg.S.begin() + first, cfg.S.begin() + first + 3) == arrangements[lowest]);
+        REQUIRE(TryHeatBathFlip(cfg, first+1, 1e-12) == false);
+    }
+
+    SECTION("Check if heat-bath flips change the types more often than Metropolis flips") {
+        configuration metropolis = cfg;
+        int accepted = 0, changed = 0;
+        for (int i = 0; i < 5*N; i++) {
+            int j = floor(ranf()*N);
+            accepted += TryFlip(metropolis, j, 2.0);
+            changed += TryHeatBathFlip(cfg, j, 2.0);
+        }
+        REQUIRE(changed > accepted);
+        for (int i = 0; i < N; i += 3) {
+            std::vector<int> before(metropolis.S.begin() + i, metropolis.S.begin() + i + 3);
+            std::vector<int> after(cfg.S.begin() + i, cfg.S.begin() + i + 3);
+            std::sort(before.begin(), before.end()); std::sort(after.begin(), after.end());
+            REQUIRE(before == after);
+        }
+    }
+}
+
+TEST_CASE("Test molecules of other sizes", "[test_simulation][Topology]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration trimers = ReadTrimCFG(config_path);
+    trimers.UpdateNL();
+    // Each trimer split into a dimer and a monomer
+    std::vector<int> molecules(N);
+    for (int i = 0; i < N; i++) molecules[i] = 2*(i/3) + (i%3 == 2);
+    configuration cfg = trimers;
+    cfg.SetMolecules(molecules);
+    generator.Seed(12345);
+
+    SECTION("Check if the energy only counts the bonds of the molecules") {
+        REQUIRE(cfg.Molecules() == 2*N/3);
+        double removed = 0;
+        for (int i = 0; i < N; i += 3) {
+            for (int k = i; k < i+2; k++) {
+                removed += FENEPair(cfg.X[k], cfg.Y[k], cfg.Z[k], diameters[cfg.S[k]-1],
+                                    cfg.X[i+2], cfg.Y[i+2], cfg.Z[i+2], diameters[cfg.S[i+2]-1]);
+            }
+        }
+        REQUIRE(VTotal(trimers) - VTotal(cfg) == Approx(2*removed));
+    }
+
+    SECTION("Check if flips only exchange types inside the dimers") {
+        std::vector<int> before = cfg.S;
+        int accepted = 0;
+        for (int i = 0; i < 5*N; i++) accepted += TryFlip(cfg, floor(ranf()*N), 2.0);
+        REQUIRE(accepted > 0);
+        for (int i = 0; i < N; i += 3) {
+            REQUIRE(cfg.S[i+2] == before[i+2]);
+            REQUIRE(std::min(cfg.S[i], cfg.S[i+1]) == std::min(before[i], before[i+1]));
+            REQUIRE(std::max(cfg.S[i], cfg.S[i+1]) == std::max(before[i], before[i+1]));
+        }
+    }
+
+    SECTION("Check if swaps may pair particles of former trimers") {
+        bool inside = false, split = false;
+        for (int i = 0; i < 2000; i++) {
+            int j = floor(ranf()*N);
+            std::vector<int> before = cfg.S;
+            if (!TrySwap(cfg, j, 1e12, true)) continue;
+            for (int k = 0; k < N; k++) {
+                if (k == j || cfg.S[k] == before[k]) continue;
+                if (cfg.molecule[k] == cfg.molecule[j]) inside = true;
+                if (k/3 == j/3) split = true;
+            }
+        }
+        REQUIRE(inside == false);
+        REQUIRE(split == true);
+    }
+
+    SECTION("Check if a run keeps the molecules in its configuration files") {
+        double T, p_flip;
+        int tau, cycles, tw, n_log, n_lin;
+        std::string out;
+        std::vector<std::string> observables = {"U", "MSD_CM"};
+        std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+        ReadJSONParams(params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip);
+        MakeOutDir(out, params_path);
+        run_options opts;
+        opts.sort_every = 1;
+        MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+        configuration last = ReadTrimCFG(out + "configs/cfg_500.xy");
+        REQUIRE(last.molecule == molecules);
+        for (int i = 0; i < N; i += 3) {
+            double dx = MinimumImageDistance(last.X[i], last.X[i+1]);
+            double dy = MinimumImageDistance(last.Y[i], last.Y[i+1]);
+            double dz = MinimumImageDistance(last.Z[i], last.Z[i+1]);
+            REQUIRE(dx*dx + dy*dy + dz*dz < 1.5*1.5*sigmaMax*sigmaMax);
+        }
+        std::vector<std::vector<double>> rows = ReadObsTable(out + "obs.txt");
+        REQUIRE(rows.back()[3] > 0);
+        fs::remove_all(out);
+    }
+}
+
+TEST_CASE("Test observables-only run", "[test_simulation][ComputeObservables]") {
+    // Reference configuration
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+
+    // Params 
+    double T;
+    int tau;
+    int cycles;
+    int tw;
+    double p_flip;
+    std::vector<std::string> observables = {"U", "MSD", "Fs"};
+    std::string out;
+    int n_log;
+    int n_lin;
+    std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+
+    ReadJSONParams(
+        params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip
+    );
+    generator.Seed(12345);
+    MakeOutDir(out, params_path);
+    MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false);
+    fs::rename(out + "obs.txt", out + "obs_run.txt");
+
+    // Serial and parallel replays write the same rows in the same order
+    run_options serial;
+    serial.threads = 1;
+    ComputeObservables(T, tau, cycles, tw, observables, out, n_log, false, serial);
+    fs::rename(out + "obs.txt", out + "obs_serial.txt");
+
+    run_options parallel;
+    parallel.threads = 4;
+    parallel.obs_binary = true;
+    ComputeObservables(T, tau, cycles, tw, observables, out, n_log, false, parallel);
+    REQUIRE(AreFilesIdentical(out + "obs.txt", out + "obs_serial.txt")==true);
+
+    // The binary file holds the rows of the text file at full precision
+    std::vector<std::vector<double>> binary;
+    ReadNpyTable(out + "obs.npy", binary);
+    std::vector<std::vector<double>> text = ReadObsTable(out + "obs.txt");
+    REQUIRE(binary.size() == text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        REQUIRE(binary[i].size() == text[i].size());
+        for (size_t j = 0; j < text[i].size(); j++) {
+            REQUIRE(binary[i][j] == Approx(text[i][j]).epsilon(1e-8).margin(1e-12));
+        }
+    }
+
+    // Replayed observables match the on-the-fly ones up to the precision of the snapshots
+    std::vector<std::vector<double>> run = ReadObsTable(out + "obs_run.txt");
+    std::vector<std::vector<double>> replay = ReadObsTable(out + "obs.txt");
+    REQUIRE(run.size() == replay.size());
+    for (size_t i = 0; i < run.size(); i++) {
+        REQUIRE(run[i].size() == replay[i].size());
+        for (size_t j = 0; j < run[i].size(); j++) {
+            REQUIRE(replay[i][j] == Approx(run[i][j]).epsilon(1e-5).margin(1e-7));
+        }
+    }
+
+    // Cleanup: Remove the output directory
+    fs::remove_all(out);
+}
+
+TEST_CASE("Test binary observables file", "[test_simulation][Npy]") {
+    std::string out = std::string(PROJECT_ROOT_DIR) + "/tests/output/";
+    fs::create_directories(out);
+    std::string file = out + "obs.npy";
+    std::vector<std::string> columns = {"U", "Q", "chi4", "Fs:3.5"};
+    std::vector<std::vector<double>> rows;
+
+    SECTION("Check if rows are written in batches with the column names in the header") {
+        npy_table table;
+        table.Create(file, columns, 3);
+        REQUIRE(fs::file_size(file) % 64 == 0);
+        for (int k = 0; k < 5; k++) table.Write(k+1, k%2, {0.5*k, 1, -1.*k, 1e-300});
+        // The last two rows are still buffered
+        std::string header = ReadNpyTable(file, rows);
+        REQUIRE(rows.size() == 3);
+        REQUIRE(header.find("('t', '<i8'), ('cycle', '<i8'), ('U', '<f8'), ('Q', '<f8'), ('chi4', '<f8'), ('Fs:3.5', '<f8')") != std::string::npos);
+        std::streamoff size = table.Flush();
+        REQUIRE(size == (std::streamoff)fs::file_size(file));
+        ReadNpyTable(file, rows);
+        REQUIRE(rows.size() == 5);
+        REQUIRE(rows[4] == std::vector<double>({5, 0, 2, 1, -4, 1e-300}));
+        REQUIRE_THROWS_AS(table.Write(6, 0, {1, 2}), std::invalid_argument);
+    }
+
+    SECTION("Check if reopening discards the rows written after the checkpoint") {
+        std::streamoff offset;
+        {
+            npy_table table;
+            table.Create(file, columns);
+            for (int k = 0; k < 4; k++) table.Write(k+1, 0, {1, 2, 3, 4});
+            offset = table.Flush();
+            for (int k = 4; k < 10; k++) table.Write(k+1, 0, {1, 2, 3, 4});
+        }
+        ReadNpyTable(file, rows);
+        REQUIRE(rows.size() == 10);
+        npy_table other;
+        REQUIRE_THROWS_AS(other.Reopen(file, {"U", "MSD"}, offset), std::runtime_error);
+        npy_table table;
+        table.Reopen(file, columns, offset);
+        table.Write(5, 1, {5, 6, 7, 8});
+        table.Close();
+        ReadNpyTable(file, rows);
+        REQUIRE(rows.size() == 5);
+        REQUIRE(rows[3][0] == 4);
+        REQUIRE(rows[4] == std::vector<double>({5, 1, 5, 6, 7, 8}));
+    }
+    fs::remove_all(out);
+}
+
+TEST_CASE("Test manifest of jobs", "[test_simulation][Manifest]") {
+    std::string root = std::string(PROJECT_ROOT_DIR);
+    std::string out = root + "/tests/output/";
+    fs::create_directory(out);
+
+    // Two identical jobs running concurrently and a job with missing parameters
+    std::string manifest_path = out + "manifest.json";
+    {
+        std::ofstream manifest(manifest_path);
+        manifest << "{\"jobs\": [" << std::endl;
+        for (int j = 0; j < 2; j++) {
+            manifest << "    {\"params\": \"" << root << "/tests/params/params.json\", \"init\": \"" << root
+                     << "/tests/config/initconf.xyz\", \"rootdir\": \"" << out << "job" << j
+                     << "\", \"seed\": 12345}," << std::endl;
+        }
+        manifest << "    {\"params\": \"" << out << "missing.json\", \"rootdir\": \"" << out << "job2\"}" << std::endl;
+        manifest << "]}" << std::endl;
+    }
+    // The missing parameters can only be detected when the job runs
+    std::vector<manifest_job> jobs = ReadManifest(manifest_path, {"U", "MSD", "Fs"}, run_options());
+    REQUIRE(jobs.size() == 3);
+    REQUIRE(jobs[0].rootdir == out + "job0/");
+    REQUIRE(jobs[0].seed == 12345);
+
+    int failed = RunManifest(jobs, 2, run_options(), out + "status.json");
+    REQUIRE(failed == 1);
+
+    // Each job used its own particles and generator: both runs are identical
+    REQUIRE(AreFilesIdentical(out + "job0/configs/cfg_500.xy", out + "job1/configs/cfg_500.xy")==true);
+    REQUIRE(AreFilesIdentical(out + "job0/obs.txt", out + "job1/obs.txt")==true);
+#ifndef TFMC_MIXED_PRECISION
+    REQUIRE(AreFilesIdentical(out + "job0/configs/cfg_500.xy", root + "/tests/reference/cfg_500.xy")==true);
+    REQUIRE(AreFilesIdentical(out + "job0/obs.txt", root + "/tests/reference/obs.txt")==true);
+#endif
+
+    std::ifstream status_file(out + "status.json");
+    std::stringstream status;
+    status << status_file.rdbuf();
+    REQUIRE(status.str().find("\"done\": 2,") != std::string::npos);
+    REQUIRE(status.str().find("\"failed\": 1,") != std::string::npos);
+
+    // Two jobs may not write into the same directory
+    {
+        std::ofstream manifest(manifest_path);
+        manifest << "{\"jobs\": [{\"params\": \"a.json\", \"rootdir\": \"" << out << "job0\"}, "
+                 << "{\"params\": \"b.json\", \"rootdir\": \"" << out << "job0/\"}]}" << std::endl;
+    }
+    REQUIRE_THROWS_AS(ReadManifest(manifest_path, {"U"}, run_options()), std::runtime_error);
+
+    // Cleanup: Remove the output directory
+    fs::remove_all(out);
+}
+
+TEST_CASE("Test skin tuning", "[test_simulation][Skin]") {
+    SECTION("Check if the search finds the cheapest skin") {
+        // Synthetic cost per sweep, lowest at a skin of 0.4
+        skin_tuner tuner(10, 0.7);
+        long long sweeps = 0;
+        double seconds = 0, skin = tuner.Update(sweeps, seconds);
+        while (!tuner.done) {
+            sweeps++; seconds += 1 + (skin-0.4)*(skin-0.4);
+            skin = tuner.Update(sweeps, seconds);
+        }
+        REQUIRE(skin == Approx(0.4));
+        REQUIRE(tuner.best_cost == Approx(1));
+        REQUIRE_THROWS_AS(skin_tuner(0, 0.7), std::invalid_argument);
+    }
+
+    SECTION("Check if the dynamics does not depend on the skin") {
+        std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+        configuration cfg = ReadTrimCFG(config_path);
+
+        double T;
+        int tau;
+        int cycles;
+        int tw;
+        double p_flip;
+        std::vector<std::string> observables = {"U", "MSD", "Fs"};
+        std::string out;
+        int n_log;
+        int n_lin;
+        std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+        ReadJSONParams(
+            params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip
+        );
+        generator.Seed(12345);
+        MakeOutDir(out, params_path);
+
+        // Each skin is measured for 20 sweeps
+        run_options opts;
+        opts.skin = 0.3;
+        opts.skin_tune = 20;
+        MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+
+        // Pairs outside the cutoff do not contribute, so the skin only changes the speed
+#ifndef TFMC_MIXED_PRECISION
+        REQUIRE(AreFilesIdentical(out + "configs/cfg_500.xy", 
+                                  std::string(PROJECT_ROOT_DIR) + "/tests/reference/cfg_500.xy")==true);
+        REQUIRE(AreFilesIdentical(out + "obs.txt", 
+                                  std::string(PROJECT_ROOT_DIR) + "/tests/reference/obs.txt")==true);
+#endif
+        REQUIRE(CountLines(out + "stats.json", "\"skin\": ") == 1);
+        REQUIRE(cfg.skin >= 0.1 - 1e-9);
+        REQUIRE(cfg.skin <= 1.5 + 1e-9);
+
+        fs::remove_all(out);
+    }
+}
+
+TEST_CASE("Test trimer generator", "[test_simulation][Generator]") {
+    generator.Seed(12345);
+    configuration cfg = GenerateTrimers();
+    REQUIRE(cfg.X.size() == N);
+
+    SECTION("Check if molecules are whole trimers without overlaps") {
+        for (int m = 0; m < N/3; m++) {
+            std::vector<int> types = {cfg.S[3*m], cfg.S[3*m+1], cfg.S[3*m+2]};
+            std::sort(types.begin(), types.end());
+            if (types != std::vector<int>({1, 2, 3})) FAIL("Molecule " << m << " is not a trimer");
+        }
+        double closest = 1e10, longest = 0;
+        bool in_box = true;
+        for (int i = 0; i < N; i++) {
+            in_box = in_box && cfg.X[i] >= 0 && cfg.X[i] < Size && cfg.Y[i] >= 0 && cfg.Y[i] < Size
+                            && cfg.Z[i] >= 0 && cfg.Z[i] < Size;
+            for (int k = i+1; k < N; k++) {
+                double sigma = (diameters[cfg.S[i]-1] + diameters[cfg.S[k]-1])/2;
+                if (i/3 == k/3) {
+                    // Bonds are measured on unwrapped positions
+                    double xij = cfg.Xfull[i]-cfg.Xfull[k], yij = cfg.Yfull[i]-cfg.Yfull[k];
+                    double zij = cfg.Zfull[i]-cfg.Zfull[k];
+                    longest = std::max(longest, sqrt(xij*xij + yij*yij + zij*zij)/sigma);
+                } else {
+                    double xij = MinimumImageDistance(double(cfg.X[i]), double(cfg.X[k]));
+                    double yij = MinimumImageDistance(double(cfg.Y[i]), double(cfg.Y[k]));
+                    double zij = MinimumImageDistance(double(cfg.Z[i]), double(cfg.Z[k]));
+                    closest = std::min(closest, sqrt(xij*xij + yij*yij + zij*zij)/sigma);
+                }
+            }
+        }
+        REQUIRE(in_box);
+        REQUIRE(closest >= 0.9 - 1e-6);
+        REQUIRE(longest < 1.5);
+        // Lists are not built by the generator, but the WCA part of the energy needs them
+        cfg.UpdateNL();
+        double fene = 0, wca = 0, largest = 0, listed = 0;
+        for (int i = 0; i < N; i++) {
+            listed += cfg.neighbours_list[i].size();
+            for (int k = 3*(i/3); k < 3*(i/3)+3; k++) {
+                if (k != i) fene += FENEPair(cfg.X[i], cfg.Y[i], cfg.Z[i], diameters[cfg.S[i]-1],
+                                             cfg.X[k], cfg.Y[k], cfg.Z[k], diameters[cfg.S[k]-1]);
+            }
+            for (int k: cfg.neighbours_list[i]) {
+                double pair = WCAPair(cfg.X[i], cfg.Y[i], cfg.Z[i], diameters[cfg.S[i]-1],
+                                      cfg.X[k], cfg.Y[k], cfg.Z[k], diameters[cfg.S[k]-1]);
+                wca += pair;
+                if (k/3 != i/3) largest = std::max(largest, pair);
+            }
+        }
+        // No pair is above the WCA energy of a contact at 0.9 times the mean diameter
+        double contact = WCAPair(0., 0., 0., 1., 0.9, 0., 0., 1.);
+        REQUIRE(largest > 0);
+        REQUIRE(largest <= contact*(1 + 1e-6));
+        REQUIRE(VTotal(cfg) == Approx(wca + fene));
+        // Energy per particle bounded accordingly (bonded pairs are at most at the same contact)
+        REQUIRE((VTotal(cfg) - fene)/(2*N) <= contact*listed/(2*N));
+    }
+
+    SECTION("Check if the configuration can be written and run") {
+        std::string out = std::string(PROJECT_ROOT_DIR) + "/tests/output/";
+        fs::create_directory(out);
+        WriteTrimCFG(cfg, out + "init.xyz");
+        configuration read = ReadTrimCFG(out + "init.xyz");
+        REQUIRE(read.S == cfg.S);
+        cfg.UpdateNL(); read.UpdateNL();
+        REQUIRE(VTotal(read) == Approx(VTotal(cfg)));
+
+        std::vector<std::string> observables = {"U"};
+        run_options opts;
+        opts.stats_every = 0;
+        MonteCarloRun(read, 2.0, 100, 1, 1, 0.2, observables, out, 5, 5, false, opts);
+        REQUIRE(std::isfinite(VTotal(read)));
+        fs::remove_all(out);
+    }
+
+    SECTION("Check if invalid settings are rejected") {
+        int n = N;
+        N = 3001;
+        REQUIRE_THROWS_AS(GenerateTrimers(), std::invalid_argument);
+        N = n;
+        REQUIRE_THROWS_AS(GenerateTrimers(0.95, 0), std::invalid_argument);
+        // Overlaps left by the placement are not relaxed without iterations
+        REQUIRE_THROWS_AS(GenerateTrimers(0.95, 1, 0.99, 0), std::runtime_error);
+    }
+}
+
+TEST_CASE("Test averaging over cycles", "[test_simulation][Averages]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+    double T, p_flip;
+    int tau, cycles, tw, n_log, n_lin;
+    std::string out;
+    ReadJSONParams(params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip);
+    std::vector<std::string> observables = {"MSD", "Q"};
+    tau = 200; cycles = 4; tw = 50;
+
+    SECTION("Check if the streaming averages match the rows of each cycle") {
+        Size = pow(N/density, 1./3.);
+        run_options opts;
+        opts.obs_average = true;
+        MakeOutDir(out, params_path);
+        configuration cfg = ReadTrimCFG(config_path);
+        generator.Seed(12345);
+        MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+
+        // Rows of obs.txt (t cycle MSD Q chi4) grouped by lag
+        std::map<int, std::vector<std::vector<double>>> lags;
+        for (const std::vector<double>& row: ReadObsTable(out + "obs.txt")) {
+            lags[int(row[0]) - tw*int(row[1]) - 1].push_back(row);
+        }
+        // Rows of obs_avg.txt (lag samples MSD MSD_var MSD_err Q Q_var Q_err chi4)
+        std::vector<std::vector<double>> averages = ReadObsTable(out + "obs_avg.txt");
+        REQUIRE(averages.size() == lags.size());
+        for (const std::vector<double>& avg: averages) {
+            const std::vector<std::vector<double>>& rows = lags[int(avg[0])];
+            double n = rows.size();
+            REQUIRE(avg[1] == n);
+            for (int k = 0; k < 2; k++) {
+                double sum = 0, sum2 = 0;
+                for (const std::vector<double>& row: rows) {sum += row[2+k]; sum2 += row[2+k]*row[2+k];}
+                double mean = sum/n, var = n > 1 ? (sum2 - n*mean*mean)/(n-1) : 0;
+                REQUIRE(avg[2+3*k] == Approx(mean).epsilon(1e-7));
+                REQUIRE(avg[3+3*k] == Approx(var).epsilon(1e-5).margin(1e-12));
+                REQUIRE(avg[4+3*k] == Approx(sqrt(var/n)).epsilon(1e-5).margin(1e-12));
+            }
+            // chi4 over all the cycles is the one of the last row of obs.txt
+            REQUIRE(avg[8] == Approx(rows.back()[4]).epsilon(1e-5).margin(1e-9));
+        }
+
+        // Same run without the raw rows
+        std::string avg_path = out + "obs_avg.txt", ref_path = out + "obs_avg_ref.txt";
+        fs::rename(avg_path, ref_path);
+        fs::remove(out + "obs.txt");
+        opts.obs_raw = false;
+        cfg = ReadTrimCFG(config_path);
+        generator.Seed(12345);
+        MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+        REQUIRE(!fs::exists(out + "obs.txt"));
+        REQUIRE(AreFilesIdentical(avg_path, ref_path)==true);
+
+        fs::remove_all(out);
+    }
+}
+
+TEST_CASE("Test live export", "[test_simulation][Live]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    live_frame frame;
+    std::vector<int> S;
+    std::vector<double> X, Y, Z;
+
+    SECTION("Check if a published frame is read back in the original order") {
+        std::string name = LiveName(std::string(PROJECT_ROOT_DIR) + "/tests/output/");
+        REQUIRE_THROWS_AS(live_reader(name), std::runtime_error);
+        live_export live(name);
+        live_reader reader(name);
+        REQUIRE(reader.Particles() == N);
+        REQUIRE(reader.Read(frame, S, X, Y, Z) == false);
+
+        // Molecules stored in reverse order
+        std::vector<int> order(N);
+        for (int i = 0; i < N; i++) order[i] = 3*(N/3-1-i/3) + i%3;
+        configuration sorted = cfg;
+        sorted.Permute(order);
+        for (int k = 0; k < 6; k++) {
+            live_frame published;
+            published.t = 10*k; published.equilibrating = false; published.Size = Size; published.U = k;
+            live.Publish(sorted, published, order);
+        }
+        REQUIRE(reader.Read(frame, S, X, Y, Z) == true);
+        REQUIRE(frame.frame == 5);
+        REQUIRE(frame.t == 50);
+        REQUIRE(frame.U == 5);
+        REQUIRE(S == cfg.S);
+        REQUIRE(X == std::vector<double>(cfg.Xfull.begin(), cfg.Xfull.end()));
+        REQUIRE(Z == std::vector<double>(cfg.Zfull.begin(), cfg.Zfull.end()));
+    }
+
+    SECTION("Check if a reader sees consistent frames while the run goes") {
+        double T, p_flip;
+        int tau, cycles, tw, n_log, n_lin;
+        std::string out;
+        std::vector<std::string> observables = {"U", "MSD", "Fs"};
+        std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+        ReadJSONParams(params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip);
+        generator.Seed(12345);
+        MakeOutDir(out, params_path);
+
+        // Flips exchange types within molecules, so every frame holds N/3 particles of each type
+        std::atomic<bool> running(true);
+        int frames = 0, inconsistent = 0, last_t = -1;
+        std::thread monitor([&](){
+            while (running) {
+                try {
+                    live_reader reader(LiveName(out));
+                    while (running && reader.Read(frame, S, X, Y, Z)) {
+                        int counts[3] = {0, 0, 0};
+                        for (int s: S) counts[s-1]++;
+                        if (frame.t%10 != 0 || frame.t < last_t || counts[0] != N/3 || counts[2] != N/3) inconsistent++;
+                        if (frame.t != last_t) frames++;
+                        last_t = frame.t;
+                    }
+                } catch (const std::runtime_error&) {
+                    // Segment not created yet or already removed
+                }
+                std::this_thread::yield();
+            }
+        });
+        run_options opts;
+        opts.live_every = 10;
+        MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+        running = false;
+        monitor.join();
+
+        REQUIRE(inconsistent == 0);
+        REQUIRE(frames > 0);
+        // The export does not change the run and is removed at its end
+#ifndef TFMC_MIXED_PRECISION
+        REQUIRE(AreFilesIdentical(out + "obs.txt", std::string(PROJECT_ROOT_DIR) + "/tests/reference/obs.txt")==true);
+#endif
+        REQUIRE_THROWS_AS(live_reader(LiveName(out)), std::runtime_error);
+        fs::remove_all(out);
+    }
+}
+
+TEST_CASE("Test isobaric volume moves", "[test_simulation][NPT]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    configuration cfg = ReadTrimCFG(config_path);
+    cfg.UpdateNL(); cfg.GetBonds();
+    double size = Size;
+
+    SECTION("Check if the neighbours lists stay valid while the box expands") {
+        // The initial configuration is above this pressure, so the box grows
+        generator.Seed(12345);
+        int accepted = 0, rebuilds = 0;
+        for (int t = 0; t < 200; t++) {
+            RunSweeps(cfg, 0.5, 0.2, 1);
+            bool rebuilt = false;
+            accepted += TryVolume(cfg, 0.5, 10., 0.002, &rebuilt);
+            rebuilds += rebuilt;
+        }
+        REQUIRE(accepted > 20);
+        // Compressions past the margin of the lists rebuild them, which the caller counts
+        REQUIRE(rebuilds > 0);
+        REQUIRE(accepted < 180);
+        REQUIRE(N/(Size*Size*Size) < 1.15);
+
+        bool in_box = true;
+        for (int i = 0; i < N; i++) {
+            if (cfg.X[i] < 0 || cfg.X[i] > Size || cfg.Y[i] < 0 || cfg.Y[i] > Size || cfg.Z[i] < 0 || cfg.Z[i] > Size) in_box = false;
+        }
+        REQUIRE(in_box);
+        configuration rebuilt = cfg;
+        rebuilt.UpdateNL();
+        REQUIRE(VTotal(cfg) == Approx(VTotal(rebuilt)));
+        Size = size;
+    }
+
+    SECTION("Check if a run samples the density and reports the volume moves") {
+        double T, p_flip;
+        int tau, cycles, tw, n_log, n_lin;
+        std::string out;
+        std::vector<std::string> observables = {"U", "rho", "P"};
+        std::string params_path = std::string(PROJECT_ROOT_DIR) + "/tests/params/params.json";
+        ReadJSONParams(params_path, out, N, T, tau, tw, cycles, n_log, n_lin, p_flip);
+        generator.Seed(12345);
+        MakeOutDir(out, params_path);
+
+        run_options opts;
+        opts.pressure = 10; opts.volume_every = 2; opts.stats_every = 100;
+        MonteCarloRun(cfg, T, tau, cycles, tw, p_flip, observables, out, n_log, n_lin, false, opts);
+        Size = size;
+
+        std::vector<std::vector<double>> rows = ReadObsTable(out + "obs.txt");
+        REQUIRE(rows.front()[3] == Approx(density));
+        REQUIRE(rows.back()[3] < rows.front()[3]);
+        REQUIRE(rows.back()[4] < rows.front()[4]);
+        REQUIRE(CountLines(out + "stats.txt", "volume_acceptance density") == 1);
+        REQUIRE(CountLines(out + "stats.json", "\"volume_acceptance\": 0.") == 1);
+        fs::remove_all(out);
+    }
+}
@@ -1,6 +1,8 @@
 #include <catch2/catch.hpp>
 #include <string>
 #include <vector>
+#include <fstream>
+#include <boost/filesystem.hpp>
 #include "globals.hpp"
 #include "utils.hpp"
 
@@ -22,4 +24,38 @@ TEST_CASE("Test ParseCMDLine function", "[test_utils][ParseCMDLine]") {
     REQUIRE(input == "input.cfg");
     REQUIRE(params == "params.json");
     REQUIRE(observables.size() == 2);
-}
\ No newline at end of file
+
+    SECTION("Check that a generated configuration cannot be combined with --init") {
+        const char* generate[] = {"program", "--init", "input.cfg", "--params", "params.json", "--generate"};
+        run_options opts;
+        REQUIRE(ParseCMDLine(6, generate, input, params, observables, opts) == false);
+    }
+}
+TEST_CASE("Test ReadTrimCFG function", "[test_utils][ReadTrimCFG]") {
+    std::string config_path = std::string(PROJECT_ROOT_DIR) + "/tests/config/initconf.xyz";
+    std::string out = std::string(PROJECT_ROOT_DIR) + "/tests/output/read/";
+    boost::filesystem::create_directories(out);
+    configuration cfg = ReadTrimCFG(config_path);
+
+    SECTION("Check that truncated files are rejected") {
+        {
+            std::ofstream truncated(out + "truncated.xyz");
+            for (int i = 0; i < N/2; i++) truncated << cfg.S[i] << " " << cfg.Xfull[i] << " " << cfg.Yfull[i] << " " << cfg.Zfull[i] << std::endl;
+        }
+        configuration buffer = cfg;
+        REQUIRE_THROWS_AS(ReadTrimCFG(out + "truncated.xyz", buffer), std::runtime_error);
+    }
+
+    SECTION("Check that lines with missing columns are rejected") {
+        {
+            std::ofstream missing(out + "missing.xyz");
+            for (int i = 0; i < N; i++) {
+                missing << cfg.S[i] << " " << cfg.Xfull[i] << " " << cfg.Yfull[i];
+                if (i != 7) missing << " " << cfg.Zfull[i];
+                missing << std::endl;
+            }
+        }
+        REQUIRE_THROWS_AS(ReadTrimCFG(out + "missing.xyz"), std::runtime_error);
+    }
+    boost::filesystem::remove_all(out);
+}
@@ -0,0 +1,89 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "globals.hpp"
+#include "live.hpp"
+
+namespace po = boost::program_options;
+
+// Globals that are normally defined in the main file (unused by the reader)
+__thread int N = 0;
+__thread double Size = 0;
+
+//-----------------------------------------------------------------------------
+//  Dumps the current frame of a running simulation
+int main(int argc, const char * argv[]) {
+    std::string rootdir, name, output;
+    double wait;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Produce help message")
+        ("rootdir", po::value<std::string>(&rootdir)->default_value(""), "Output directory of the running simulation")
+        ("name", po::value<std::string>(&name)->default_value(""), "Name of the shared memory segment (instead of --rootdir)")
+        ("output", po::value<std::string>(&output)->default_value(""), 
+                   "Path to write the configuration of the frame (format of rootdir/configs/)")
+        ("wait", po::value<double>(&wait)->default_value(0), "Seconds to wait for the simulation to publish a frame");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const po::error& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    if (name.empty() && rootdir.empty()) {
+        std::cerr << "Error: one of the options '--rootdir' or '--name' is required" << std::endl;
+        return 1;
+    }
+    if (name.empty()) name = LiveName(rootdir.back() == '/' ? rootdir : rootdir + "/");
+
+    // Waiting for the segment and its first frame
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    auto waited = [&](){
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    live_frame frame;
+    std::vector<int> S;
+    std::vector<double> X, Y, Z;
+    while (true) {
+        try {
+            live_reader reader(name);
+            if (reader.Read(frame, S, X, Y, Z)) break;
+            if (waited() >= wait) {
+                std::cerr << "Error: no frame published yet in " << name << std::endl;
+                return 1;
+            }
+        } catch (const std::runtime_error& ex) {
+            if (waited() >= wait) {
+                std::cerr << "Error: " << ex.what() << std::endl;
+                return 1;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::cout << "Frame " << frame.frame << " at sweep " << frame.t
+              << (frame.equilibrating ? " of the equilibration" : "") << std::endl;
+    std::cout << "N = " << S.size() << ", L = " << frame.Size << ", U = " << frame.U << std::endl;
+    frame.stats.Print(std::cout);
+
+    if (!output.empty()) {
+        std::ofstream log_cfg(output);
+        log_cfg << std::scientific << std::setprecision(8);
+        for (size_t i = 0; i < S.size(); i++) {
+            log_cfg << S[i] << " " << X[i] << " " << Y[i] << " " << Z[i] << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include "globals.hpp"
+#include "histogram.hpp"
+
+namespace po = boost::program_options;
+
+// Globals that are normally defined in the main file (unused by the reweighting)
+__thread int N = 0;
+__thread double Size = 0;
+
+// Writes one row per temperature
+void PrintAverages(const std::vector<reweighted_averages>& averages, const std::vector<std::string>& columns,
+                   bool isobaric, std::ostream& os){
+    os << "T n_eff " << (isobaric ? "h cp" : "e cv");
+    for (const std::string& name: columns) os << " " << name;
+    os << std::endl << std::scientific << std::setprecision(8);
+    for (const reweighted_averages& a: averages){
+        os << a.T << " " << a.effective_samples << " " << a.energy << " " << a.heat_capacity;
+        for (double value: a.values) os << " " << value;
+        os << std::endl;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//  Reweights the energy histograms of one or more runs to other temperatures
+int main(int argc, const char * argv[]) {
+    std::vector<std::string> inputs;
+    std::vector<double> temperatures;
+    std::string output;
+    double tolerance;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Produce help message")
+        ("histograms", po::value<std::vector<std::string>>(&inputs)->multitoken()->required(),
+                       "Energy histograms of the runs (rootdir/histogram.txt)")
+        ("T", po::value<std::vector<double>>(&temperatures)->multitoken()->required(), "Temperatures to reweight to")
+        ("tolerance", po::value<double>(&tolerance)->default_value(1e-10),
+                      "Largest change of the free energies between two iterations of the multiple histogram method")
+        ("output", po::value<std::string>(&output)->default_value(""), "Output file (standard output if empty)");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const po::error& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    try {
+        std::vector<energy_histogram> runs;
+        for (const std::string& input: inputs) runs.push_back(ReadHistogram(input));
+        std::vector<reweighted_averages> averages = Reweight(runs, temperatures, tolerance);
+        if (output.empty()) {
+            PrintAverages(averages, runs[0].columns, runs[0].isobaric, std::cout);
+        } else {
+            std::ofstream out(output);
+            PrintAverages(averages, runs[0].columns, runs[0].isobaric, out);
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}